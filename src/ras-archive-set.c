@@ -0,0 +1,282 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-archive-set.h"
+
+#include "ras-utils.h"
+
+#include <iso646.h>
+
+typedef struct
+{
+    RasArchive *archive;
+    int priority;
+    /* Breaks ties between archives with the same priority. */
+    uint64_t sequence;
+} RasMount;
+
+struct _RasArchiveSet
+{
+    GObject parent_instance;
+
+    /* From the lowest precedence to the highest. */
+    GPtrArray *mounts;
+    uint64_t next_sequence;
+
+    /* Full paths to the mounts that files are found in. The keys belong to
+     * the archives of those mounts.
+     */
+    GHashTable *paths;
+};
+
+G_DEFINE_TYPE (RasArchiveSet, ras_archive_set, G_TYPE_OBJECT)
+
+static void
+free_mount (void *data)
+{
+    RasMount *mount;
+
+    mount = data;
+
+    g_object_unref (mount->archive);
+    g_free (mount);
+}
+
+static void
+ras_archive_set_finalize (GObject *object)
+{
+    RasArchiveSet *self;
+
+    self = RAS_ARCHIVE_SET (object);
+
+    /* The keys are owned by the mounted archives. */
+    g_clear_pointer (&self->paths, g_hash_table_destroy);
+    g_clear_pointer (&self->mounts, g_ptr_array_unref);
+
+    G_OBJECT_CLASS (ras_archive_set_parent_class)->finalize (object);
+}
+
+static void
+ras_archive_set_class_init (RasArchiveSetClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = ras_archive_set_finalize;
+}
+
+static void
+ras_archive_set_init (RasArchiveSet *self)
+{
+    self->mounts = g_ptr_array_new_with_free_func (free_mount);
+    self->next_sequence = 0;
+    self->paths = g_hash_table_new (ras_path_hash, ras_path_equal);
+}
+
+/* Whether files in @a hide those in @b. */
+static bool
+mount_precedes (const RasMount *a,
+                const RasMount *b)
+{
+    if (a->priority not_eq b->priority)
+    {
+        return a->priority > b->priority;
+    }
+
+    return a->sequence > b->sequence;
+}
+
+static bool
+find_mount (RasArchiveSet *set,
+            RasArchive    *archive,
+            unsigned int  *index)
+{
+    for (unsigned int i = 0; i < set->mounts->len; i++)
+    {
+        RasMount *mount;
+
+        mount = g_ptr_array_index (set->mounts, i);
+        if (archive == mount->archive)
+        {
+            *index = i;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+ras_archive_set_mount (RasArchiveSet *self,
+                       RasArchive    *archive,
+                       int            priority)
+{
+    unsigned int index;
+    RasMount *mount;
+    g_autoptr (GList) paths = NULL;
+
+    g_return_if_fail (RAS_IS_ARCHIVE_SET (self));
+    g_return_if_fail (RAS_IS_ARCHIVE (archive));
+    g_return_if_fail (!find_mount (self, archive, &index));
+
+    mount = g_new0 (RasMount, 1);
+
+    mount->archive = g_object_ref (archive);
+    mount->priority = priority;
+    mount->sequence = self->next_sequence++;
+
+    /* Mounts of higher priority stay above. */
+    index = self->mounts->len;
+    while (index > 0 && mount_precedes (g_ptr_array_index (self->mounts, index - 1), mount))
+    {
+        index--;
+    }
+
+    g_ptr_array_insert (self->mounts, index, mount);
+
+    paths = ras_archive_get_paths (archive);
+
+    for (GList *l = paths; NULL != l; l = l->next)
+    {
+        RasMount *current;
+
+        current = g_hash_table_lookup (self->paths, l->data);
+        if (NULL != current && mount_precedes (current, mount))
+        {
+            continue;
+        }
+
+        /* Replaces the key as well, since it belongs to the archive. */
+        g_hash_table_replace (self->paths, l->data, mount);
+    }
+}
+
+bool
+ras_archive_set_unmount (RasArchiveSet *self,
+                         RasArchive    *archive)
+{
+    unsigned int index;
+    RasMount *mount;
+    g_autoptr (GList) paths = NULL;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_SET (self), false);
+    g_return_val_if_fail (RAS_IS_ARCHIVE (archive), false);
+
+    if (!find_mount (self, archive, &index))
+    {
+        return false;
+    }
+
+    /* Freed once no keys refer to its archive. */
+    mount = g_ptr_array_steal_index (self->mounts, index);
+    paths = ras_archive_get_paths (archive);
+
+    for (GList *l = paths; NULL != l; l = l->next)
+    {
+        bool found;
+
+        if (mount not_eq g_hash_table_lookup (self->paths, l->data))
+        {
+            continue;
+        }
+
+        found = false;
+
+        for (unsigned int i = self->mounts->len; i > 0 && !found; i--)
+        {
+            RasMount *next;
+            const char *path;
+
+            next = g_ptr_array_index (self->mounts, i - 1);
+            found = ras_archive_lookup_extended (next->archive, l->data, &path, NULL);
+            if (found)
+            {
+                g_hash_table_replace (self->paths, (char *) path, next);
+            }
+        }
+
+        if (!found)
+        {
+            g_hash_table_remove (self->paths, l->data);
+        }
+    }
+
+    free_mount (mount);
+
+    return true;
+}
+
+RasFile *
+ras_archive_set_lookup (RasArchiveSet  *self,
+                        const char     *path,
+                        RasArchive    **archive)
+{
+    RasMount *mount;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_SET (self), NULL);
+    g_return_val_if_fail (NULL != path, NULL);
+
+    mount = g_hash_table_lookup (self->paths, path);
+    if (NULL == mount)
+    {
+        return NULL;
+    }
+
+    if (NULL != archive)
+    {
+        *archive = mount->archive;
+    }
+
+    return ras_archive_lookup (mount->archive, path);
+}
+
+GList *
+ras_archive_set_get_archives (RasArchiveSet *self)
+{
+    GList *archives;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_SET (self), NULL);
+
+    archives = NULL;
+
+    for (unsigned int i = self->mounts->len; i > 0; i--)
+    {
+        RasMount *mount;
+
+        mount = g_ptr_array_index (self->mounts, i - 1);
+        archives = g_list_prepend (archives, mount->archive);
+    }
+
+    return archives;
+}
+
+size_t
+ras_archive_set_get_file_count (RasArchiveSet *self)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE_SET (self), 0);
+
+    return g_hash_table_size (self->paths);
+}
+
+RasArchiveSet *
+ras_archive_set_new (void)
+{
+    return g_object_new (RAS_TYPE_ARCHIVE_SET, NULL);
+}
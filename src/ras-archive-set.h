@@ -0,0 +1,85 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-archive.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <glib-object.h>
+
+#define RAS_TYPE_ARCHIVE_SET (ras_archive_set_get_type ())
+
+G_BEGIN_DECLS
+
+/* Archives layered on top of each other, like a game with mods, where files
+ * in archives of higher priority hide those with the same path in others.
+ */
+G_DECLARE_FINAL_TYPE (RasArchiveSet, ras_archive_set, RAS, ARCHIVE_SET, GObject)
+
+/**
+ * ras_archive_set_mount:
+ * @set: a #RasArchiveSet
+ * @archive: the archive to mount
+ * @priority: the priority of @archive
+ *
+ * Adds @archive on top of archives with the same or a lower priority. Takes
+ * time in the number of files in @archive.
+ */
+void           ras_archive_set_mount          (RasArchiveSet *set,
+                                               RasArchive    *archive,
+                                               int            priority);
+/**
+ * ras_archive_set_unmount:
+ * @set: a #RasArchiveSet
+ * @archive: a mounted archive
+ *
+ * Removes @archive, uncovering files that it hid. Takes time in the number of
+ * files in @archive, times the number of archives for the ones it hid.
+ *
+ * Returns: whether @archive was mounted
+ */
+bool           ras_archive_set_unmount        (RasArchiveSet *set,
+                                               RasArchive    *archive);
+
+/**
+ * ras_archive_set_lookup:
+ * @set: a #RasArchiveSet
+ * @path: path of the file, matched as by ras_archive_lookup()
+ * @archive: (out) (optional) (transfer none): the archive that the file is in
+ *
+ * Finds the file with @path in the archive with the highest priority, or the
+ * one mounted last among those with the same priority, without going through
+ * the archives.
+ *
+ * Returns: (transfer none) (nullable): the file
+ */
+RasFile       *ras_archive_set_lookup         (RasArchiveSet  *set,
+                                               const char     *path,
+                                               RasArchive    **archive);
+
+/* Mounted archives, from the lowest precedence to the highest. */
+GList         *ras_archive_set_get_archives   (RasArchiveSet *set);
+/* The number of distinct paths across all mounted archives. */
+size_t         ras_archive_set_get_file_count (RasArchiveSet *set);
+
+RasArchiveSet *ras_archive_set_new            (void);
+
+G_END_DECLS
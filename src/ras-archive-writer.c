@@ -0,0 +1,789 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-archive-writer.h"
+
+#include "ras-archive.h"
+#include "ras-utils.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <iso646.h>
+#include <string.h>
+#include <zlib.h>
+
+/* Input is read, and the spool copied out, this much at a time. */
+#define BLOCK_SIZE 0x10000
+
+struct _RasArchiveWriter
+{
+    GObject parent_instance;
+
+    GOutputStream *stream;
+    uint32_t format_version;
+    int32_t encryption_seed;
+    RasLzssLevel compression_level;
+    unsigned int n_threads;
+
+    /* Entry data in file table order, spool_length bytes of it. */
+    GFile *spool_file;
+    GFileIOStream *spool;
+    uint64_t spool_length;
+
+    GByteArray *file_table;
+    uint32_t file_count;
+    GByteArray *directory_table;
+    uint32_t directory_count;
+
+    /* Directory paths to their indices, and full paths of files, both
+     * compared like ras_path_equal() does.
+     */
+    GHashTable *directory_index;
+    GHashTable *paths;
+
+    /* The spool could not be rewound after a failed entry. */
+    bool failed;
+    bool finished;
+};
+
+G_DEFINE_TYPE (RasArchiveWriter, ras_archive_writer, G_TYPE_OBJECT)
+
+static void
+delete_spool (RasArchiveWriter *self)
+{
+    if (NULL != self->spool)
+    {
+        (void) g_io_stream_close (G_IO_STREAM (self->spool), NULL, NULL);
+    }
+    if (NULL != self->spool_file)
+    {
+        (void) g_file_delete (self->spool_file, NULL, NULL);
+    }
+
+    g_clear_object (&self->spool);
+    g_clear_object (&self->spool_file);
+}
+
+static void
+ras_archive_writer_finalize (GObject *object)
+{
+    RasArchiveWriter *self;
+
+    self = RAS_ARCHIVE_WRITER (object);
+
+    delete_spool (self);
+
+    g_clear_object (&self->stream);
+    g_clear_pointer (&self->file_table, g_byte_array_unref);
+    g_clear_pointer (&self->directory_table, g_byte_array_unref);
+    g_clear_pointer (&self->directory_index, g_hash_table_destroy);
+    g_clear_pointer (&self->paths, g_hash_table_destroy);
+
+    G_OBJECT_CLASS (ras_archive_writer_parent_class)->finalize (object);
+}
+
+static void
+ras_archive_writer_class_init (RasArchiveWriterClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = ras_archive_writer_finalize;
+}
+
+static void
+ras_archive_writer_init (RasArchiveWriter *self)
+{
+    self->compression_level = RAS_LZSS_LEVEL_DEFAULT;
+    self->n_threads = 1;
+    self->file_table = g_byte_array_new ();
+    self->directory_table = g_byte_array_new ();
+    self->directory_index = g_hash_table_new_full (ras_path_hash, ras_path_equal,
+                                                   g_free, NULL);
+    self->paths = g_hash_table_new_full (ras_path_hash, ras_path_equal,
+                                         g_free, NULL);
+}
+
+static void
+append_uint32 (GByteArray *table,
+               uint32_t    value)
+{
+    value = GUINT32_TO_LE (value);
+
+    g_byte_array_append (table, (const uint8_t *) &value, sizeof (value));
+}
+
+static void
+set_uint32 (uint8_t  *header,
+            size_t    offset,
+            uint32_t  value)
+{
+    value = GUINT32_TO_LE (value);
+
+    memcpy (header + offset, &value, sizeof (value));
+}
+
+uint32_t
+ras_ensure_directory_entry (GHashTable *index,
+                            GByteArray *table,
+                            uint32_t   *count,
+                            const char *path,
+                            GDateTime  *creation_date_time)
+{
+    void *value;
+    const char *separator;
+    uint32_t directory_index;
+
+    g_return_val_if_fail (NULL != index, 0);
+    g_return_val_if_fail (NULL != table, 0);
+    g_return_val_if_fail (NULL != count, 0);
+    g_return_val_if_fail (NULL != path, 0);
+
+    if (g_hash_table_lookup_extended (index, path, NULL, &value))
+    {
+        return GPOINTER_TO_UINT (value);
+    }
+
+    /* Parents come before their children in the table. */
+    separator = strrchr (path, '\\');
+    if (NULL != separator)
+    {
+        g_autofree char *parent_path = NULL;
+
+        parent_path = g_strndup (path, separator - path);
+
+        (void) ras_ensure_directory_entry (index, table, count, parent_path, creation_date_time);
+    }
+
+    directory_index = (*count)++;
+
+    g_byte_array_append (table, (const uint8_t *) path, strlen (path) + 1);
+    ras_append_system_time (table, creation_date_time);
+
+    g_hash_table_insert (index, g_strdup (path), GUINT_TO_POINTER (directory_index));
+
+    return directory_index;
+}
+
+void
+ras_append_file_entry (GByteArray           *table,
+                       const char           *name,
+                       uint32_t              size,
+                       uint32_t              entry_size,
+                       uint32_t              directory_index,
+                       RasCompressionMethod  compression_method,
+                       GDateTime            *creation_date_time)
+{
+    g_return_if_fail (NULL != table);
+    g_return_if_fail (NULL != name);
+
+    g_byte_array_append (table, (const uint8_t *) name, strlen (name) + 1);
+    append_uint32 (table, size);
+    append_uint32 (table, entry_size);
+    append_uint32 (table, 0);
+    append_uint32 (table, directory_index);
+    append_uint32 (table, 0);
+    append_uint32 (table, compression_method);
+    ras_append_system_time (table, creation_date_time);
+}
+
+static bool
+check_usable (RasArchiveWriter  *self,
+              GError           **error)
+{
+    if (self->failed)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "The spool file could not be rewound after a failed entry");
+
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+write_counted (GOutputStream  *output,
+               const uint8_t  *data,
+               size_t          length,
+               uint64_t       *written,
+               GCancellable   *cancellable,
+               GError        **error)
+{
+    if (!g_output_stream_write_all (output, data, length, NULL, cancellable, error))
+    {
+        return false;
+    }
+
+    *written += length;
+
+    return true;
+}
+
+bool
+ras_write_entry (GIOStream             *output,
+                 GInputStream          *stream,
+                 RasCompressionMethod   compression_method,
+                 RasLzssLevel           level,
+                 unsigned int           n_threads,
+                 uint32_t              *size,
+                 uint64_t              *entry_size,
+                 GCancellable          *cancellable,
+                 GError               **error)
+{
+    GOutputStream *output_stream;
+    g_autofree uint8_t *buffer = NULL;
+    size_t block_size;
+    g_autoptr (RasLzssEncoder) encoder = NULL;
+    g_autoptr (RasLzssJoiner) joiner = NULL;
+    g_autoptr (GByteArray) tokens = NULL;
+    goffset header_offset;
+    uint64_t total;
+    uint64_t written;
+
+    g_return_val_if_fail (G_IS_SEEKABLE (output), false);
+    g_return_val_if_fail (G_IS_INPUT_STREAM (stream), false);
+
+    output_stream = g_io_stream_get_output_stream (output);
+    block_size = BLOCK_SIZE;
+    header_offset = g_seekable_tell (G_SEEKABLE (output));
+    total = 0;
+    written = 0;
+
+    if (RAS_FILE_COMPRESSION_METHOD_COMPRESS == compression_method)
+    {
+        uint8_t header[RAS_LZSS_HEADER_LENGTH] = { 0 };
+
+        if (0 == n_threads)
+        {
+            n_threads = g_get_num_processors ();
+        }
+
+        /* Enough input for a segment per thread at a time. */
+        if (n_threads > 1)
+        {
+            joiner = ras_lzss_joiner_new ();
+            block_size = (size_t) n_threads * RAS_LZSS_SEGMENT_SIZE;
+        }
+        else
+        {
+            encoder = ras_lzss_encoder_new (level);
+        }
+        /* Worst case is all literals, at 9 bits apiece. */
+        tokens = g_byte_array_sized_new (block_size + block_size / 8 + 1);
+
+        /* Filled in once the sizes are known. */
+        if (!write_counted (output_stream, header, sizeof (header), &written, cancellable, error))
+        {
+            return false;
+        }
+    }
+
+    buffer = g_malloc (block_size);
+
+    for (;;)
+    {
+        gsize length;
+
+        /* Filled completely, so that segments are as long as they can be. */
+        if (!g_input_stream_read_all (stream, buffer, block_size, &length, cancellable, error))
+        {
+            return false;
+        }
+        if (0 == length)
+        {
+            break;
+        }
+
+        total += length;
+        if (total > G_MAXUINT32)
+        {
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                 "Entries cannot be larger than 4 GiB");
+
+            return false;
+        }
+
+        if (NULL != encoder)
+        {
+            ras_lzss_encoder_push (encoder, buffer, length, tokens);
+        }
+        else if (NULL != joiner)
+        {
+            ras_lzss_compress_segments (buffer, length, level, n_threads, joiner, tokens);
+        }
+        else
+        {
+            if (!write_counted (output_stream, buffer, length, &written, cancellable, error))
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        if (!write_counted (output_stream, tokens->data, tokens->len, &written, cancellable, error))
+        {
+            return false;
+        }
+
+        g_byte_array_set_size (tokens, 0);
+    }
+
+    if (NULL != tokens)
+    {
+        uint8_t header[RAS_LZSS_HEADER_LENGTH];
+        uint64_t token_length;
+
+        if (NULL != encoder)
+        {
+            ras_lzss_encoder_finish (encoder, tokens);
+        }
+        else
+        {
+            ras_lzss_joiner_finish (joiner, tokens);
+        }
+
+        if (!write_counted (output_stream, tokens->data, tokens->len, &written, cancellable, error))
+        {
+            return false;
+        }
+
+        token_length = written - RAS_LZSS_HEADER_LENGTH;
+        if (token_length > G_MAXUINT32 - RAS_LZSS_HEADER_LENGTH)
+        {
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                                 "Entries cannot be larger than 4 GiB");
+
+            return false;
+        }
+
+        memcpy (header, RAS_LZSS_HEADER, strlen (RAS_LZSS_HEADER));
+        set_uint32 (header, 4, total);
+        set_uint32 (header, 8, token_length);
+
+        if (!g_seekable_seek (G_SEEKABLE (output), header_offset, G_SEEK_SET,
+                              cancellable, error)
+            || !g_output_stream_write_all (output_stream, header, sizeof (header), NULL,
+                                           cancellable, error)
+            || !g_seekable_seek (G_SEEKABLE (output), header_offset + written, G_SEEK_SET,
+                                 cancellable, error))
+        {
+            return false;
+        }
+    }
+
+    *size = total;
+    *entry_size = written;
+
+    return true;
+}
+
+bool
+ras_write_tables (GOutputStream  *stream,
+                  int32_t         encryption_seed,
+                  uint32_t        format_version,
+                  uint32_t        file_count,
+                  uint32_t        directory_count,
+                  GByteArray     *file_table,
+                  GByteArray     *directory_table,
+                  GCancellable   *cancellable,
+                  GError        **error)
+{
+    uint8_t header[RAS_HEADER_LENGTH] = { 0 };
+    uint32_t crc;
+
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), false);
+    g_return_val_if_fail (NULL != file_table, false);
+    g_return_val_if_fail (NULL != directory_table, false);
+
+    memcpy (header, RAS_MAGIC, RAS_MAGIC_LENGTH);
+    set_uint32 (header, RAS_HEADER_OFFSET_ENCRYPTION_SEED, (uint32_t) encryption_seed);
+    set_uint32 (header, RAS_HEADER_OFFSET_FILE_COUNT, file_count);
+    set_uint32 (header, RAS_HEADER_OFFSET_DIRECTORY_COUNT, directory_count);
+    set_uint32 (header, RAS_HEADER_OFFSET_FILE_TABLE_SIZE, file_table->len);
+    set_uint32 (header, RAS_HEADER_OFFSET_DIRECTORY_TABLE_SIZE, directory_table->len);
+    set_uint32 (header, RAS_HEADER_OFFSET_ARCHIVE_VERSION, RAS_ARCHIVE_VERSION);
+    set_uint32 (header, RAS_HEADER_OFFSET_FORMAT_VERSION, format_version);
+
+    crc = crc32_z (0, Z_NULL, 0);
+    crc = crc32_z (crc, file_table->data, file_table->len);
+    set_uint32 (header, RAS_HEADER_OFFSET_FILE_TABLE_CHECKSUM, crc);
+
+    crc = crc32_z (0, Z_NULL, 0);
+    crc = crc32_z (crc, directory_table->data, directory_table->len);
+    set_uint32 (header, RAS_HEADER_OFFSET_DIRECTORY_TABLE_CHECKSUM, crc);
+
+    /* Computed with the checksum itself zeroed. */
+    crc = crc32_z (0, Z_NULL, 0);
+    crc = crc32_z (crc, header, RAS_HEADER_LENGTH);
+    set_uint32 (header, RAS_HEADER_OFFSET_HEADER_CHECKSUM, crc);
+
+    ras_encrypt_with_seed (RAS_HEADER_LENGTH - RAS_HEADER_OFFSET_FILE_COUNT,
+                           header + RAS_HEADER_OFFSET_FILE_COUNT,
+                           encryption_seed);
+    ras_encrypt_with_seed (file_table->len, file_table->data, encryption_seed);
+    ras_encrypt_with_seed (directory_table->len, directory_table->data, encryption_seed);
+
+    return g_output_stream_write_all (stream, header, RAS_HEADER_LENGTH,
+                                      NULL, cancellable, error)
+        && g_output_stream_write_all (stream, file_table->data, file_table->len,
+                                      NULL, cancellable, error)
+        && g_output_stream_write_all (stream, directory_table->data, directory_table->len,
+                                      NULL, cancellable, error);
+}
+
+void
+ras_archive_writer_set_compression_level (RasArchiveWriter *self,
+                                          RasLzssLevel      level)
+{
+    g_return_if_fail (RAS_IS_ARCHIVE_WRITER (self));
+    g_return_if_fail (level >= RAS_LZSS_LEVEL_FASTEST);
+    g_return_if_fail (level <= RAS_LZSS_LEVEL_BEST);
+
+    self->compression_level = level;
+}
+
+void
+ras_archive_writer_set_n_threads (RasArchiveWriter *self,
+                                  unsigned int      n_threads)
+{
+    g_return_if_fail (RAS_IS_ARCHIVE_WRITER (self));
+
+    self->n_threads = n_threads;
+}
+
+bool
+ras_archive_writer_add_stream (RasArchiveWriter      *self,
+                               const char            *path,
+                               GInputStream          *stream,
+                               RasCompressionMethod   compression_method,
+                               GDateTime             *creation_date_time,
+                               GCancellable          *cancellable,
+                               GError               **error)
+{
+    g_autofree char *normalized_path = NULL;
+    g_autofree char *directory_path = NULL;
+    const char *name;
+    const char *separator;
+    g_autoptr (GDateTime) now = NULL;
+    uint32_t size;
+    uint64_t entry_size;
+    uint32_t directory_index;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_WRITER (self), false);
+    g_return_val_if_fail (NULL != path, false);
+    g_return_val_if_fail (G_IS_INPUT_STREAM (stream), false);
+    g_return_val_if_fail (RAS_FILE_COMPRESSION_METHOD_COMPRESS == compression_method
+                          || RAS_FILE_COMPRESSION_METHOD_STORE == compression_method, false);
+    g_return_val_if_fail (!self->finished, false);
+
+    if (!check_usable (self, error))
+    {
+        return false;
+    }
+
+    normalized_path = ras_path_normalize (path);
+    if (NULL == normalized_path)
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+                     "Invalid entry path “%s”", path);
+
+        return false;
+    }
+    if (g_hash_table_contains (self->paths, normalized_path))
+    {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                     "Entry %s already exists", normalized_path);
+
+        return false;
+    }
+
+    separator = strrchr (normalized_path, '\\');
+    if (NULL == separator)
+    {
+        directory_path = g_strdup ("\\");
+        name = normalized_path;
+    }
+    else
+    {
+        directory_path = g_strndup (normalized_path, separator - normalized_path);
+        name = separator + 1;
+    }
+
+    if (!ras_write_entry (G_IO_STREAM (self->spool), stream, compression_method,
+                          self->compression_level, self->n_threads,
+                          &size, &entry_size, cancellable, error))
+    {
+        /* Whatever was written is overwritten by the next entry and never
+         * copied out.
+         */
+        if (!g_seekable_seek (G_SEEKABLE (self->spool), self->spool_length, G_SEEK_SET, NULL, NULL))
+        {
+            self->failed = true;
+        }
+
+        return false;
+    }
+
+    self->spool_length += entry_size;
+
+    if (NULL == creation_date_time)
+    {
+        now = g_date_time_new_now_utc ();
+        creation_date_time = now;
+    }
+
+    directory_index = ras_ensure_directory_entry (self->directory_index,
+                                                  self->directory_table,
+                                                  &self->directory_count,
+                                                  directory_path,
+                                                  creation_date_time);
+
+    ras_append_file_entry (self->file_table, name, size, entry_size, directory_index,
+                           compression_method, creation_date_time);
+
+    self->file_count++;
+
+    g_hash_table_add (self->paths, g_steal_pointer (&normalized_path));
+
+    return true;
+}
+
+bool
+ras_archive_writer_add_file (RasArchiveWriter      *self,
+                             const char            *path,
+                             GFile                 *file,
+                             RasCompressionMethod   compression_method,
+                             GCancellable          *cancellable,
+                             GError               **error)
+{
+    g_autoptr (GFileInfo) info = NULL;
+    g_autoptr (GDateTime) creation_date_time = NULL;
+    g_autoptr (GFileInputStream) stream = NULL;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_WRITER (self), false);
+    g_return_val_if_fail (G_IS_FILE (file), false);
+
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_TIME_CREATED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NONE,
+                              cancellable, error);
+    if (NULL == info)
+    {
+        return false;
+    }
+
+    /* Not every file system records creation times. */
+    if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_CREATED))
+    {
+        uint64_t created;
+
+        created = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_CREATED);
+        creation_date_time = g_date_time_new_from_unix_utc (created);
+    }
+    else
+    {
+        creation_date_time = g_file_info_get_modification_date_time (info);
+    }
+
+    stream = g_file_read (file, cancellable, error);
+    if (NULL == stream)
+    {
+        return false;
+    }
+
+    return ras_archive_writer_add_stream (self, path, G_INPUT_STREAM (stream),
+                                          compression_method, creation_date_time,
+                                          cancellable, error);
+}
+
+bool
+ras_archive_writer_add_directory (RasArchiveWriter  *self,
+                                  const char        *path,
+                                  GDateTime         *creation_date_time,
+                                  GError           **error)
+{
+    g_autofree char *normalized_path = NULL;
+    g_autoptr (GDateTime) now = NULL;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_WRITER (self), false);
+    g_return_val_if_fail (NULL != path, false);
+    g_return_val_if_fail (!self->finished, false);
+
+    if (!check_usable (self, error))
+    {
+        return false;
+    }
+
+    normalized_path = ras_path_normalize (path);
+    if (NULL == normalized_path)
+    {
+        /* The root. */
+        return true;
+    }
+
+    if (NULL == creation_date_time)
+    {
+        now = g_date_time_new_now_utc ();
+        creation_date_time = now;
+    }
+
+    (void) ras_ensure_directory_entry (self->directory_index,
+                                       self->directory_table,
+                                       &self->directory_count,
+                                       normalized_path,
+                                       creation_date_time);
+
+    return true;
+}
+
+static bool
+copy_spool (RasArchiveWriter  *self,
+            GCancellable      *cancellable,
+            GError           **error)
+{
+    GInputStream *input;
+    g_autofree uint8_t *buffer = NULL;
+
+    input = g_io_stream_get_input_stream (G_IO_STREAM (self->spool));
+    buffer = g_malloc (BLOCK_SIZE);
+
+    if (!g_seekable_seek (G_SEEKABLE (self->spool), 0, G_SEEK_SET, cancellable, error))
+    {
+        return false;
+    }
+
+    /* Not spliced, as the spool may hold leftovers of a failed entry past
+     * spool_length.
+     */
+    for (uint64_t offset = 0; offset < self->spool_length; )
+    {
+        size_t length;
+        gsize bytes_read;
+
+        length = MIN (self->spool_length - offset, BLOCK_SIZE);
+
+        if (!g_input_stream_read_all (input, buffer, length, &bytes_read, cancellable, error))
+        {
+            return false;
+        }
+        if (bytes_read < length)
+        {
+            g_set_error_literal (error, RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                                 "The spool file was truncated");
+
+            return false;
+        }
+
+        if (!g_output_stream_write_all (self->stream, buffer, length, NULL, cancellable, error))
+        {
+            return false;
+        }
+
+        offset += length;
+    }
+
+    return true;
+}
+
+bool
+ras_archive_writer_finish (RasArchiveWriter  *self,
+                           GCancellable      *cancellable,
+                           GError           **error)
+{
+    bool success;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE_WRITER (self), false);
+    g_return_val_if_fail (!self->finished, false);
+
+    self->finished = true;
+
+    if (!check_usable (self, error))
+    {
+        return false;
+    }
+
+    success = ras_write_tables (self->stream,
+                                self->encryption_seed,
+                                self->format_version,
+                                self->file_count,
+                                self->directory_count,
+                                self->file_table,
+                                self->directory_table,
+                                cancellable, error)
+           && copy_spool (self, cancellable, error);
+
+    delete_spool (self);
+
+    return success;
+}
+
+RasArchiveWriter *
+ras_archive_writer_new (GOutputStream  *stream,
+                        uint32_t        format_version,
+                        int32_t         encryption_seed,
+                        const char     *temporary_directory,
+                        GError        **error)
+{
+    g_autoptr (RasArchiveWriter) writer = NULL;
+    g_autofree char *spool_path = NULL;
+    int fd;
+
+    g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), NULL);
+    g_return_val_if_fail (format_version >= RAS_FORMAT_VERSION, NULL);
+
+    writer = g_object_new (RAS_TYPE_ARCHIVE_WRITER, NULL);
+
+    writer->stream = g_object_ref (stream);
+    writer->format_version = format_version;
+    writer->encryption_seed = encryption_seed;
+
+    spool_path = g_build_filename (NULL != temporary_directory? temporary_directory : g_get_tmp_dir (),
+                                   "ras-XXXXXX", NULL);
+    fd = g_mkstemp (spool_path);
+    if (fd < 0)
+    {
+        int saved_errno;
+
+        saved_errno = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "Failed to create spool file: %s", g_strerror (saved_errno));
+
+        return NULL;
+    }
+    (void) g_close (fd, NULL);
+
+    writer->spool_file = g_file_new_for_path (spool_path);
+    writer->spool = g_file_open_readwrite (writer->spool_file, NULL, error);
+    if (NULL == writer->spool)
+    {
+        return NULL;
+    }
+
+    /* The root has no creation time. */
+    g_byte_array_append (writer->directory_table, (const uint8_t *) "\\", sizeof ("\\"));
+    ras_append_system_time (writer->directory_table, NULL);
+    g_hash_table_insert (writer->directory_index, g_strdup ("\\"), GUINT_TO_POINTER (0));
+    writer->directory_count = 1;
+
+    return g_steal_pointer (&writer);
+}
@@ -0,0 +1,191 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-file.h"
+#include "ras-lzss.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+#define RAS_TYPE_ARCHIVE_WRITER (ras_archive_writer_get_type ())
+
+G_BEGIN_DECLS
+
+G_DECLARE_FINAL_TYPE (RasArchiveWriter, ras_archive_writer, RAS, ARCHIVE_WRITER, GObject)
+
+void              ras_archive_writer_set_compression_level (RasArchiveWriter      *writer,
+                                                            RasLzssLevel           level);
+/**
+ * ras_archive_writer_set_n_threads:
+ * @writer: a #RasArchiveWriter
+ * @n_threads: the number of threads to compress each entry with, or 0 for
+ * one per CPU
+ *
+ * With more than one thread, entries are compressed in segments of
+ * %RAS_LZSS_SEGMENT_SIZE, which costs under 0.1% in compression ratio, and
+ * a segment per thread is buffered at a time.
+ */
+void              ras_archive_writer_set_n_threads         (RasArchiveWriter      *writer,
+                                                            unsigned int           n_threads);
+
+/**
+ * ras_archive_writer_add_stream:
+ * @writer: a #RasArchiveWriter
+ * @path: path of the entry, e.g. “data/textures/foo.dds”
+ * @stream: the contents of the entry
+ * @compression_method: how to store the contents
+ * @creation_date_time: (nullable): the creation time of the entry, or %NULL
+ * for the current time
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Reads @stream to the end, compressing it on the way to the spool file.
+ * Directories in @path are added as needed. If this fails, the archive is
+ * left as it was.
+ */
+bool              ras_archive_writer_add_stream            (RasArchiveWriter      *writer,
+                                                            const char            *path,
+                                                            GInputStream          *stream,
+                                                            RasCompressionMethod   compression_method,
+                                                            GDateTime             *creation_date_time,
+                                                            GCancellable          *cancellable,
+                                                            GError               **error);
+bool              ras_archive_writer_add_file              (RasArchiveWriter      *writer,
+                                                            const char            *path,
+                                                            GFile                 *file,
+                                                            RasCompressionMethod   compression_method,
+                                                            GCancellable          *cancellable,
+                                                            GError               **error);
+bool              ras_archive_writer_add_directory         (RasArchiveWriter      *writer,
+                                                            const char            *path,
+                                                            GDateTime             *creation_date_time,
+                                                            GError               **error);
+
+/**
+ * ras_archive_writer_finish:
+ * @writer: a #RasArchiveWriter
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Writes the header and the tables, followed by the spooled entries, to the
+ * output stream, which is left open.
+ */
+bool              ras_archive_writer_finish                (RasArchiveWriter      *writer,
+                                                            GCancellable          *cancellable,
+                                                            GError               **error);
+
+/**
+ * ras_archive_writer_new:
+ * @stream: where to write the archive
+ * @format_version: 3 for Max Payne archives, 4 for Max Payne 2 archives
+ * @encryption_seed: the seed to encrypt the header and tables with
+ * @temporary_directory: (nullable): where to spool entries until the archive
+ * is finished, or %NULL for g_get_tmp_dir()
+ * @error: return location for a #GError
+ *
+ * Entries follow the tables in an archive, and the tables are only complete
+ * once every entry has been added, so entries are spooled to a temporary
+ * file in the meantime. Only the tables are kept in memory.
+ *
+ * Returns: (transfer full) (nullable): a new #RasArchiveWriter
+ */
+RasArchiveWriter *ras_archive_writer_new                   (GOutputStream         *stream,
+                                                            uint32_t               format_version,
+                                                            int32_t                encryption_seed,
+                                                            const char            *temporary_directory,
+                                                            GError               **error);
+
+/* The rest is shared with ras_archive_update(). */
+
+/**
+ * ras_ensure_directory_entry:
+ * @index: directory paths, see ras_path_normalize(), to their indices
+ * @table: the plaintext directory table
+ * @count: (inout): the number of entries in @table
+ * @path: the path of the directory
+ * @creation_date_time: the creation time of any directories added
+ *
+ * Adds @path to @table, along with any parents that are not there yet.
+ *
+ * Returns: the index of @path in @table
+ */
+uint32_t          ras_ensure_directory_entry               (GHashTable            *index,
+                                                            GByteArray            *table,
+                                                            uint32_t              *count,
+                                                            const char            *path,
+                                                            GDateTime             *creation_date_time);
+void              ras_append_file_entry                    (GByteArray            *table,
+                                                            const char            *name,
+                                                            uint32_t               size,
+                                                            uint32_t               entry_size,
+                                                            uint32_t               directory_index,
+                                                            RasCompressionMethod   compression_method,
+                                                            GDateTime             *creation_date_time);
+
+/**
+ * ras_write_entry:
+ * @output: a seekable stream, positioned where the entry is to be written
+ * @stream: the contents of the entry
+ * @compression_method: how to store the contents
+ * @level: the compression level
+ * @n_threads: as for ras_archive_writer_set_n_threads()
+ * @size: (out): the size of the contents
+ * @entry_size: (out): the number of bytes written
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Writes the data of a single entry, leaving @output positioned after it. On
+ * failure, the position of @output is unspecified.
+ */
+bool              ras_write_entry                          (GIOStream             *output,
+                                                            GInputStream          *stream,
+                                                            RasCompressionMethod   compression_method,
+                                                            RasLzssLevel           level,
+                                                            unsigned int           n_threads,
+                                                            uint32_t              *size,
+                                                            uint64_t              *entry_size,
+                                                            GCancellable          *cancellable,
+                                                            GError               **error);
+/**
+ * ras_write_tables:
+ * @stream: where to write the header and the tables
+ * @encryption_seed: the seed to encrypt them with
+ * @format_version: the format version of the archive
+ * @file_count: the number of entries in @file_table
+ * @directory_count: the number of entries in @directory_table
+ * @file_table: the plaintext file table, encrypted in place
+ * @directory_table: the plaintext directory table, encrypted in place
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ */
+bool              ras_write_tables                         (GOutputStream         *stream,
+                                                            int32_t                encryption_seed,
+                                                            uint32_t               format_version,
+                                                            uint32_t               file_count,
+                                                            uint32_t               directory_count,
+                                                            GByteArray            *file_table,
+                                                            GByteArray            *directory_table,
+                                                            GCancellable          *cancellable,
+                                                            GError               **error);
+
+G_END_DECLS
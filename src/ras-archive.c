@@ -17,48 +17,91 @@
  */
 
 #include "ras-archive.h"
+#include "ras-archive-writer.h"
+#include "ras-cache.h"
+#include "ras-cipher.h"
 #include "ras-directory.h"
 #include "ras-file.h"
-#include "ras-stream-codec.h"
+#include "ras-source.h"
+#include "ras-stats.h"
+#include "ras-trace.h"
+#include "ras-uring.h"
 #include "ras-utils.h"
 
 #include <iso646.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
 
-enum
-{
-    RAS_HEADER_OFFSET_MAGIC = 0x0,
-    RAS_HEADER_OFFSET_ENCRYPTION_SEED = 0x4,
-    RAS_HEADER_OFFSET_FILE_COUNT = 0x8,
-    RAS_HEADER_OFFSET_DIRECTORY_COUNT = 0xC,
-    RAS_HEADER_OFFSET_FILE_TABLE_SIZE = 0x10,
-    RAS_HEADER_OFFSET_DIRECTORY_TABLE_SIZE = 0x14,
-    RAS_HEADER_OFFSET_ARCHIVE_VERSION = 0x18,
-    RAS_HEADER_OFFSET_HEADER_CHECKSUM = 0x1C,
-    RAS_HEADER_OFFSET_FILE_TABLE_CHECKSUM = 0x20,
-    RAS_HEADER_OFFSET_DIRECTORY_TABLE_CHECKSUM = 0x24,
-    RAS_HEADER_OFFSET_FORMAT_VERSION = 0x28,
-};
-
-#define RAS_FORMAT_VERSION 3
-#define RAS_HEADER_LENGTH 0x2C
-#define RAS_MAGIC "RAS"
-#define RAS_MAGIC_LENGTH (strlen (RAS_MAGIC) + 1)
+/* A range of file data. */
+typedef struct
+{
+    uint64_t offset;
+    uint64_t length;
+} RasExtent;
 
 struct _RasArchive
 {
     GObject parent_instance;
 
-    GBytes *bytes;
-
-    GList *file_table;
-    GHashTable *directory_table;
+    RasSource *source;
+    int32_t encryption_seed;
+    uint32_t format_version;
+    /* Where file data starts, which can be past the end of the tables. */
+    uint64_t data_offset;
+
+    /* In table order. */
+    GPtrArray *file_table;
+    GPtrArray *directory_table;
+    /* Offsets of file data from the start of the archive; the last one is
+     * the end of the data of the last file.
+     */
+    uint64_t *file_offsets;
+
+    /* Full paths of files, see ras_path_hash(). */
+    GHashTable *path_index;
+
+    /* The directory tree, including directories that are only implied by the
+     * names of others.
+     */
+    RasDirectory *root_directory;
+    GHashTable *directory_index;
+    GPtrArray *implicit_directories;
+
+    /* Data of dead entries, which take the place of ones that were replaced
+     * or removed by ras_archive_update(). They have no name and are not
+     * included in the file table.
+     */
+    GArray *dead_space;
+
+    /* Decoded contents, see ras_archive_set_cache(). Prefetching holds the
+     * lock while it decodes a file, so that nothing is added to a cache once
+     * the archive is done with it.
+     */
+    RasCache *cache;
+    GMutex cache_mutex;
 };
 
 G_DEFINE_TYPE (RasArchive, ras_archive, G_TYPE_OBJECT)
 
+/* Cache entries hold references to the files, which would otherwise keep
+ * them, and the source they read from, alive for as long as the cache.
+ */
+static void
+uncache_files (RasArchive *self)
+{
+    if (NULL == self->cache)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < self->file_table->len; i++)
+    {
+        ras_cache_remove (self->cache, g_ptr_array_index (self->file_table, i));
+    }
+}
+
 static void
 ras_archive_finalize (GObject *object)
 {
@@ -66,10 +109,19 @@ ras_archive_finalize (GObject *object)
 
     self = RAS_ARCHIVE (object);
 
-    g_clear_list (&self->file_table, g_object_unref);
-    g_clear_pointer (&self->directory_table, g_hash_table_destroy);
+    uncache_files (self);
+
+    g_clear_pointer (&self->file_table, g_ptr_array_unref);
+    g_clear_pointer (&self->directory_table, g_ptr_array_unref);
+    g_clear_pointer (&self->file_offsets, g_free);
+    g_clear_pointer (&self->path_index, g_hash_table_destroy);
+    g_clear_pointer (&self->directory_index, g_hash_table_destroy);
+    g_clear_pointer (&self->implicit_directories, g_ptr_array_unref);
+    g_clear_pointer (&self->dead_space, g_array_unref);
+    g_clear_object (&self->cache);
+    g_mutex_clear (&self->cache_mutex);
 
-    g_clear_pointer (&self->bytes, g_bytes_unref);
+    g_clear_pointer (&self->source, ras_source_unref);
 
     G_OBJECT_CLASS (ras_archive_parent_class)->finalize (object);
 }
@@ -87,9 +139,18 @@ ras_archive_class_init (RasArchiveClass *klass)
 static void
 ras_archive_init (RasArchive *self)
 {
-    self->file_table = NULL;
-    self->directory_table = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-                                                   NULL, g_object_unref);
+    self->file_table = g_ptr_array_new_with_free_func (g_object_unref);
+    self->directory_table = g_ptr_array_new_with_free_func (g_object_unref);
+    self->file_offsets = NULL;
+    self->path_index = g_hash_table_new_full (ras_path_hash, ras_path_equal,
+                                              g_free, NULL);
+    self->root_directory = NULL;
+    self->directory_index = g_hash_table_new_full (ras_path_hash, ras_path_equal,
+                                                   g_free, NULL);
+    self->implicit_directories = g_ptr_array_new_with_free_func (g_object_unref);
+    self->dead_space = g_array_new (false, false, sizeof (RasExtent));
+    self->cache = NULL;
+    g_mutex_init (&self->cache_mutex);
 }
 
 GQuark
@@ -102,15 +163,151 @@ RasDirectory *
 ras_archive_get_directory_by_index (RasArchive   *self,
                                     unsigned int  index)
 {
-    const void *key;
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+
+    if (index >= self->directory_table->len)
+    {
+        return NULL;
+    }
+
+    return g_ptr_array_index (self->directory_table, index);
+}
+
+RasFile *
+ras_archive_get_file_by_index (RasArchive *self,
+                               size_t      index)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+
+    if (index >= self->file_table->len)
+    {
+        return NULL;
+    }
+
+    return g_ptr_array_index (self->file_table, index);
+}
+
+GBytes *
+ras_archive_get_bytes (RasArchive  *self,
+                       size_t       index,
+                       GError     **error)
+{
+    RasFile *file;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+    g_return_val_if_fail (index < self->file_table->len, NULL);
+
+    file = g_ptr_array_index (self->file_table, index);
+    if (NULL == self->cache)
+    {
+        return ras_file_get_bytes (file, error);
+    }
+
+    return ras_cache_get_bytes (self->cache, file, error);
+}
+
+void
+ras_archive_set_cache (RasArchive *self,
+                       RasCache   *cache)
+{
+    g_return_if_fail (RAS_IS_ARCHIVE (self));
+    g_return_if_fail (NULL == cache || RAS_IS_CACHE (cache));
+
+    if (cache == self->cache)
+    {
+        return;
+    }
+
+    g_mutex_lock (&self->cache_mutex);
+
+    uncache_files (self);
+
+    g_set_object (&self->cache, cache);
+
+    g_mutex_unlock (&self->cache_mutex);
+}
+
+RasCache *
+ras_archive_get_cache (RasArchive *self)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+
+    return self->cache;
+}
+
+RasFile *
+ras_archive_lookup (RasArchive *self,
+                    const char *path)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+    g_return_val_if_fail (NULL != path, NULL);
+
+    return g_hash_table_lookup (self->path_index, path);
+}
+
+bool
+ras_archive_lookup_extended (RasArchive  *self,
+                             const char  *path,
+                             const char **orig_path,
+                             RasFile    **file)
+{
+    void *key;
     void *value;
 
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), false);
+    g_return_val_if_fail (NULL != path, false);
+
+    if (!g_hash_table_lookup_extended (self->path_index, path, &key, &value))
+    {
+        return false;
+    }
+
+    if (NULL != orig_path)
+    {
+        *orig_path = key;
+    }
+    if (NULL != file)
+    {
+        *file = value;
+    }
+
+    return true;
+}
+
+GList *
+ras_archive_get_paths (RasArchive *self)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+
+    return g_hash_table_get_keys (self->path_index);
+}
+
+RasDirectory *
+ras_archive_get_root_directory (RasArchive *self)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+
+    return self->root_directory;
+}
+
+RasDirectory *
+ras_archive_lookup_directory (RasArchive *self,
+                              const char *path)
+{
     g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
+    g_return_val_if_fail (NULL != path, NULL);
+
+    return g_hash_table_lookup (self->directory_index, path);
+}
 
-    key = GUINT_TO_POINTER (index);
-    value = g_hash_table_lookup (self->directory_table, key);
+uint64_t
+ras_archive_get_file_offset (RasArchive *self,
+                             size_t      index)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), 0);
+    g_return_val_if_fail (index < self->file_table->len, 0);
 
-    return RAS_DIRECTORY (value);
+    return self->file_offsets[index];
 }
 
 size_t
@@ -118,7 +315,7 @@ ras_archive_get_file_count (RasArchive *self)
 {
     g_return_val_if_fail (RAS_IS_ARCHIVE (self), 0);
 
-    return g_list_length (self->file_table);
+    return self->file_table->len;
 }
 
 size_t
@@ -126,7 +323,22 @@ ras_archive_get_directory_count (RasArchive *self)
 {
     g_return_val_if_fail (RAS_IS_ARCHIVE (self), 0);
 
-    return g_hash_table_size (self->directory_table);
+    return self->directory_table->len;
+}
+
+static GList *
+ptr_array_to_list (GPtrArray *array)
+{
+    GList *list;
+
+    list = NULL;
+
+    for (size_t i = array->len; i > 0; i--)
+    {
+        list = g_list_prepend (list, g_ptr_array_index (array, i - 1));
+    }
+
+    return list;
 }
 
 GList *
@@ -134,7 +346,7 @@ ras_archive_get_directory_table (RasArchive *self)
 {
     g_return_val_if_fail (RAS_IS_ARCHIVE (self), NULL);
 
-    return g_hash_table_get_values (self->directory_table);
+    return ptr_array_to_list (self->directory_table);
 }
 
 GList *
@@ -142,19 +354,88 @@ ras_archive_get_file_table (RasArchive *archive)
 {
     g_return_val_if_fail (RAS_IS_ARCHIVE (archive), NULL);
 
-    return g_list_copy (g_list_reverse (archive->file_table));
+    return ptr_array_to_list (archive->file_table);
+}
+
+void
+ras_archive_iter_init (RasArchiveIter *iter,
+                       RasArchive     *archive)
+{
+    g_return_if_fail (NULL != iter);
+    g_return_if_fail (RAS_IS_ARCHIVE (archive));
+
+    iter->archive = archive;
+    iter->index = 0;
+}
+
+bool
+ras_archive_iter_next (RasArchiveIter  *iter,
+                       RasFile        **file)
+{
+    g_return_val_if_fail (NULL != iter, false);
+
+    if (iter->index >= iter->archive->file_table->len)
+    {
+        return false;
+    }
+
+    if (NULL != file)
+    {
+        *file = g_ptr_array_index (iter->archive->file_table, iter->index);
+    }
+
+    iter->index++;
+
+    return true;
+}
+
+/* Name, NUL, six 32-bit fields and a SYSTEMTIME. */
+#define FILE_ENTRY_MIN_LENGTH (1 + 24 + 16)
+
+/* Checks that an entry with a name and @fixed_length bytes following it fits
+ * in the table and stores the length of the name in @name_length.
+ */
+static bool
+check_entry (const uint8_t  *data,
+             const uint8_t  *end,
+             size_t          fixed_length,
+             size_t         *name_length,
+             GError        **error)
+{
+    const uint8_t *nul;
+
+    nul = memchr (data, '\0', end - data);
+    if (NULL == nul || (size_t) (end - nul - 1) < fixed_length)
+    {
+        g_set_error_literal (error, RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                             "Truncated entry table");
+
+        return false;
+    }
+
+    *name_length = nul - data;
+
+    return true;
 }
 
 static bool
 populate_file_table (RasArchive     *archive,
                      const uint8_t  *data,
+                     size_t          length,
                      size_t          file_count,
-                     const uint8_t  *file_data,
+                     size_t          file_data_offset,
                      GError        **error)
 {
+    const uint8_t *end;
+
     g_assert (RAS_IS_ARCHIVE (archive));
     g_assert (data not_eq NULL);
 
+    end = data + length;
+
+    /* The count comes from the header, so do not trust it for allocations. */
+    archive->file_offsets = g_new (uint64_t, MIN (file_count, length / FILE_ENTRY_MIN_LENGTH) + 1);
+
     for (size_t i = 0; i < file_count; i++)
     {
         const char *name;
@@ -170,8 +451,12 @@ populate_file_table (RasArchive     *archive,
         RasFile *file;
         RasDirectory *directory;
 
+        if (!check_entry (data, end, 24 + sizeof (creation_time), &name_length, error))
+        {
+            return false;
+        }
+
         name = (const char *) data;
-        name_length = strlen (name);
 
         data += name_length + 1;
 
@@ -184,6 +469,18 @@ populate_file_table (RasArchive     *archive,
 
         data += 24;
 
+        if (0 == name_length)
+        {
+            RasExtent extent = { file_data_offset, entry_size };
+
+            g_array_append_val (archive->dead_space, extent);
+
+            data += sizeof (creation_time);
+            file_data_offset += entry_size;
+
+            continue;
+        }
+
         for (size_t i = 0; G_N_ELEMENTS (creation_time) > i; i++)
         {
             creation_time[i] = GUINT16_FROM_LE (((uint16_t *) data)[i]);
@@ -213,44 +510,40 @@ populate_file_table (RasArchive     *archive,
                              reserved1,
                              compression_method,
                              creation_date_time,
-                             file_data);
+                             archive->source,
+                             file_data_offset);
 
-        archive->file_table = g_list_prepend (archive->file_table, file);
+        archive->file_offsets[archive->file_table->len] = file_data_offset;
+        g_ptr_array_add (archive->file_table, file);
 
+        /* Extraction reports invalid indices. */
         directory = ras_archive_get_directory_by_index (archive, parent_directory_index);
+        if (NULL != directory)
+        {
+            ras_directory_add_file (directory, file);
+        }
 
-        ras_directory_add_file (directory, file);
-
-        file_data += entry_size;
+        file_data_offset += entry_size;
     }
 
-    return true;
-}
-
-static void
-insert_directory (RasArchive   *archive,
-                  RasDirectory *directory)
-{
-    uint32_t table_size;
-    void *key;
-
-    g_assert (RAS_IS_ARCHIVE (archive));
-    g_assert (RAS_IS_DIRECTORY (directory));
-
-    table_size = g_hash_table_size (archive->directory_table);
-    key = GUINT_TO_POINTER (table_size);
+    archive->file_offsets[archive->file_table->len] = file_data_offset;
 
-    g_assert (g_hash_table_insert (archive->directory_table, key, directory));
+    return true;
 }
 
 static bool
 populate_directory_table (RasArchive     *archive,
                           const uint8_t  *data,
+                          size_t          length,
                           size_t          directory_count,
                           GError        **error)
 {
+    const uint8_t *end;
+
     g_assert (RAS_IS_ARCHIVE (archive));
 
+    end = data + length;
+
     for (size_t i = 0; i < directory_count; i++)
     {
         const char *name;
@@ -258,8 +551,12 @@ populate_directory_table (RasArchive     *archive,
         uint16_t creation_time[8];
         g_autoptr (GDateTime) creation_date_time = NULL;
 
+        if (!check_entry (data, end, sizeof (creation_time), &name_length, error))
+        {
+            return false;
+        }
+
         name = (const char *) data;
-        name_length = strlen (name);
 
         data += name_length + 1;
 
@@ -289,8 +586,8 @@ populate_directory_table (RasArchive     *archive,
 
         g_debug ("Inserting directory to table: %s", name);
 
-        insert_directory (archive,
-                          ras_directory_new (name, creation_date_time));
+        g_ptr_array_add (archive->directory_table,
+                         ras_directory_new (name, creation_date_time));
 
         data += sizeof (creation_time);
     }
@@ -298,151 +595,381 @@ populate_directory_table (RasArchive     *archive,
     return true;
 }
 
-RasArchive *
-ras_archive_load (GBytes  *bytes,
-                  GError **error)
+/* Decrypts a table into @output and returns its CRC.
+ *
+ * Both are done a block at a time, so that the checksum is computed while
+ * the decrypted data is still in cache.
+ */
+static uint32_t
+decrypt_table (const uint8_t *input,
+               uint8_t       *output,
+               size_t         length,
+               int32_t        seed,
+               RasStats      *stats)
 {
-    size_t size;
-    const uint8_t *data;
-    uint8_t header[RAS_HEADER_LENGTH];
-    int32_t encryption_seed;
-    g_autoptr (RasStreamCodec) codec = NULL;
-    size_t bytes_read;
-    size_t bytes_written;
-    g_autoptr (RasArchive) archive = NULL;
-    size_t file_count;
-    size_t directory_count;
-    size_t file_table_size;
-    size_t directory_table_size;
+    RasKeystream keystream;
+    uint32_t crc;
+    uint64_t decrypt_time;
+    uint64_t crc_time;
 
-    g_return_val_if_fail (bytes not_eq NULL, NULL);
+    ras_keystream_init (&keystream, seed);
 
-    data = g_bytes_get_data (bytes, &size);
+    decrypt_time = 0;
+    crc_time = 0;
 
-    if (size < RAS_HEADER_LENGTH)
-    {
-        g_set_error_literal (error,
-                             RAS_ARCHIVE_ERROR,
-                             RAS_ERROR_TRUNCATED,
-                             "Truncated file");
+    crc = crc32_z (0, Z_NULL, 0);
 
-        return NULL;
-    }
-    if (memcmp (data, RAS_MAGIC, RAS_MAGIC_LENGTH) not_eq 0)
+    for (size_t offset = 0; offset < length; )
     {
-        g_set_error_literal (error,
-                             RAS_ARCHIVE_ERROR,
-                             RAS_ERROR_INVALID_MAGIC,
-                             "Not a RAS archive");
+        uint8_t key[RAS_CIPHER_BLOCK_SIZE];
+        size_t block_length;
+        uint64_t start;
+        uint64_t decrypted;
 
-        return NULL;
+        block_length = MIN (length - offset, sizeof (key));
+        start = ras_stats_get_time ();
+
+        ras_keystream_generate (&keystream, key, block_length);
+        ras_cipher_decrypt (input + offset, output + offset, block_length, offset, key);
+
+        decrypted = ras_stats_get_time ();
+
+        crc = crc32_z (crc, output + offset, block_length);
+
+        decrypt_time += decrypted - start;
+        crc_time += ras_stats_get_time () - decrypted;
+
+        offset += block_length;
     }
 
-    (void) memcpy (header, data, RAS_HEADER_LENGTH);
+    ras_keystream_clear (&keystream);
 
-    encryption_seed = GINT32_FROM_LE (*((int32_t *) (data + RAS_HEADER_OFFSET_ENCRYPTION_SEED)));
-    codec = ras_stream_codec_new (encryption_seed);
+    ras_stats_add (stats, RAS_STAT_BYTES_DECRYPTED, length);
+    ras_stats_add (stats, RAS_STAT_DECRYPT_TIME, decrypt_time);
+    ras_stats_add (stats, RAS_STAT_CRC_TIME, crc_time);
 
-    g_converter_convert (G_CONVERTER (codec),
-                         header + 8, 36,
-                         (void *) header + 8, 36,
-                         G_CONVERTER_INPUT_AT_END,
-                         &bytes_read, &bytes_written,
-                         NULL);
+    return crc;
+}
 
-    if (GUINT32_FROM_LE (*(uint32_t *) (header + RAS_HEADER_OFFSET_FORMAT_VERSION)) < RAS_FORMAT_VERSION)
+/* Returns the name of the directory containing @path, with “\\” for the
+ * root.
+ */
+static char *
+get_parent_path (const char *path)
+{
+    size_t length;
+
+    length = strlen (path);
+    while (length > 0 && '\\' == path[length - 1])
     {
-        g_set_error_literal (error,
-                             RAS_ARCHIVE_ERROR,
-                             RAS_ERROR_UNSUPPORTED_VERSION,
-                             "Unsupported format version");
+        length--;
+    }
+    while (length > 0 && '\\' not_eq path[length - 1])
+    {
+        length--;
+    }
+    while (length > 0 && '\\' == path[length - 1])
+    {
+        length--;
+    }
 
-        return NULL;
+    if (0 == length)
+    {
+        return g_strdup ("\\");
     }
 
+    return g_strndup (path, length);
+}
+
+static RasDirectory *
+ensure_directory (RasArchive *archive,
+                  const char *path)
+{
+    RasDirectory *directory;
+    g_autofree char *parent_path = NULL;
+
+    directory = g_hash_table_lookup (archive->directory_index, path);
+    if (NULL != directory)
     {
-        uint32_t checksum;
-        uint32_t crc;
+        return directory;
+    }
 
-        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_HEADER_CHECKSUM)));
+    g_debug ("Adding implied directory: %s", path);
 
-        *((uint32_t *) (header + RAS_HEADER_OFFSET_HEADER_CHECKSUM)) = 0;
+    directory = ras_directory_new (path, NULL);
 
-        crc = crc32_z (0, Z_NULL, 0);
-        crc = crc32_z (crc, header, RAS_HEADER_LENGTH);
-        if (crc not_eq checksum)
-        {
-            g_set_error_literal (error,
-                                 RAS_ARCHIVE_ERROR,
-                                 RAS_ERROR_UNSUPPORTED_VERSION,
-                                 "Invalid header checksum");
+    g_ptr_array_add (archive->implicit_directories, directory);
+    g_hash_table_insert (archive->directory_index, g_strdup (path), directory);
 
-            return NULL;
-        }
+    if (NULL != archive->root_directory)
+    {
+        parent_path = get_parent_path (path);
+
+        ras_directory_add_child (ensure_directory (archive, parent_path), directory);
     }
 
-    archive = g_object_new (RAS_TYPE_ARCHIVE, NULL);
+    return directory;
+}
 
-    archive->bytes = g_bytes_ref (bytes);
+static void
+build_directory_tree (RasArchive *archive)
+{
+    GPtrArray *directories;
 
-    file_count = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_COUNT)));
-    directory_count = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_COUNT)));
-    file_table_size = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_TABLE_SIZE)));
-    directory_table_size = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_TABLE_SIZE)));
+    directories = archive->directory_table;
 
+    for (size_t i = 0; i < directories->len; i++)
     {
-        g_autofree uint8_t *directory_table = NULL;
-        uint32_t checksum;
-        uint32_t crc;
-
-        directory_table = malloc (directory_table_size);
-        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_TABLE_CHECKSUM)));
+        RasDirectory *directory;
+        char *name;
 
-        g_converter_reset (G_CONVERTER (codec));
-        g_converter_convert (G_CONVERTER (codec),
-                             data + RAS_HEADER_LENGTH + file_table_size, directory_table_size,
-                             directory_table, directory_table_size,
-                             G_CONVERTER_INPUT_AT_END,
-                             &bytes_read, &bytes_written,
-                             NULL);
+        directory = g_ptr_array_index (directories, i);
+        name = ras_directory_get_name (directory, false);
 
-        crc = crc32_z (0, Z_NULL, 0);
-        crc = crc32_z (crc, directory_table, directory_table_size);
-        if (crc not_eq checksum)
+        /* The first directory with a given name wins. */
+        if (g_hash_table_contains (archive->directory_index, name))
         {
-            g_set_error_literal (error,
-                                 RAS_ARCHIVE_ERROR,
-                                 RAS_ERROR_UNSUPPORTED_VERSION,
-                                 "Invalid directory table checksum");
+            g_free (name);
 
-            return NULL;
+            continue;
         }
 
-        if (!populate_directory_table (archive, directory_table, directory_count, error))
-        {
-            return NULL;
-        }
+        g_hash_table_insert (archive->directory_index, name, directory);
     }
 
+    archive->root_directory = ensure_directory (archive, "\\");
+
+    for (size_t i = 0; i < directories->len; i++)
     {
-        g_autofree uint8_t *file_table = NULL;
-        uint32_t checksum;
+        RasDirectory *directory;
+        g_autofree char *name = NULL;
+        g_autofree char *parent_path = NULL;
+
+        directory = g_ptr_array_index (directories, i);
+        if (archive->root_directory == directory)
+        {
+            continue;
+        }
+
+        name = ras_directory_get_name (directory, false);
+        if (g_hash_table_lookup (archive->directory_index, name) not_eq directory)
+        {
+            continue;
+        }
+
+        parent_path = get_parent_path (name);
+
+        ras_directory_add_child (ensure_directory (archive, parent_path), directory);
+    }
+}
+
+static void
+build_path_index (RasArchive *archive)
+{
+    size_t directory_count;
+    g_auto (GStrv) directory_names = NULL;
+
+    directory_count = archive->directory_table->len;
+    directory_names = g_new0 (char *, directory_count + 1);
+
+    for (size_t i = 0; i < directory_count; i++)
+    {
+        directory_names[i] = ras_directory_get_name (g_ptr_array_index (archive->directory_table, i),
+                                                     false);
+    }
+
+    for (size_t i = 0; i < archive->file_table->len; i++)
+    {
+        RasFile *file;
+        uint32_t directory_index;
+        g_autofree char *name = NULL;
+        char *path;
+
+        file = g_ptr_array_index (archive->file_table, i);
+        directory_index = ras_file_get_directory_index (file);
+        if (directory_index >= directory_count)
+        {
+            continue;
+        }
+
+        name = ras_file_get_name (file);
+        path = g_strconcat (directory_names[directory_index], "\\", name, NULL);
+
+        /* The first entry with a given path wins. */
+        if (g_hash_table_contains (archive->path_index, path))
+        {
+            g_free (path);
+
+            continue;
+        }
+
+        g_hash_table_insert (archive->path_index, path, file);
+    }
+}
+
+static RasArchive *
+load (RasSource     *source,
+      GCancellable  *cancellable,
+      GError       **error)
+{
+    uint8_t header[RAS_HEADER_LENGTH];
+    int32_t encryption_seed;
+    RasStats *stats;
+    uint64_t start;
+    uint64_t span;
+    g_autoptr (RasArchive) archive = NULL;
+    size_t file_count;
+    size_t directory_count;
+    size_t file_table_size;
+    size_t directory_table_size;
+    uint64_t size;
+    const uint8_t *data;
+    const uint8_t *tables;
+    g_autofree uint8_t *table = NULL;
+
+    if (!ras_source_read (source, 0, header, RAS_HEADER_LENGTH, cancellable, error))
+    {
+        return NULL;
+    }
+    if (memcmp (header, RAS_MAGIC, RAS_MAGIC_LENGTH) not_eq 0)
+    {
+        g_set_error_literal (error,
+                             RAS_ARCHIVE_ERROR,
+                             RAS_ERROR_INVALID_MAGIC,
+                             "Not a RAS archive");
+
+        return NULL;
+    }
+
+    encryption_seed = GINT32_FROM_LE (*((int32_t *) (header + RAS_HEADER_OFFSET_ENCRYPTION_SEED)));
+    stats = ras_source_get_stats (source);
+    span = ras_trace_begin ();
+
+    ras_decrypt_with_seed (RAS_HEADER_LENGTH - RAS_HEADER_OFFSET_FILE_COUNT,
+                           header + RAS_HEADER_OFFSET_FILE_COUNT,
+                           encryption_seed);
+
+    ras_stats_add (stats, RAS_STAT_BYTES_DECRYPTED, RAS_HEADER_LENGTH - RAS_HEADER_OFFSET_FILE_COUNT);
+
+    if (GUINT32_FROM_LE (*(uint32_t *) (header + RAS_HEADER_OFFSET_FORMAT_VERSION)) < RAS_FORMAT_VERSION)
+    {
+        g_set_error_literal (error,
+                             RAS_ARCHIVE_ERROR,
+                             RAS_ERROR_UNSUPPORTED_VERSION,
+                             "Unsupported format version");
+
+        return NULL;
+    }
+
+    {
+        uint32_t checksum;
         uint32_t crc;
-        const uint8_t *file_data;
 
-        file_table = malloc (file_table_size);
-        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_TABLE_CHECKSUM)));
+        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_HEADER_CHECKSUM)));
 
-        g_converter_reset (G_CONVERTER (codec));
-        g_converter_convert (G_CONVERTER (codec),
-                             data + RAS_HEADER_LENGTH, file_table_size,
-                             file_table, file_table_size,
-                             G_CONVERTER_INPUT_AT_END,
-                             &bytes_read, &bytes_written,
-                             NULL);
+        *((uint32_t *) (header + RAS_HEADER_OFFSET_HEADER_CHECKSUM)) = 0;
 
         crc = crc32_z (0, Z_NULL, 0);
-        crc = crc32_z (crc, file_table, file_table_size);
+        crc = crc32_z (crc, header, RAS_HEADER_LENGTH);
+        if (crc not_eq checksum)
+        {
+            g_set_error_literal (error,
+                                 RAS_ARCHIVE_ERROR,
+                                 RAS_ERROR_UNSUPPORTED_VERSION,
+                                 "Invalid header checksum");
+
+            return NULL;
+        }
+    }
+
+    ras_trace_end (span, "decrypt_header", NULL);
+
+    file_count = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_COUNT)));
+    directory_count = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_COUNT)));
+    file_table_size = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_TABLE_SIZE)));
+    directory_table_size = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_TABLE_SIZE)));
+
+    size = ras_source_get_size (source);
+    if (RAS_SOURCE_SIZE_UNKNOWN not_eq size
+        && size - RAS_HEADER_LENGTH < (uint64_t) file_table_size + directory_table_size)
+    {
+        g_set_error_literal (error,
+                             RAS_ARCHIVE_ERROR,
+                             RAS_ERROR_TRUNCATED,
+                             "Truncated file");
+
+        return NULL;
+    }
+
+    archive = g_object_new (RAS_TYPE_ARCHIVE, NULL);
+
+    archive->source = ras_source_ref (source);
+    archive->encryption_seed = encryption_seed;
+    archive->format_version = GUINT32_FROM_LE (*(uint32_t *) (header + RAS_HEADER_OFFSET_FORMAT_VERSION));
+
+    /* Both tables are decrypted into the same buffer, in place unless the
+     * archive is already in memory.
+     */
+    table = g_malloc (MAX (file_table_size + directory_table_size, 1));
+    data = ras_source_get_data (source);
+    if (NULL != data)
+    {
+        tables = data + RAS_HEADER_LENGTH;
+    }
+    else
+    {
+        if (!ras_source_read (source, RAS_HEADER_LENGTH, table,
+                              file_table_size + directory_table_size,
+                              cancellable, error))
+        {
+            return NULL;
+        }
+
+        tables = table;
+    }
+
+    {
+        uint32_t checksum;
+        uint32_t crc;
+
+        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_DIRECTORY_TABLE_CHECKSUM)));
+        span = ras_trace_begin ();
+        crc = decrypt_table (tables + file_table_size, table + file_table_size,
+                             directory_table_size, encryption_seed, stats);
+        /* The checksum is computed as the table is decrypted. */
+        ras_trace_end (span, "decrypt_directory_table", NULL);
+        if (crc not_eq checksum)
+        {
+            g_set_error_literal (error,
+                                 RAS_ARCHIVE_ERROR,
+                                 RAS_ERROR_UNSUPPORTED_VERSION,
+                                 "Invalid directory table checksum");
+
+            return NULL;
+        }
+
+        start = ras_stats_get_time ();
+        span = ras_trace_begin ();
+
+        if (!populate_directory_table (archive, table + file_table_size, directory_table_size,
+                                       directory_count, error))
+        {
+            return NULL;
+        }
+
+        ras_trace_end (span, "populate_directory_table", NULL);
+        ras_stats_add (stats, RAS_STAT_TABLE_PARSE_TIME, ras_stats_get_time () - start);
+    }
+
+    {
+        uint32_t checksum;
+        uint32_t crc;
+        size_t file_data_offset;
+
+        checksum = GUINT32_FROM_LE (*((uint32_t *) (header + RAS_HEADER_OFFSET_FILE_TABLE_CHECKSUM)));
+        span = ras_trace_begin ();
+        crc = decrypt_table (tables, table, file_table_size, encryption_seed, stats);
+        ras_trace_end (span, "decrypt_file_table", NULL);
         if (crc not_eq checksum)
         {
             g_set_error_literal (error,
@@ -453,13 +980,1932 @@ ras_archive_load (GBytes  *bytes,
             return NULL;
         }
 
-        file_data = data + RAS_HEADER_LENGTH + file_table_size + directory_table_size;
+        file_data_offset = RAS_HEADER_LENGTH + file_table_size + directory_table_size;
+        archive->data_offset = file_data_offset;
+
+        start = ras_stats_get_time ();
+        span = ras_trace_begin ();
 
-        if (!populate_file_table (archive, file_table, file_count, file_data, error))
+        if (!populate_file_table (archive, table, file_table_size,
+                                  file_count, file_data_offset, error))
         {
             return NULL;
         }
+
+        ras_trace_end (span, "populate_file_table", NULL);
     }
 
+    span = ras_trace_begin ();
+
+    build_directory_tree (archive);
+    build_path_index (archive);
+
+    ras_trace_end (span, "build_index", NULL);
+
+    ras_stats_add (stats, RAS_STAT_TABLE_PARSE_TIME, ras_stats_get_time () - start);
+
     return g_steal_pointer (&archive);
 }
+
+RasArchive *
+ras_archive_load (GBytes  *bytes,
+                  GError **error)
+{
+    g_autoptr (RasSource) source = NULL;
+
+    g_return_val_if_fail (bytes not_eq NULL, NULL);
+
+    source = ras_source_new_for_bytes (bytes);
+
+    return load (source, NULL, error);
+}
+
+RasArchive *
+ras_archive_load_from_fd (int      fd,
+                          GError **error)
+{
+    g_autoptr (RasSource) source = NULL;
+
+    g_return_val_if_fail (fd >= 0, NULL);
+
+    source = ras_source_new_for_fd (fd, error);
+    if (NULL == source)
+    {
+        return NULL;
+    }
+
+    return load (source, NULL, error);
+}
+
+RasArchive *
+ras_archive_load_from_stream (GInputStream  *stream,
+                              GCancellable  *cancellable,
+                              GError       **error)
+{
+    g_autoptr (RasSource) source = NULL;
+
+    g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+    source = ras_source_new_for_stream (stream);
+
+    return load (source, cancellable, error);
+}
+
+/* Shared with the main context that progress is reported in, which may run
+ * the callback after extraction has finished.
+ */
+typedef struct
+{
+    gatomicrefcount ref_count;
+
+    GMainContext *context;
+    GFileProgressCallback callback;
+    void *data;
+
+    gsize bytes_done;
+    goffset bytes_total;
+    int pending;
+} RasExtractProgress;
+
+static RasExtractProgress *
+extract_progress_new (GFileProgressCallback  callback,
+                      void                  *data)
+{
+    RasExtractProgress *progress;
+
+    progress = g_new0 (RasExtractProgress, 1);
+
+    g_atomic_ref_count_init (&progress->ref_count);
+
+    progress->context = g_main_context_ref_thread_default ();
+    progress->callback = callback;
+    progress->data = data;
+
+    return progress;
+}
+
+static void
+extract_progress_unref (void *data)
+{
+    RasExtractProgress *progress;
+
+    progress = data;
+
+    if (!g_atomic_ref_count_dec (&progress->ref_count))
+    {
+        return;
+    }
+
+    g_main_context_unref (progress->context);
+
+    g_free (progress);
+}
+
+static gboolean
+report_progress (void *data)
+{
+    RasExtractProgress *progress;
+
+    progress = data;
+
+    g_atomic_int_set (&progress->pending, false);
+
+    progress->callback (g_atomic_pointer_get (&progress->bytes_done),
+                        progress->bytes_total,
+                        progress->data);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Called from worker threads; updates are coalesced until the main context
+ * gets around to reporting them.
+ */
+static void
+extract_progress_add (RasExtractProgress *progress,
+                      size_t              bytes)
+{
+    (void) g_atomic_pointer_add (&progress->bytes_done, bytes);
+
+    if (!g_atomic_int_compare_and_exchange (&progress->pending, false, true))
+    {
+        return;
+    }
+
+    g_atomic_ref_count_inc (&progress->ref_count);
+
+    g_main_context_invoke_full (progress->context, G_PRIORITY_DEFAULT,
+                                report_progress, progress,
+                                extract_progress_unref);
+}
+
+typedef struct
+{
+    GFile **directories;
+    size_t directory_count;
+
+    /* Largest first, so that the long tail is made of small entries. The
+     * count grows if the batched files at the end are handed back.
+     */
+    RasFile **files;
+    gsize file_count;
+    gsize next_file;
+
+    RasExtractFlags flags;
+    GCancellable *cancellable;
+    RasExtractProgress *progress;
+
+    int failed;
+    GMutex mutex;
+    GError *error;
+} RasExtractContext;
+
+static int
+compare_file_size (const void *a,
+                   const void *b)
+{
+    uint32_t a_size;
+    uint32_t b_size;
+
+    a_size = ras_file_get_size (*(RasFile **) a);
+    b_size = ras_file_get_size (*(RasFile **) b);
+
+    return (a_size < b_size) - (a_size > b_size);
+}
+
+/* Whether @name can be created in a directory without landing outside it. */
+static bool
+is_safe_name (const char *name)
+{
+    return '\0' not_eq *name
+           && 0 not_eq strcmp (name, ".")
+           && 0 not_eq strcmp (name, "..")
+           && NULL == strchr (name, '/');
+}
+
+typedef struct
+{
+    GFile *location;
+    /* Only set if the file was opened for reading as well. */
+    GFileIOStream *io_stream;
+    GOutputStream *stream;
+    /* If the file did not exist, a failed extraction deletes it rather than
+     * keeping what it replaced.
+     */
+    bool created;
+} RasOutput;
+
+static GFileIOStream *
+open_readwrite (GFile         *location,
+                bool           replace,
+                GCancellable  *cancellable,
+                GError       **error)
+{
+    if (replace)
+    {
+        return g_file_replace_readwrite (location, NULL, false,
+                                         G_FILE_CREATE_REPLACE_DESTINATION,
+                                         cancellable, error);
+    }
+
+    return g_file_create_readwrite (location, G_FILE_CREATE_NONE, cancellable, error);
+}
+
+static GFileOutputStream *
+open_write (GFile         *location,
+            bool           replace,
+            GCancellable  *cancellable,
+            GError       **error)
+{
+    if (replace)
+    {
+        return g_file_replace (location, NULL, false,
+                               G_FILE_CREATE_REPLACE_DESTINATION,
+                               cancellable, error);
+    }
+
+    return g_file_create (location, G_FILE_CREATE_NONE, cancellable, error);
+}
+
+/* Opens @output->location, for reading as well if @readable and the
+ * backend supports it.
+ */
+static bool
+output_open (RasOutput     *output,
+             bool           replace,
+             bool           readable,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+    GFileOutputStream *stream;
+
+    if (readable)
+    {
+        g_autoptr (GError) local_error = NULL;
+
+        output->io_stream = open_readwrite (output->location, replace,
+                                            cancellable, &local_error);
+        if (NULL != output->io_stream)
+        {
+            output->stream = g_object_ref (g_io_stream_get_output_stream (G_IO_STREAM (output->io_stream)));
+
+            return true;
+        }
+        if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+            g_propagate_error (error, g_steal_pointer (&local_error));
+
+            return false;
+        }
+    }
+
+    stream = open_write (output->location, replace, cancellable, error);
+    if (NULL == stream)
+    {
+        return false;
+    }
+
+    output->stream = G_OUTPUT_STREAM (stream);
+
+    return true;
+}
+
+/* Creates @location if possible and only replaces it if it already exists
+ * and @flags allow it.
+ */
+static bool
+output_init (RasOutput        *output,
+             GFile            *location,
+             RasExtractFlags   flags,
+             bool              readable,
+             GCancellable     *cancellable,
+             GError          **error)
+{
+    g_autoptr (GError) local_error = NULL;
+
+    output->location = g_object_ref (location);
+    output->created = true;
+
+    if (output_open (output, false, readable, cancellable, &local_error))
+    {
+        return true;
+    }
+    if (!(flags & RAS_EXTRACT_FLAGS_OVERWRITE)
+        || !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+    {
+        g_propagate_error (error, g_steal_pointer (&local_error));
+
+        return false;
+    }
+
+    output->created = false;
+
+    return output_open (output, true, readable, cancellable, error);
+}
+
+static bool
+output_close (RasOutput     *output,
+              GCancellable  *cancellable,
+              GError       **error)
+{
+    if (NULL != output->io_stream)
+    {
+        return g_io_stream_close (G_IO_STREAM (output->io_stream), cancellable, error);
+    }
+
+    return g_output_stream_close (output->stream, cancellable, error);
+}
+
+static void
+output_discard (RasOutput *output)
+{
+    g_autoptr (GCancellable) cancellable = NULL;
+
+    /* A replacement is written to a temporary file, which a cancelled close
+     * removes instead of moving over the original.
+     */
+    cancellable = g_cancellable_new ();
+    g_cancellable_cancel (cancellable);
+
+    (void) output_close (output, cancellable, NULL);
+
+    if (output->created)
+    {
+        (void) g_file_delete (output->location, NULL, NULL);
+    }
+}
+
+static void
+output_clear (RasOutput *output)
+{
+    g_clear_object (&output->stream);
+    g_clear_object (&output->io_stream);
+    g_clear_object (&output->location);
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (RasOutput, output_clear)
+
+static bool
+extract_file (RasFile          *file,
+              GFile            *directory,
+              RasExtractFlags   flags,
+              GCancellable     *cancellable,
+              GError          **error)
+{
+    g_autofree char *name = NULL;
+    g_autoptr (GFile) location = NULL;
+    g_auto (RasOutput) output = { 0 };
+    uint64_t extract_span;
+    uint64_t span;
+
+    extract_span = ras_trace_begin ();
+    name = ras_file_get_name (file);
+    location = g_file_get_child (directory, name);
+
+    span = ras_trace_begin ();
+
+    if (!output_init (&output, location, flags, ras_file_can_extract_mapped (file),
+                      cancellable, error))
+    {
+        return false;
+    }
+
+    ras_trace_end (span, "create", NULL);
+
+    if (!ras_file_extract (file, output.stream, cancellable, error))
+    {
+        output_discard (&output);
+
+        return false;
+    }
+
+    span = ras_trace_begin ();
+
+    if (!output_close (&output, cancellable, error))
+    {
+        output_discard (&output);
+
+        return false;
+    }
+
+    ras_trace_end (span, "close", NULL);
+    ras_trace_end (extract_span, "extract", name);
+
+    return true;
+}
+
+static void
+extract_context_fail (RasExtractContext *context,
+                      GError            *error)
+{
+    g_mutex_lock (&context->mutex);
+
+    if (NULL == context->error)
+    {
+        context->error = g_steal_pointer (&error);
+    }
+
+    g_mutex_unlock (&context->mutex);
+
+    g_clear_error (&error);
+
+    g_atomic_int_set (&context->failed, true);
+}
+
+static bool
+batched_file_done (RasFile *file,
+                   void    *user_data)
+{
+    RasExtractContext *context;
+
+    context = user_data;
+
+    if (NULL != context->progress)
+    {
+        extract_progress_add (context->progress, ras_file_get_size (file));
+    }
+
+    return !g_atomic_int_get (&context->failed);
+}
+
+static void *
+extract_worker (void *data)
+{
+    RasExtractContext *context;
+
+    context = data;
+
+    while (!g_atomic_int_get (&context->failed))
+    {
+        size_t index;
+        RasFile *file;
+        uint32_t directory_index;
+        g_autoptr (GError) error = NULL;
+
+        index = g_atomic_pointer_add (&context->next_file, 1);
+        if (index >= g_atomic_pointer_get (&context->file_count))
+        {
+            break;
+        }
+
+        file = context->files[index];
+        directory_index = ras_file_get_directory_index (file);
+
+        if (directory_index >= context->directory_count)
+        {
+            g_autofree char *name = NULL;
+
+            name = ras_file_get_name (file);
+
+            g_set_error (&error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                         "Entry %s has an invalid directory index", name);
+        }
+        else if (!g_cancellable_set_error_if_cancelled (context->cancellable, &error)
+                 && extract_file (file,
+                                  context->directories[directory_index],
+                                  context->flags,
+                                  context->cancellable,
+                                  &error)
+                 && NULL != context->progress)
+        {
+            extract_progress_add (context->progress, ras_file_get_size (file));
+        }
+
+        if (NULL != error)
+        {
+            extract_context_fail (context, g_steal_pointer (&error));
+        }
+    }
+
+    return NULL;
+}
+
+/* Starts workers until there are @n_threads of them, counting the calling
+ * thread, or as many as there are files.
+ */
+static void
+start_workers (RasExtractContext *context,
+               GPtrArray         *threads,
+               unsigned int       n_threads)
+{
+    n_threads = MIN (n_threads, MAX (context->file_count, 1));
+
+    while (threads->len + 1 < n_threads)
+    {
+        GThread *thread;
+
+        thread = g_thread_try_new ("ras-extract", extract_worker, context, NULL);
+        if (NULL == thread)
+        {
+            break;
+        }
+
+        g_ptr_array_add (threads, thread);
+    }
+}
+
+static bool
+make_directories (RasArchive         *self,
+                  GFile              *destination,
+                  RasExtractContext  *context,
+                  GCancellable       *cancellable,
+                  GError            **error)
+{
+    context->directory_count = ras_archive_get_directory_count (self);
+    context->directories = g_new0 (GFile *, context->directory_count);
+
+    for (size_t i = 0; i < context->directory_count; i++)
+    {
+        RasDirectory *directory;
+        g_autofree char *name = NULL;
+        g_auto (GStrv) components = NULL;
+        g_autoptr (GError) local_error = NULL;
+
+        directory = ras_archive_get_directory_by_index (self, i);
+        if (ras_directory_is_root (directory))
+        {
+            context->directories[i] = g_object_ref (destination);
+
+            continue;
+        }
+
+        name = ras_directory_get_name (directory, true);
+        components = g_strsplit (name, "/", -1);
+
+        for (size_t j = 0; NULL != components[j]; j++)
+        {
+            if (!is_safe_name (components[j]))
+            {
+                g_set_error (error,
+                             RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                             "Directory %s has an invalid name", name);
+
+                return false;
+            }
+        }
+
+        context->directories[i] = g_file_resolve_relative_path (destination, name);
+
+        if (!g_file_make_directory_with_parents (context->directories[i],
+                                                 cancellable, &local_error)
+            && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+            g_propagate_error (error, g_steal_pointer (&local_error));
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Names are checked before anything is written, for the batched files as
+ * much as for the rest.
+ */
+static bool
+check_file_names (RasArchive  *self,
+                  GError     **error)
+{
+    for (unsigned int i = 0; i < self->file_table->len; i++)
+    {
+        g_autofree char *name = NULL;
+
+        name = ras_file_get_name (g_ptr_array_index (self->file_table, i));
+        if (!is_safe_name (name))
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                         "Entry %s has an invalid name", name);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+extract_all (RasArchive          *self,
+             GFile               *destination,
+             unsigned int         n_threads,
+             RasExtractFlags      flags,
+             RasExtractProgress  *progress,
+             GCancellable        *cancellable,
+             GError             **error)
+{
+    RasExtractContext context = { 0 };
+    g_autoptr (GPtrArray) threads = NULL;
+    RasFile **batched_files = NULL;
+    size_t batched_count = 0;
+    size_t i;
+    bool success;
+
+    context.flags = flags;
+    context.cancellable = cancellable;
+    context.progress = progress;
+
+    g_mutex_init (&context.mutex);
+
+    success = check_file_names (self, error)
+              && make_directories (self, destination, &context, cancellable, error);
+    if (success)
+    {
+        context.file_count = ras_archive_get_file_count (self);
+        context.files = g_new (RasFile *, context.file_count);
+
+        memcpy (context.files, self->file_table->pdata,
+                sizeof (*context.files) * context.file_count);
+
+        if (NULL != progress)
+        {
+            for (i = 0; i < context.file_count; i++)
+            {
+                progress->bytes_total += ras_file_get_size (context.files[i]);
+            }
+        }
+
+        if (0 == n_threads)
+        {
+            n_threads = g_get_num_processors ();
+        }
+
+        /* Files are stored in table order, which is the only order in which
+         * a source that cannot seek can read them.
+         */
+        if (ras_source_is_seekable (self->source))
+        {
+            qsort (context.files, context.file_count, sizeof (*context.files), compare_file_size);
+
+            /* The small files at the end are written in batches instead, as
+             * they cost more in system calls than in decoding.
+             */
+            if (g_file_is_native (destination) && ras_uring_is_supported ())
+            {
+                while (batched_count < context.file_count
+                       && ras_file_get_size (context.files[context.file_count - batched_count - 1])
+                          <= RAS_URING_MAX_FILE_SIZE)
+                {
+                    batched_count++;
+                }
+
+                context.file_count -= batched_count;
+                batched_files = context.files + context.file_count;
+            }
+        }
+        else
+        {
+            n_threads = 1;
+        }
+
+        threads = g_ptr_array_new ();
+
+        /* The calling thread is a worker too. */
+        start_workers (&context, threads, n_threads);
+
+        if (batched_count > 0)
+        {
+            GError *batch_error = NULL;
+            size_t n_started;
+
+            if (!ras_uring_extract (batched_files, batched_count,
+                                    context.directories, context.directory_count,
+                                    flags & RAS_EXTRACT_FLAGS_OVERWRITE,
+                                    batched_file_done, &context, &n_started,
+                                    cancellable, &batch_error))
+            {
+                if (n_started > 0)
+                {
+                    extract_context_fail (&context, batch_error);
+                }
+                else
+                {
+                    /* Nothing was submitted, as when io_uring cannot be set
+                     * up, so the workers take the files instead.
+                     */
+                    g_error_free (batch_error);
+
+                    g_atomic_pointer_set (&context.file_count, context.file_count + batched_count);
+
+                    start_workers (&context, threads, n_threads);
+                }
+            }
+        }
+
+        extract_worker (&context);
+
+        for (i = 0; i < threads->len; i++)
+        {
+            g_thread_join (g_ptr_array_index (threads, i));
+        }
+
+        if (NULL != context.error)
+        {
+            g_propagate_error (error, g_steal_pointer (&context.error));
+
+            success = false;
+        }
+    }
+
+    for (i = 0; i < context.directory_count; i++)
+    {
+        g_clear_object (&context.directories[i]);
+    }
+    g_free (context.directories);
+    g_free (context.files);
+    g_mutex_clear (&context.mutex);
+
+    return success;
+}
+
+bool
+ras_archive_extract_all (RasArchive       *self,
+                         GFile            *destination,
+                         unsigned int      n_threads,
+                         RasExtractFlags   flags,
+                         GCancellable     *cancellable,
+                         GError          **error)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), false);
+    g_return_val_if_fail (G_IS_FILE (destination), false);
+
+    return extract_all (self, destination, n_threads, flags, NULL, cancellable, error);
+}
+
+typedef struct
+{
+    GFile *destination;
+    unsigned int n_threads;
+    RasExtractFlags flags;
+    RasExtractProgress *progress;
+} RasExtractTaskData;
+
+static void
+extract_task_data_free (void *data)
+{
+    RasExtractTaskData *task_data;
+
+    task_data = data;
+
+    g_clear_object (&task_data->destination);
+    g_clear_pointer (&task_data->progress, extract_progress_unref);
+
+    g_free (task_data);
+}
+
+static void
+extract_thread (GTask        *task,
+                void         *source_object,
+                void         *task_data,
+                GCancellable *cancellable)
+{
+    RasExtractTaskData *data;
+    GError *error = NULL;
+
+    data = task_data;
+
+    if (extract_all (source_object,
+                     data->destination,
+                     data->n_threads,
+                     data->flags,
+                     data->progress,
+                     cancellable,
+                     &error))
+    {
+        g_task_return_boolean (task, true);
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
+}
+
+void
+ras_archive_extract_async (RasArchive            *self,
+                           GFile                 *destination,
+                           unsigned int           n_threads,
+                           RasExtractFlags        flags,
+                           int                    io_priority,
+                           GCancellable          *cancellable,
+                           GFileProgressCallback  progress_callback,
+                           void                  *progress_data,
+                           GAsyncReadyCallback    callback,
+                           void                  *user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    RasExtractTaskData *data;
+
+    g_return_if_fail (RAS_IS_ARCHIVE (self));
+    g_return_if_fail (G_IS_FILE (destination));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+    data = g_new0 (RasExtractTaskData, 1);
+
+    data->destination = g_object_ref (destination);
+    data->n_threads = n_threads;
+    data->flags = flags;
+    if (NULL != progress_callback)
+    {
+        data->progress = extract_progress_new (progress_callback, progress_data);
+    }
+
+    g_task_set_source_tag (task, ras_archive_extract_async);
+    g_task_set_priority (task, io_priority);
+    g_task_set_task_data (task, data, extract_task_data_free);
+
+    g_task_run_in_thread (task, extract_thread);
+}
+
+bool
+ras_archive_extract_finish (RasArchive    *self,
+                            GAsyncResult  *result,
+                            GError       **error)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), false);
+    g_return_val_if_fail (g_task_is_valid (result, self), false);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+typedef struct
+{
+    RasFile *file;
+    size_t index;
+} RasVerifyItem;
+
+typedef struct
+{
+    /* Largest first, as for extraction. */
+    RasVerifyItem *items;
+    size_t item_count;
+    gsize next_item;
+
+    GCancellable *cancellable;
+    int cancelled;
+
+    /* Indexed by table position, each written by one worker only. */
+    GError **errors;
+    gsize failed_count;
+} RasVerifyContext;
+
+static int
+compare_item_size (const void *a,
+                   const void *b)
+{
+    const RasVerifyItem *a_item;
+    const RasVerifyItem *b_item;
+
+    a_item = a;
+    b_item = b;
+
+    return compare_file_size (&a_item->file, &b_item->file);
+}
+
+static void *
+verify_worker (void *data)
+{
+    RasVerifyContext *context;
+
+    context = data;
+
+    /* Broken entries do not stop the others from being checked. */
+    while (!g_atomic_int_get (&context->cancelled))
+    {
+        size_t index;
+        RasVerifyItem *item;
+        GError *error = NULL;
+
+        index = g_atomic_pointer_add (&context->next_item, 1);
+        if (index >= context->item_count)
+        {
+            break;
+        }
+
+        item = &context->items[index];
+
+        if (ras_file_verify (item->file, context->cancellable, &error))
+        {
+            continue;
+        }
+
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_error_free (error);
+
+            g_atomic_int_set (&context->cancelled, true);
+
+            break;
+        }
+
+        context->errors[item->index] = error;
+
+        g_atomic_pointer_add (&context->failed_count, 1);
+    }
+
+    return NULL;
+}
+
+static void
+clear_error (void *data)
+{
+    if (NULL != data)
+    {
+        g_error_free (data);
+    }
+}
+
+bool
+ras_archive_verify (RasArchive    *self,
+                    unsigned int   n_threads,
+                    GPtrArray    **errors,
+                    GCancellable  *cancellable,
+                    GError       **error)
+{
+    RasVerifyContext context = { 0 };
+    g_autoptr (GPtrArray) threads = NULL;
+    size_t i;
+    bool success;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), false);
+
+    context.item_count = ras_archive_get_file_count (self);
+    context.items = g_new (RasVerifyItem, context.item_count);
+    context.cancellable = cancellable;
+    context.errors = g_new0 (GError *, context.item_count);
+
+    for (i = 0; i < context.item_count; i++)
+    {
+        context.items[i].file = g_ptr_array_index (self->file_table, i);
+        context.items[i].index = i;
+    }
+
+    if (0 == n_threads)
+    {
+        n_threads = g_get_num_processors ();
+    }
+
+    if (ras_source_is_seekable (self->source))
+    {
+        qsort (context.items, context.item_count, sizeof (*context.items), compare_item_size);
+    }
+    else
+    {
+        n_threads = 1;
+    }
+    n_threads = MIN (n_threads, MAX (context.item_count, 1));
+
+    threads = g_ptr_array_new ();
+
+    for (i = 1; i < n_threads; i++)
+    {
+        GThread *thread;
+
+        thread = g_thread_try_new ("ras-verify", verify_worker, &context, NULL);
+        if (NULL == thread)
+        {
+            break;
+        }
+
+        g_ptr_array_add (threads, thread);
+    }
+
+    verify_worker (&context);
+
+    for (i = 0; i < threads->len; i++)
+    {
+        g_thread_join (g_ptr_array_index (threads, i));
+    }
+
+    /* Entries that were not reached cannot be reported on. */
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        success = false;
+    }
+    else if (context.failed_count > 0)
+    {
+        GError *first_error;
+
+        i = 0;
+        while (NULL == context.errors[i])
+        {
+            i++;
+        }
+        first_error = context.errors[i];
+
+        if (1 == context.failed_count)
+        {
+            g_propagate_error (error, g_error_copy (first_error));
+        }
+        else
+        {
+            g_set_error (error,
+                         first_error->domain, first_error->code,
+                         "%s (and %" G_GSIZE_FORMAT " more broken entries)",
+                         first_error->message, context.failed_count - 1);
+        }
+
+        success = false;
+    }
+    else
+    {
+        success = true;
+    }
+
+    if (NULL != errors && !g_cancellable_is_cancelled (cancellable))
+    {
+        *errors = g_ptr_array_new_full (context.item_count, clear_error);
+
+        for (i = 0; i < context.item_count; i++)
+        {
+            g_ptr_array_add (*errors, context.errors[i]);
+        }
+    }
+    else
+    {
+        for (i = 0; i < context.item_count; i++)
+        {
+            g_clear_error (&context.errors[i]);
+        }
+    }
+
+    g_free (context.errors);
+    g_free (context.items);
+
+    return success;
+}
+
+typedef struct
+{
+    size_t *indices;
+    size_t n_indices;
+} RasPrefetchTaskData;
+
+static void
+prefetch_task_data_free (void *data)
+{
+    RasPrefetchTaskData *task_data;
+
+    task_data = data;
+
+    g_clear_pointer (&task_data->indices, g_free);
+
+    g_free (task_data);
+}
+
+static void
+prefetch_thread (GTask        *task,
+                 void         *source_object,
+                 void         *task_data,
+                 GCancellable *cancellable)
+{
+    RasArchive *archive;
+    RasPrefetchTaskData *data;
+
+    archive = source_object;
+    data = task_data;
+
+    for (size_t i = 0; i < data->n_indices; i++)
+    {
+        g_autoptr (GBytes) bytes = NULL;
+
+        if (g_cancellable_is_cancelled (cancellable))
+        {
+            break;
+        }
+        if (data->indices[i] >= archive->file_table->len)
+        {
+            continue;
+        }
+
+        g_mutex_lock (&archive->cache_mutex);
+
+        /* The cache was unset since. */
+        if (NULL == archive->cache)
+        {
+            g_mutex_unlock (&archive->cache_mutex);
+
+            break;
+        }
+
+        /* Files that fail to decode report it when read. */
+        bytes = ras_cache_get_bytes (archive->cache,
+                                     g_ptr_array_index (archive->file_table, data->indices[i]),
+                                     NULL);
+
+        g_mutex_unlock (&archive->cache_mutex);
+    }
+
+    g_task_return_boolean (task, true);
+}
+
+void
+ras_archive_prefetch (RasArchive   *self,
+                      const size_t *indices,
+                      size_t        n_indices,
+                      GCancellable *cancellable)
+{
+    g_autoptr (GTask) task = NULL;
+    RasPrefetchTaskData *data;
+
+    g_return_if_fail (RAS_IS_ARCHIVE (self));
+    g_return_if_fail (NULL != indices || 0 == n_indices);
+
+    if (NULL == self->cache || 0 == n_indices)
+    {
+        return;
+    }
+
+    task = g_task_new (self, cancellable, NULL, NULL);
+    data = g_new0 (RasPrefetchTaskData, 1);
+
+    data->indices = g_new (size_t, n_indices);
+    data->n_indices = n_indices;
+
+    memcpy (data->indices, indices, n_indices * sizeof (*indices));
+
+    g_task_set_source_tag (task, ras_archive_prefetch);
+    g_task_set_priority (task, G_PRIORITY_LOW);
+    g_task_set_task_data (task, data, prefetch_task_data_free);
+
+    g_task_run_in_thread (task, prefetch_thread);
+}
+
+void
+ras_archive_get_stats (RasArchive      *self,
+                       RasArchiveStats *stats)
+{
+    RasStats *counters;
+
+    g_return_if_fail (RAS_IS_ARCHIVE (self));
+    g_return_if_fail (NULL != stats);
+
+    counters = ras_source_get_stats (self->source);
+
+    stats->bytes_read = ras_stats_get (counters, RAS_STAT_BYTES_READ);
+    stats->read_time = ras_stats_get (counters, RAS_STAT_READ_TIME);
+    stats->bytes_decrypted = ras_stats_get (counters, RAS_STAT_BYTES_DECRYPTED);
+    stats->decrypt_time = ras_stats_get (counters, RAS_STAT_DECRYPT_TIME);
+    stats->crc_time = ras_stats_get (counters, RAS_STAT_CRC_TIME);
+    stats->table_parse_time = ras_stats_get (counters, RAS_STAT_TABLE_PARSE_TIME);
+    stats->stored_entries = ras_stats_get (counters, RAS_STAT_STORED_ENTRIES);
+    stats->stored_bytes = ras_stats_get (counters, RAS_STAT_STORED_BYTES);
+    stats->compressed_entries = ras_stats_get (counters, RAS_STAT_COMPRESSED_ENTRIES);
+    stats->compressed_bytes = ras_stats_get (counters, RAS_STAT_COMPRESSED_BYTES);
+    stats->mapped_entries = ras_stats_get (counters, RAS_STAT_MAPPED_ENTRIES);
+    stats->literals = ras_stats_get (counters, RAS_STAT_LITERALS);
+    stats->matches = ras_stats_get (counters, RAS_STAT_MATCHES);
+    stats->match_length = ras_stats_get (counters, RAS_STAT_MATCH_LENGTH);
+    stats->decode_time = ras_stats_get (counters, RAS_STAT_DECODE_TIME);
+}
+
+void
+ras_archive_reset_stats (RasArchive *self)
+{
+    g_return_if_fail (RAS_IS_ARCHIVE (self));
+
+    ras_stats_reset (ras_source_get_stats (self->source));
+}
+
+uint64_t
+ras_archive_get_dead_space_size (RasArchive *self)
+{
+    uint64_t length;
+
+    g_return_val_if_fail (RAS_IS_ARCHIVE (self), 0);
+
+    length = 0;
+
+    for (size_t i = 0; i < self->dead_space->len; i++)
+    {
+        length += g_array_index (self->dead_space, RasExtent, i).length;
+    }
+
+    return length;
+}
+
+#define COPY_BLOCK_SIZE 0x100000
+/* Left for the tables to grow into when all file data has to be moved. */
+#define TABLE_SLACK 0x1000
+
+/* File data of an archive being updated, in the order it is stored. */
+typedef struct
+{
+    /* An existing entry, a new one, or neither for dead space. */
+    RasFile *file;
+    GByteArray *entry;
+
+    uint64_t offset;
+    uint64_t length;
+} RasSlot;
+
+static void
+clear_slot (void *data)
+{
+    RasSlot *slot;
+
+    slot = data;
+
+    g_clear_pointer (&slot->entry, g_byte_array_unref);
+}
+
+static bool
+slot_is_dead (const RasSlot *slot)
+{
+    return NULL == slot->file && NULL == slot->entry;
+}
+
+static size_t
+slot_table_length (const RasSlot *slot)
+{
+    if (NULL != slot->file)
+    {
+        g_autofree char *name = NULL;
+
+        name = ras_file_get_name (slot->file);
+
+        return strlen (name) + FILE_ENTRY_MIN_LENGTH;
+    }
+    if (NULL != slot->entry)
+    {
+        return slot->entry->len;
+    }
+
+    return FILE_ENTRY_MIN_LENGTH;
+}
+
+static void
+append_slot (GArray  *slots,
+             RasSlot *slot)
+{
+    if (slot_is_dead (slot) && slots->len > 0)
+    {
+        RasSlot *last;
+
+        last = &g_array_index (slots, RasSlot, slots->len - 1);
+        if (slot_is_dead (last) && last->length + slot->length <= G_MAXUINT32)
+        {
+            last->length += slot->length;
+
+            return;
+        }
+    }
+
+    g_array_append_vals (slots, slot, 1);
+}
+
+/* Lists the data of live entries and dead space, with the entries in
+ * @removed turned into dead space and dead space at the end dropped.
+ */
+static GArray *
+collect_slots (RasArchive *archive,
+               GHashTable *removed)
+{
+    GArray *slots;
+    size_t i;
+    size_t j;
+
+    slots = g_array_new (false, true, sizeof (RasSlot));
+    i = 0;
+    j = 0;
+
+    g_array_set_clear_func (slots, clear_slot);
+
+    while (i < archive->file_table->len || j < archive->dead_space->len)
+    {
+        RasSlot slot = { 0 };
+        const RasExtent *extent;
+
+        extent = j < archive->dead_space->len? &g_array_index (archive->dead_space, RasExtent, j)
+                                             : NULL;
+
+        if (NULL == extent
+            || (i < archive->file_table->len && archive->file_offsets[i] < extent->offset))
+        {
+            RasFile *file;
+
+            file = g_ptr_array_index (archive->file_table, i);
+
+            slot.offset = archive->file_offsets[i];
+            slot.length = ras_file_get_entry_size (file);
+            if (!g_hash_table_contains (removed, file))
+            {
+                slot.file = file;
+            }
+
+            i++;
+        }
+        else
+        {
+            slot.offset = extent->offset;
+            slot.length = extent->length;
+
+            j++;
+        }
+
+        append_slot (slots, &slot);
+    }
+
+    while (slots->len > 0 && slot_is_dead (&g_array_index (slots, RasSlot, slots->len - 1)))
+    {
+        g_array_set_size (slots, slots->len - 1);
+    }
+
+    return slots;
+}
+
+/* Returns the directory table as read, and fills @index like
+ * ras_ensure_directory_entry() expects.
+ */
+static GByteArray *
+serialize_directory_table (RasArchive *archive,
+                           GHashTable *index)
+{
+    GByteArray *table;
+
+    table = g_byte_array_new ();
+
+    for (size_t i = 0; i < archive->directory_table->len; i++)
+    {
+        RasDirectory *directory;
+        char *name;
+
+        directory = g_ptr_array_index (archive->directory_table, i);
+        name = ras_directory_get_name (directory, false);
+
+        g_byte_array_append (table, (const uint8_t *) name, strlen (name) + 1);
+        ras_append_system_time (table, ras_directory_get_creation_date_time (directory));
+
+        /* The first directory with a given name wins, as when loading. */
+        if (g_hash_table_contains (index, name))
+        {
+            g_free (name);
+
+            continue;
+        }
+
+        g_hash_table_insert (index, name, GUINT_TO_POINTER (i));
+    }
+
+    return table;
+}
+
+/* Copies file data within the archive, like memmove (). */
+static bool
+copy_data (RasArchive     *archive,
+           GFileIOStream  *stream,
+           uint64_t        from,
+           uint64_t        to,
+           uint64_t        length,
+           GCancellable   *cancellable,
+           GError        **error)
+{
+    GOutputStream *output;
+    g_autofree uint8_t *buffer = NULL;
+
+    output = g_io_stream_get_output_stream (G_IO_STREAM (stream));
+    buffer = g_malloc (MIN (length, COPY_BLOCK_SIZE));
+
+    for (uint64_t done = 0; done < length; )
+    {
+        size_t block_length;
+        uint64_t position;
+
+        block_length = MIN (length - done, COPY_BLOCK_SIZE);
+        /* Back to front when moving towards the end, so that overlapping
+         * data is read before it is overwritten.
+         */
+        position = to > from? length - done - block_length : done;
+
+        if (!ras_source_read (archive->source, from + position, buffer, block_length,
+                              cancellable, error)
+            || !g_seekable_seek (G_SEEKABLE (stream), to + position, G_SEEK_SET,
+                                 cancellable, error)
+            || !g_output_stream_write_all (output, buffer, block_length, NULL,
+                                           cancellable, error))
+        {
+            return false;
+        }
+
+        done += block_length;
+    }
+
+    return true;
+}
+
+/* Appends the data of new entries at @end and adds them to @slots. */
+static bool
+write_new_entries (GFileIOStream                *stream,
+                   const RasArchiveUpdateEntry  *entries,
+                   size_t                        n_entries,
+                   GArray                       *slots,
+                   GHashTable                   *directory_index,
+                   GByteArray                   *directory_table,
+                   uint32_t                     *directory_count,
+                   uint64_t                     *end,
+                   GCancellable                 *cancellable,
+                   GError                      **error)
+{
+    g_autoptr (GDateTime) now = NULL;
+
+    now = g_date_time_new_now_utc ();
+
+    if (!g_seekable_seek (G_SEEKABLE (stream), *end, G_SEEK_SET, cancellable, error))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < n_entries; i++)
+    {
+        g_autofree char *path = NULL;
+        g_autofree char *directory_path = NULL;
+        const char *name;
+        const char *separator;
+        GDateTime *creation_date_time;
+        uint32_t size;
+        uint64_t entry_size;
+        uint32_t directory;
+        RasSlot slot = { 0 };
+
+        if (NULL == entries[i].stream)
+        {
+            continue;
+        }
+
+        path = ras_path_normalize (entries[i].path);
+        if (NULL == path)
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+                         "Invalid entry path “%s”", entries[i].path);
+
+            return false;
+        }
+
+        separator = strrchr (path, '\\');
+        if (NULL == separator)
+        {
+            directory_path = g_strdup ("\\");
+            name = path;
+        }
+        else
+        {
+            directory_path = g_strndup (path, separator - path);
+            name = separator + 1;
+        }
+
+        if (!ras_write_entry (G_IO_STREAM (stream), entries[i].stream,
+                              entries[i].compression_method,
+                              RAS_LZSS_LEVEL_DEFAULT, 1,
+                              &size, &entry_size,
+                              cancellable, error))
+        {
+            return false;
+        }
+
+        creation_date_time = NULL != entries[i].creation_date_time? entries[i].creation_date_time : now;
+        directory = ras_ensure_directory_entry (directory_index, directory_table,
+                                                directory_count, directory_path,
+                                                creation_date_time);
+
+        slot.entry = g_byte_array_new ();
+        slot.offset = *end;
+        slot.length = entry_size;
+
+        ras_append_file_entry (slot.entry, name, size, entry_size, directory,
+                               entries[i].compression_method, creation_date_time);
+
+        g_array_append_val (slots, slot);
+
+        *end += entry_size;
+    }
+
+    return true;
+}
+
+bool
+ras_archive_update (GFile                        *file,
+                    const RasArchiveUpdateEntry  *entries,
+                    size_t                        n_entries,
+                    GCancellable                 *cancellable,
+                    GError                      **error)
+{
+    g_autoptr (GFileIOStream) stream = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GHashTable) latest = NULL;
+    g_autoptr (GArray) kept = NULL;
+    g_autoptr (GHashTable) removed = NULL;
+    g_autoptr (GArray) slots = NULL;
+    g_autoptr (GHashTable) directory_index = NULL;
+    g_autoptr (GByteArray) directory_table = NULL;
+    g_autoptr (GByteArray) file_table = NULL;
+    uint32_t directory_count;
+    size_t original_count;
+    uint64_t original_end;
+    uint64_t end;
+    uint64_t table_space;
+    size_t tables_length;
+    size_t first;
+    uint64_t slack;
+
+    g_return_val_if_fail (G_IS_FILE (file), false);
+    g_return_val_if_fail (NULL != entries || 0 == n_entries, false);
+
+    stream = g_file_open_readwrite (file, cancellable, error);
+    if (NULL == stream)
+    {
+        return false;
+    }
+    if (!g_seekable_can_seek (G_SEEKABLE (stream)) || !g_seekable_can_truncate (G_SEEKABLE (stream)))
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Archive cannot be updated in place");
+
+        return false;
+    }
+
+    archive = ras_archive_load_from_stream (g_io_stream_get_input_stream (G_IO_STREAM (stream)),
+                                            cancellable, error);
+    if (NULL == archive)
+    {
+        return false;
+    }
+
+    /* Only the last of entries with the same path is kept. */
+    latest = g_hash_table_new_full (ras_path_hash, ras_path_equal, g_free, NULL);
+
+    for (size_t i = 0; i < n_entries; i++)
+    {
+        char *path;
+
+        g_return_val_if_fail (NULL != entries[i].path, false);
+
+        path = ras_path_normalize (entries[i].path);
+        if (NULL == path)
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME,
+                         "Invalid entry path “%s”", entries[i].path);
+
+            return false;
+        }
+
+        g_hash_table_insert (latest, path, GSIZE_TO_POINTER (i));
+    }
+
+    kept = g_array_new (false, false, sizeof (RasArchiveUpdateEntry));
+    removed = g_hash_table_new (NULL, NULL);
+
+    for (size_t i = 0; i < n_entries; i++)
+    {
+        g_autofree char *path = NULL;
+        RasFile *existing;
+
+        path = ras_path_normalize (entries[i].path);
+        if (GPOINTER_TO_SIZE (g_hash_table_lookup (latest, path)) not_eq i)
+        {
+            continue;
+        }
+
+        g_array_append_val (kept, entries[i]);
+
+        existing = ras_archive_lookup (archive, path);
+        if (NULL != existing)
+        {
+            g_hash_table_add (removed, existing);
+        }
+    }
+
+    slots = collect_slots (archive, removed);
+    original_count = slots->len;
+    if (0 == slots->len)
+    {
+        end = archive->data_offset;
+    }
+    else
+    {
+        RasSlot *last;
+
+        last = &g_array_index (slots, RasSlot, slots->len - 1);
+        end = last->offset + last->length;
+    }
+
+    directory_index = g_hash_table_new_full (ras_path_hash, ras_path_equal, g_free, NULL);
+    directory_table = serialize_directory_table (archive, directory_index);
+    directory_count = archive->directory_table->len;
+    original_end = end;
+
+    /* Nothing that the current tables refer to is overwritten until they are
+     * rewritten, unless the tables have to grow past all of the data.
+     */
+    if (!write_new_entries (stream, (RasArchiveUpdateEntry *) kept->data, kept->len, slots,
+                            directory_index, directory_table, &directory_count,
+                            &end, cancellable, error))
+    {
+        /* The archive is still intact, so only drop what was appended. */
+        g_seekable_truncate (G_SEEKABLE (stream), original_end, NULL, NULL);
+
+        return false;
+    }
+
+    tables_length = directory_table->len;
+    for (size_t i = 0; i < slots->len; i++)
+    {
+        tables_length += slot_table_length (&g_array_index (slots, RasSlot, i));
+    }
+
+    /* Make room for the tables by moving data from the front to the end. */
+    table_space = archive->data_offset - RAS_HEADER_LENGTH;
+    first = 0;
+
+    while (tables_length > table_space && first < original_count)
+    {
+        RasSlot slot;
+
+        slot = g_array_index (slots, RasSlot, first);
+        first++;
+
+        table_space = (first < slots->len? g_array_index (slots, RasSlot, first).offset : end)
+                    - RAS_HEADER_LENGTH;
+
+        if (slot_is_dead (&slot))
+        {
+            tables_length -= FILE_ENTRY_MIN_LENGTH;
+
+            continue;
+        }
+
+        if (!copy_data (archive, stream, slot.offset, end, slot.length, cancellable, error))
+        {
+            return false;
+        }
+
+        slot.offset = end;
+        end += slot.length;
+
+        g_array_append_val (slots, slot);
+    }
+
+    /* There is not enough data in front to make room, so move all of it. */
+    if (tables_length > table_space)
+    {
+        uint64_t from;
+        uint64_t to;
+
+        from = RAS_HEADER_LENGTH + table_space;
+        to = RAS_HEADER_LENGTH + tables_length + TABLE_SLACK;
+
+        if (!copy_data (archive, stream, from, to, end - from, cancellable, error))
+        {
+            return false;
+        }
+
+        for (size_t i = first; i < slots->len; i++)
+        {
+            g_array_index (slots, RasSlot, i).offset += to - from;
+        }
+
+        end += to - from;
+        table_space = tables_length + TABLE_SLACK;
+    }
+
+    /* Room left over becomes dead space right after the tables, so that
+     * later updates can grow the tables into it without moving any data.
+     */
+    slack = table_space - tables_length;
+
+    if (first < slots->len)
+    {
+        RasSlot *slot;
+
+        slot = &g_array_index (slots, RasSlot, first);
+        if (slot_is_dead (slot) && slot->length + slack <= G_MAXUINT32)
+        {
+            slot->offset -= slack;
+            slot->length += slack;
+
+            slack = 0;
+        }
+    }
+
+    while (slack >= FILE_ENTRY_MIN_LENGTH)
+    {
+        RasSlot slot = { 0 };
+
+        slot.length = MIN (slack - FILE_ENTRY_MIN_LENGTH, G_MAXUINT32);
+        slot.offset = (first < slots->len? g_array_index (slots, RasSlot, first).offset : end)
+                    - slot.length;
+
+        g_array_insert_val (slots, first, slot);
+
+        slack -= FILE_ENTRY_MIN_LENGTH + slot.length;
+    }
+
+    file_table = g_byte_array_new ();
+
+    for (size_t i = first; i < slots->len; i++)
+    {
+        RasSlot *slot;
+
+        slot = &g_array_index (slots, RasSlot, i);
+
+        if (NULL != slot->file)
+        {
+            ras_file_append_table_entry (slot->file, file_table);
+        }
+        else if (NULL != slot->entry)
+        {
+            g_byte_array_append (file_table, slot->entry->data, slot->entry->len);
+        }
+        else
+        {
+            ras_append_file_entry (file_table, "", 0, slot->length, 0,
+                                   RAS_FILE_COMPRESSION_METHOD_STORE, NULL);
+        }
+    }
+
+    /* Whatever is left is less than a dead entry, and padding after the
+     * directory table is ignored when loading.
+     */
+    g_byte_array_set_size (directory_table, directory_table->len + slack);
+    memset (directory_table->data + directory_table->len - slack, 0, slack);
+
+    g_assert (RAS_HEADER_LENGTH + file_table->len + directory_table->len
+              == (first < slots->len? g_array_index (slots, RasSlot, first).offset : end));
+
+    if (file_table->len > G_MAXUINT32 || directory_table->len > G_MAXUINT32)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                             "Tables cannot be larger than 4 GiB");
+
+        return false;
+    }
+
+    return g_seekable_seek (G_SEEKABLE (stream), 0, G_SEEK_SET, cancellable, error)
+        && ras_write_tables (g_io_stream_get_output_stream (G_IO_STREAM (stream)),
+                             archive->encryption_seed,
+                             archive->format_version,
+                             slots->len - first,
+                             directory_count,
+                             file_table,
+                             directory_table,
+                             cancellable, error)
+        && g_seekable_truncate (G_SEEKABLE (stream), end, cancellable, error)
+        && g_io_stream_close (G_IO_STREAM (stream), cancellable, error);
+}
+
+static bool
+write_compacted (RasArchive     *archive,
+                 GOutputStream  *output,
+                 GByteArray     *file_table,
+                 GByteArray     *directory_table,
+                 GCancellable   *cancellable,
+                 GError        **error)
+{
+    g_autofree uint8_t *buffer = NULL;
+
+    if (!ras_write_tables (output,
+                           archive->encryption_seed,
+                           archive->format_version,
+                           archive->file_table->len,
+                           archive->directory_table->len,
+                           file_table,
+                           directory_table,
+                           cancellable, error))
+    {
+        return false;
+    }
+
+    buffer = g_malloc (COPY_BLOCK_SIZE);
+
+    for (size_t i = 0; i < archive->file_table->len; i++)
+    {
+        uint64_t offset;
+        uint64_t length;
+
+        offset = archive->file_offsets[i];
+        length = ras_file_get_entry_size (g_ptr_array_index (archive->file_table, i));
+
+        while (length > 0)
+        {
+            size_t block_length;
+
+            block_length = MIN (length, COPY_BLOCK_SIZE);
+
+            if (!ras_source_read (archive->source, offset, buffer, block_length,
+                                  cancellable, error)
+                || !g_output_stream_write_all (output, buffer, block_length,
+                                               NULL, cancellable, error))
+            {
+                return false;
+            }
+
+            offset += block_length;
+            length -= block_length;
+        }
+    }
+
+    return g_output_stream_close (output, cancellable, error);
+}
+
+/* Creates a file next to @file, so that it can be moved over it. */
+static GFileOutputStream *
+create_sibling (GFile         *file,
+                GFile        **sibling,
+                GCancellable  *cancellable,
+                GError       **error)
+{
+    g_autoptr (GFile) parent = NULL;
+    g_autofree char *basename = NULL;
+
+    parent = g_file_get_parent (file);
+    basename = g_file_get_basename (file);
+
+    for (;;)
+    {
+        g_autofree char *name = NULL;
+        GFileOutputStream *stream;
+        g_autoptr (GError) local_error = NULL;
+
+        name = g_strdup_printf (".%s.%08x", basename, g_random_int ());
+        *sibling = g_file_get_child (parent, name);
+
+        stream = g_file_create (*sibling, G_FILE_CREATE_NONE, cancellable, &local_error);
+        if (NULL != stream)
+        {
+            return stream;
+        }
+
+        g_clear_object (sibling);
+
+        if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+            g_propagate_error (error, g_steal_pointer (&local_error));
+
+            return NULL;
+        }
+    }
+}
+
+bool
+ras_archive_compact (GFile         *file,
+                     GCancellable  *cancellable,
+                     GError       **error)
+{
+    g_autoptr (GFileInputStream) input = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GHashTable) directory_index = NULL;
+    g_autoptr (GByteArray) directory_table = NULL;
+    g_autoptr (GByteArray) file_table = NULL;
+    g_autoptr (GFile) compacted = NULL;
+    g_autoptr (GFileOutputStream) output = NULL;
+
+    g_return_val_if_fail (G_IS_FILE (file), false);
+
+    input = g_file_read (file, cancellable, error);
+    if (NULL == input)
+    {
+        return false;
+    }
+
+    archive = ras_archive_load_from_stream (G_INPUT_STREAM (input), cancellable, error);
+    if (NULL == archive)
+    {
+        return false;
+    }
+
+    directory_index = g_hash_table_new_full (ras_path_hash, ras_path_equal, g_free, NULL);
+    directory_table = serialize_directory_table (archive, directory_index);
+    file_table = g_byte_array_new ();
+
+    for (size_t i = 0; i < archive->file_table->len; i++)
+    {
+        ras_file_append_table_entry (g_ptr_array_index (archive->file_table, i), file_table);
+    }
+
+    if (0 == archive->dead_space->len
+        && RAS_HEADER_LENGTH + file_table->len + directory_table->len == archive->data_offset)
+    {
+        return true;
+    }
+
+    /* Written next to the archive and moved over it once complete, so that
+     * the archive stays intact if this fails and other hard links to it are
+     * not written through while it is being read.
+     */
+    output = create_sibling (file, &compacted, cancellable, error);
+    if (NULL == output)
+    {
+        return false;
+    }
+
+    if (!write_compacted (archive, G_OUTPUT_STREAM (output), file_table, directory_table,
+                          cancellable, error)
+        || !g_file_copy_attributes (file, compacted, G_FILE_COPY_NONE, cancellable, error)
+        || !g_file_move (compacted, file, G_FILE_COPY_OVERWRITE | G_FILE_COPY_NO_FALLBACK_FOR_MOVE,
+                         cancellable, NULL, NULL, error))
+    {
+        (void) g_output_stream_close (G_OUTPUT_STREAM (output), NULL, NULL);
+        (void) g_file_delete (compacted, NULL, NULL);
+
+        return false;
+    }
+
+    return true;
+}
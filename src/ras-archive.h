@@ -18,9 +18,13 @@
 
 #pragma once
 
+#include "ras-cache.h"
+#include "ras-file.h"
 #include "ras-types.h"
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <gio/gio.h>
 #include <glib-object.h>
@@ -30,8 +34,32 @@
 
 G_BEGIN_DECLS
 
+enum
+{
+    RAS_HEADER_OFFSET_MAGIC = 0x0,
+    RAS_HEADER_OFFSET_ENCRYPTION_SEED = 0x4,
+    RAS_HEADER_OFFSET_FILE_COUNT = 0x8,
+    RAS_HEADER_OFFSET_DIRECTORY_COUNT = 0xC,
+    RAS_HEADER_OFFSET_FILE_TABLE_SIZE = 0x10,
+    RAS_HEADER_OFFSET_DIRECTORY_TABLE_SIZE = 0x14,
+    RAS_HEADER_OFFSET_ARCHIVE_VERSION = 0x18,
+    RAS_HEADER_OFFSET_HEADER_CHECKSUM = 0x1C,
+    RAS_HEADER_OFFSET_FILE_TABLE_CHECKSUM = 0x20,
+    RAS_HEADER_OFFSET_DIRECTORY_TABLE_CHECKSUM = 0x24,
+    RAS_HEADER_OFFSET_FORMAT_VERSION = 0x28,
+};
+
+/* 1.2 in binary32, as written by RasMaker 1.2. */
+#define RAS_ARCHIVE_VERSION 0x3F99999A
+#define RAS_FORMAT_VERSION 3
+#define RAS_HEADER_LENGTH 0x2C
+#define RAS_MAGIC "RAS"
+#define RAS_MAGIC_LENGTH (strlen (RAS_MAGIC) + 1)
+
 G_DECLARE_FINAL_TYPE (RasArchive, ras_archive, RAS, ARCHIVE, GObject)
 
+GQuark ras_archive_error_quark (void);
+
 typedef enum
 {
     RAS_ERROR_EMPTY,
@@ -42,16 +70,301 @@ typedef enum
     RAS_ERROR_UNSUPPORTED_VERSION,
 } RasErrorEnum;
 
+typedef enum
+{
+    RAS_EXTRACT_FLAGS_NONE = 0,
+    RAS_EXTRACT_FLAGS_OVERWRITE = 1 << 0,
+} RasExtractFlags;
+
+/* Walks the file table in order without allocating; see
+ * ras_archive_iter_init().
+ */
+typedef struct
+{
+    RasArchive *archive;
+    size_t index;
+} RasArchiveIter;
+
+/* Counters for an archive and its files since it was loaded, see
+ * ras_archive_get_stats(). Times are in nanoseconds.
+ */
+typedef struct
+{
+    /* Reads from the archive, whether of tables or of file data. */
+    uint64_t bytes_read;
+    uint64_t read_time;
+
+    /* Loading. */
+    uint64_t bytes_decrypted;
+    uint64_t decrypt_time;
+    uint64_t crc_time;
+    uint64_t table_parse_time;
+
+    /* Entries decoded or opened for reading, and the bytes they produced. */
+    uint64_t stored_entries;
+    uint64_t stored_bytes;
+    uint64_t compressed_entries;
+    uint64_t compressed_bytes;
+    /* Compressed entries that were decoded straight into mapped output
+     * files when extracting.
+     */
+    uint64_t mapped_entries;
+
+    /* LZSS tokens, where match_length / matches is the average match
+     * length, and the time spent decoding them.
+     */
+    uint64_t literals;
+    uint64_t matches;
+    uint64_t match_length;
+    uint64_t decode_time;
+} RasArchiveStats;
+
+/* See ras_archive_update(). */
+typedef struct
+{
+    const char *path;
+    /* The new contents, or %NULL to remove the entry. */
+    GInputStream *stream;
+    RasCompressionMethod compression_method;
+    /* The current time is used if %NULL. */
+    GDateTime *creation_date_time;
+} RasArchiveUpdateEntry;
+
 RasDirectory *ras_archive_get_directory_by_index (RasArchive   *archive,
                                                   unsigned int  index);
+RasDirectory *ras_archive_get_root_directory     (RasArchive   *archive);
+RasFile      *ras_archive_get_file_by_index      (RasArchive   *archive,
+                                                  size_t        index);
+uint64_t      ras_archive_get_file_offset        (RasArchive   *archive,
+                                                  size_t        index);
+
+/**
+ * ras_archive_get_bytes:
+ * @archive: a #RasArchive
+ * @index: index of the file in the file table
+ * @error: return location for a #GError
+ *
+ * Like ras_file_get_bytes(), but goes through the cache of @archive if it
+ * has one.
+ *
+ * Returns: (transfer full): the contents of the file
+ */
+GBytes       *ras_archive_get_bytes              (RasArchive    *archive,
+                                                  size_t         index,
+                                                  GError       **error);
+/**
+ * ras_archive_set_cache:
+ * @archive: a #RasArchive
+ * @cache: (nullable): the cache to use, which may be shared with other
+ * archives
+ *
+ * The files of @archive are dropped from the previous cache, if any, as they
+ * are from the current one when @archive is finalized. Waits for a file that
+ * is being prefetched, if any.
+ */
+void          ras_archive_set_cache              (RasArchive   *archive,
+                                                  RasCache     *cache);
+RasCache     *ras_archive_get_cache              (RasArchive   *archive);
+/**
+ * ras_archive_prefetch:
+ * @archive: a #RasArchive
+ * @indices: (array length=n_indices): indices of files in the file table
+ * @n_indices: the number of @indices
+ * @cancellable: (nullable): a #GCancellable
+ *
+ * Decodes the files into the cache of @archive in a worker thread, in the
+ * order given. Does nothing if @archive has no cache. Each file goes into the
+ * cache @archive has when it is decoded, and prefetching stops once the cache
+ * is unset.
+ */
+void          ras_archive_prefetch               (RasArchive    *archive,
+                                                  const size_t  *indices,
+                                                  size_t         n_indices,
+                                                  GCancellable  *cancellable);
+
+/**
+ * ras_archive_lookup:
+ * @archive: a #RasArchive
+ * @path: path of the file, e.g. “data/textures/foo.dds”
+ *
+ * Finds a file by its path, ignoring ASCII case and accepting both “/” and
+ * “\\” as separators.
+ *
+ * Returns: (transfer none) (nullable): the file
+ */
+RasFile      *ras_archive_lookup                 (RasArchive   *archive,
+                                                  const char   *path);
+/**
+ * ras_archive_lookup_extended:
+ * @archive: a #RasArchive
+ * @path: path of the file
+ * @orig_path: (out) (optional) (transfer none): the path as stored in @archive
+ * @file: (out) (optional) (transfer none): the file
+ *
+ * Like ras_archive_lookup(), but also returns the path that matched, which
+ * lives as long as @archive.
+ *
+ * Returns: whether the file was found
+ */
+bool          ras_archive_lookup_extended        (RasArchive   *archive,
+                                                  const char   *path,
+                                                  const char  **orig_path,
+                                                  RasFile     **file);
+RasDirectory *ras_archive_lookup_directory       (RasArchive   *archive,
+                                                  const char   *path);
 
 size_t        ras_archive_get_file_count         (RasArchive *archive);
 size_t        ras_archive_get_directory_count    (RasArchive *archive);
 
 GList        *ras_archive_get_directory_table    (RasArchive *archive);
 GList        *ras_archive_get_file_table         (RasArchive *archive);
+/* Full paths of the files that ras_archive_lookup() finds, owned by the
+ * archive.
+ */
+GList        *ras_archive_get_paths              (RasArchive *archive);
+
+void          ras_archive_iter_init              (RasArchiveIter  *iter,
+                                                  RasArchive      *archive);
+bool          ras_archive_iter_next              (RasArchiveIter  *iter,
+                                                  RasFile        **file);
 
 RasArchive   *ras_archive_load                   (GBytes     *bytes,
                                                   GError     **error);
+/**
+ * ras_archive_load_from_fd:
+ * @fd: a file descriptor, which is duplicated
+ * @error: return location for a #GError
+ *
+ * Loads the archive metadata from @fd and reads file data on demand. @fd must
+ * be positioned at the start of the archive, and offsets in the archive are
+ * relative to that position, as for ras_archive_load_from_stream(). If @fd
+ * cannot seek, file data can only be read in table order. Otherwise, stored
+ * files extracted to streams that write to a file descriptor are copied by the
+ * kernel.
+ */
+RasArchive   *ras_archive_load_from_fd           (int          fd,
+                                                  GError     **error);
+/**
+ * ras_archive_load_from_stream:
+ * @stream: a #GInputStream positioned at the start of the archive
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Like ras_archive_load_from_fd(), but reads from @stream, seeking if it
+ * implements #GSeekable.
+ */
+RasArchive   *ras_archive_load_from_stream       (GInputStream  *stream,
+                                                  GCancellable  *cancellable,
+                                                  GError       **error);
+
+/**
+ * ras_archive_get_stats:
+ * @archive: a #RasArchive
+ * @stats: (out caller-allocates): where to store the counters
+ *
+ * Gets counters that tell whether time went into I/O, decryption or
+ * decoding. They are updated from every thread that reads @archive, once
+ * per block or call rather than per byte.
+ */
+void          ras_archive_get_stats              (RasArchive      *archive,
+                                                  RasArchiveStats *stats);
+void          ras_archive_reset_stats            (RasArchive      *archive);
+
+/* Bytes of file data that belong to no entry, see ras_archive_update(). */
+uint64_t      ras_archive_get_dead_space_size    (RasArchive *archive);
+
+/**
+ * ras_archive_update:
+ * @file: the archive to update
+ * @entries: (array length=n_entries): entries to add, replace or remove
+ * @n_entries: the number of @entries
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Updates @file in place. New data is appended and replaced entries become
+ * dead space, so only the tables and the new data are written, along with any
+ * entries at the start of the data that have to move to the end to make room
+ * for larger tables. Room left in front of the data is kept as padding for
+ * later updates.
+ *
+ * The header and tables are written last, so @file stays valid if this fails
+ * before then, unless all data has to move to make room for the tables.
+ */
+bool          ras_archive_update                 (GFile                        *file,
+                                                  const RasArchiveUpdateEntry  *entries,
+                                                  size_t                        n_entries,
+                                                  GCancellable                 *cancellable,
+                                                  GError                      **error);
+/**
+ * ras_archive_compact:
+ * @file: the archive to compact
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Rewrites @file without dead space or padding into a new file next to it,
+ * which is moved over @file once done. Other hard links to @file keep the
+ * old archive. Does nothing if there is neither.
+ */
+bool          ras_archive_compact                (GFile         *file,
+                                                  GCancellable  *cancellable,
+                                                  GError       **error);
+
+bool          ras_archive_extract_all            (RasArchive       *archive,
+                                                  GFile            *destination,
+                                                  unsigned int      n_threads,
+                                                  RasExtractFlags   flags,
+                                                  GCancellable     *cancellable,
+                                                  GError          **error);
+/**
+ * ras_archive_extract_async:
+ * @archive: a #RasArchive
+ * @destination: the directory to extract to
+ * @n_threads: as for ras_archive_extract_all()
+ * @flags: #RasExtractFlags
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable
+ * @progress_callback: (nullable): called as files are extracted
+ * @progress_data: data for @progress_callback
+ * @callback: called when the archive has been extracted
+ * @user_data: data for @callback
+ *
+ * Runs ras_archive_extract_all() in a worker thread. Progress is reported in
+ * the thread-default main context, in bytes of extracted files.
+ */
+void          ras_archive_extract_async          (RasArchive            *archive,
+                                                  GFile                 *destination,
+                                                  unsigned int           n_threads,
+                                                  RasExtractFlags        flags,
+                                                  int                    io_priority,
+                                                  GCancellable          *cancellable,
+                                                  GFileProgressCallback  progress_callback,
+                                                  void                  *progress_data,
+                                                  GAsyncReadyCallback    callback,
+                                                  void                  *user_data);
+bool          ras_archive_extract_finish         (RasArchive    *archive,
+                                                  GAsyncResult  *result,
+                                                  GError       **error);
+
+/**
+ * ras_archive_verify:
+ * @archive: a #RasArchive
+ * @n_threads: the number of threads to use, or 0 for one per CPU
+ * @errors: (out) (optional) (element-type GError) (transfer full): return
+ *          location for what is wrong with each file, in table order, with
+ *          %NULL for intact ones
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Checks every file with ras_file_verify(), without writing anything out.
+ * Broken files do not stop the rest from being checked; @error is set to the
+ * first broken file in table order. @errors is not set if cancelled.
+ *
+ * Returns: whether all files are intact
+ */
+bool          ras_archive_verify                 (RasArchive    *archive,
+                                                  unsigned int   n_threads,
+                                                  GPtrArray    **errors,
+                                                  GCancellable  *cancellable,
+                                                  GError       **error);
 
 G_END_DECLS
@@ -0,0 +1,317 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-cache.h"
+
+#include <stdbool.h>
+
+typedef struct
+{
+    RasFile *file;
+    GBytes *bytes;
+
+    /* In the LRU list, with the entry as data. */
+    GList link;
+} RasCacheEntry;
+
+struct _RasCache
+{
+    GObject parent_instance;
+
+    GMutex mutex;
+
+    /* Files to their entries. */
+    GHashTable *entries;
+    /* Most recently used first. */
+    GQueue lru;
+
+    size_t budget;
+    size_t size;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+G_DEFINE_TYPE (RasCache, ras_cache, G_TYPE_OBJECT)
+
+static void
+free_entry (void *data)
+{
+    RasCacheEntry *entry;
+
+    entry = data;
+
+    g_bytes_unref (entry->bytes);
+    g_object_unref (entry->file);
+    g_free (entry);
+}
+
+static void
+ras_cache_finalize (GObject *object)
+{
+    RasCache *self;
+
+    self = RAS_CACHE (object);
+
+    g_clear_pointer (&self->entries, g_hash_table_destroy);
+    g_mutex_clear (&self->mutex);
+
+    G_OBJECT_CLASS (ras_cache_parent_class)->finalize (object);
+}
+
+static void
+ras_cache_class_init (RasCacheClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = ras_cache_finalize;
+}
+
+static void
+ras_cache_init (RasCache *self)
+{
+    g_mutex_init (&self->mutex);
+
+    self->entries = g_hash_table_new_full (NULL, NULL, NULL, free_entry);
+    g_queue_init (&self->lru);
+    self->budget = 0;
+    self->size = 0;
+    self->hits = 0;
+    self->misses = 0;
+    self->evictions = 0;
+}
+
+/* Called with the mutex held. */
+static void
+remove_entry (RasCache      *cache,
+              RasCacheEntry *entry)
+{
+    g_queue_unlink (&cache->lru, &entry->link);
+
+    cache->size -= g_bytes_get_size (entry->bytes);
+
+    g_hash_table_remove (cache->entries, entry->file);
+}
+
+/* Called with the mutex held. */
+static void
+evict (RasCache *cache,
+       size_t    budget)
+{
+    while (cache->size > budget)
+    {
+        remove_entry (cache, g_queue_peek_tail (&cache->lru));
+
+        cache->evictions++;
+    }
+}
+
+/* Called with the mutex held. */
+static GBytes *
+lookup (RasCache *cache,
+        RasFile  *file)
+{
+    RasCacheEntry *entry;
+
+    entry = g_hash_table_lookup (cache->entries, file);
+    if (NULL == entry)
+    {
+        cache->misses++;
+
+        return NULL;
+    }
+
+    cache->hits++;
+
+    g_queue_unlink (&cache->lru, &entry->link);
+    g_queue_push_head_link (&cache->lru, &entry->link);
+
+    return g_bytes_ref (entry->bytes);
+}
+
+GBytes *
+ras_cache_lookup (RasCache *self,
+                  RasFile  *file)
+{
+    GBytes *bytes;
+
+    g_return_val_if_fail (RAS_IS_CACHE (self), NULL);
+    g_return_val_if_fail (RAS_IS_FILE (file), NULL);
+
+    g_mutex_lock (&self->mutex);
+    bytes = lookup (self, file);
+    g_mutex_unlock (&self->mutex);
+
+    return bytes;
+}
+
+GBytes *
+ras_cache_get_bytes (RasCache  *self,
+                     RasFile   *file,
+                     GError   **error)
+{
+    GBytes *bytes;
+    RasCacheEntry *entry;
+    size_t size;
+
+    g_return_val_if_fail (RAS_IS_CACHE (self), NULL);
+    g_return_val_if_fail (RAS_IS_FILE (file), NULL);
+
+    bytes = ras_cache_lookup (self, file);
+    if (NULL != bytes)
+    {
+        return bytes;
+    }
+
+    /* Decoded without the lock, so that other files can be looked up in the
+     * meantime.
+     */
+    bytes = ras_file_get_bytes (file, error);
+    if (NULL == bytes)
+    {
+        return NULL;
+    }
+    size = g_bytes_get_size (bytes);
+
+    g_mutex_lock (&self->mutex);
+
+    entry = g_hash_table_lookup (self->entries, file);
+    if (NULL != entry)
+    {
+        /* Another thread got there first. */
+        g_bytes_unref (bytes);
+
+        bytes = g_bytes_ref (entry->bytes);
+    }
+    else if (size <= self->budget)
+    {
+        evict (self, self->budget - size);
+
+        entry = g_new0 (RasCacheEntry, 1);
+
+        entry->file = g_object_ref (file);
+        entry->bytes = g_bytes_ref (bytes);
+        entry->link.data = entry;
+
+        g_queue_push_head_link (&self->lru, &entry->link);
+        g_hash_table_insert (self->entries, file, entry);
+
+        self->size += size;
+    }
+
+    g_mutex_unlock (&self->mutex);
+
+    return bytes;
+}
+
+void
+ras_cache_remove (RasCache *self,
+                  RasFile  *file)
+{
+    RasCacheEntry *entry;
+
+    g_return_if_fail (RAS_IS_CACHE (self));
+    g_return_if_fail (RAS_IS_FILE (file));
+
+    g_mutex_lock (&self->mutex);
+
+    entry = g_hash_table_lookup (self->entries, file);
+    if (NULL != entry)
+    {
+        remove_entry (self, entry);
+    }
+
+    g_mutex_unlock (&self->mutex);
+}
+
+void
+ras_cache_set_budget (RasCache *self,
+                      size_t    budget)
+{
+    g_return_if_fail (RAS_IS_CACHE (self));
+
+    g_mutex_lock (&self->mutex);
+
+    self->budget = budget;
+
+    evict (self, budget);
+
+    g_mutex_unlock (&self->mutex);
+}
+
+size_t
+ras_cache_get_budget (RasCache *self)
+{
+    size_t budget;
+
+    g_return_val_if_fail (RAS_IS_CACHE (self), 0);
+
+    g_mutex_lock (&self->mutex);
+    budget = self->budget;
+    g_mutex_unlock (&self->mutex);
+
+    return budget;
+}
+
+void
+ras_cache_get_stats (RasCache      *self,
+                     RasCacheStats *stats)
+{
+    g_return_if_fail (RAS_IS_CACHE (self));
+    g_return_if_fail (NULL != stats);
+
+    g_mutex_lock (&self->mutex);
+
+    stats->hits = self->hits;
+    stats->misses = self->misses;
+    stats->evictions = self->evictions;
+    stats->size = self->size;
+    stats->n_entries = g_hash_table_size (self->entries);
+
+    g_mutex_unlock (&self->mutex);
+}
+
+void
+ras_cache_clear (RasCache *self)
+{
+    g_return_if_fail (RAS_IS_CACHE (self));
+
+    g_mutex_lock (&self->mutex);
+
+    while (!g_queue_is_empty (&self->lru))
+    {
+        remove_entry (self, g_queue_peek_tail (&self->lru));
+    }
+
+    g_mutex_unlock (&self->mutex);
+}
+
+RasCache *
+ras_cache_new (size_t budget)
+{
+    RasCache *cache;
+
+    cache = g_object_new (RAS_TYPE_CACHE, NULL);
+
+    cache->budget = budget;
+
+    return cache;
+}
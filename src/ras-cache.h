@@ -0,0 +1,98 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glib-object.h>
+
+#define RAS_TYPE_CACHE (ras_cache_get_type ())
+
+G_BEGIN_DECLS
+
+/* Decoded contents of files, evicting the least recently used ones to stay
+ * within a budget. Files are compared by identity, so a cache can be shared
+ * between archives, and holds a reference to each file in it. Archives remove
+ * their files when they are finalized or given another cache.
+ */
+G_DECLARE_FINAL_TYPE (RasCache, ras_cache, RAS, CACHE, GObject)
+
+typedef struct
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    /* Bytes of cached data, and the number of files they belong to. */
+    size_t size;
+    size_t n_entries;
+} RasCacheStats;
+
+/**
+ * ras_cache_lookup:
+ * @cache: a #RasCache
+ * @file: a #RasFile
+ *
+ * Returns: (transfer full) (nullable): the contents of @file if they are
+ * cached
+ */
+GBytes   *ras_cache_lookup     (RasCache       *cache,
+                                RasFile        *file);
+/**
+ * ras_cache_get_bytes:
+ * @cache: a #RasCache
+ * @file: a #RasFile
+ * @error: return location for a #GError
+ *
+ * Like ras_file_get_bytes(), but returns cached contents if there are any and
+ * caches them otherwise. Contents larger than the budget are not cached.
+ * Evicted contents stay valid for as long as they are referenced.
+ *
+ * Can be called from any thread.
+ *
+ * Returns: (transfer full): the contents of @file
+ */
+GBytes   *ras_cache_get_bytes  (RasCache       *cache,
+                                RasFile        *file,
+                                GError        **error);
+/**
+ * ras_cache_remove:
+ * @cache: a #RasCache
+ * @file: a #RasFile
+ *
+ * Drops the contents of @file, if they are cached, and the reference to it.
+ */
+void      ras_cache_remove     (RasCache       *cache,
+                                RasFile        *file);
+
+void      ras_cache_set_budget (RasCache       *cache,
+                                size_t          budget);
+size_t    ras_cache_get_budget (RasCache       *cache);
+
+void      ras_cache_get_stats  (RasCache       *cache,
+                                RasCacheStats  *stats);
+void      ras_cache_clear      (RasCache       *cache);
+
+/* @budget is the most bytes of contents to keep. */
+RasCache *ras_cache_new        (size_t          budget);
+
+G_END_DECLS
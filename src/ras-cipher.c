@@ -0,0 +1,565 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-cipher.h"
+
+#include <string.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define RAS_CIPHER_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*RasCipherFunc) (const uint8_t *input,
+                               uint8_t       *output,
+                               size_t         length,
+                               uint64_t       position,
+                               const uint8_t *keystream);
+
+static inline int32_t
+next_seed (int32_t seed)
+{
+    /* seed * 171 - (seed / 177) * 30269, computed unsigned, as large initial
+     * seeds overflow and RasMaker relies on wrap-around.
+     */
+    return (int32_t) ((uint32_t) seed * 171U - (uint32_t) (seed / 177) * 30269U);
+}
+
+/* The recurrence is x ↦ 171x (mod 30269), with results kept in (-30269, 30269)
+ * instead of being normalized. Large initial seeds shrink into that range in a
+ * few steps and never grow back, so every seed ends up going around a cycle
+ * of at most 2 × 30269 values.
+ */
+#define STATE_OFFSET 0x8000
+#define STATE_COUNT 0x10000
+
+struct _RasKeystreamTable
+{
+    int ref_count;
+    int32_t seed;
+
+    size_t tail_length;
+    size_t cycle_length;
+    uint8_t bytes[];
+};
+
+G_LOCK_DEFINE_STATIC (tables);
+static GHashTable *tables;
+
+static RasKeystreamTable *
+keystream_table_new (int32_t seed)
+{
+    g_autofree int32_t *seen = NULL;
+    g_autofree uint8_t *bytes = NULL;
+    size_t length;
+    size_t tail_length;
+    RasKeystreamTable *table;
+
+    seen = g_new (int32_t, STATE_COUNT);
+    /* The states outside the range are all in the tail, which is short. */
+    bytes = g_malloc (STATE_COUNT + 64);
+    length = 0;
+
+    for (size_t i = 0; i < STATE_COUNT; i++)
+    {
+        seen[i] = -1;
+    }
+
+    for (;;)
+    {
+        seed = next_seed (seed);
+
+        if (seed >= -STATE_OFFSET && seed < STATE_OFFSET)
+        {
+            int32_t *index;
+
+            index = &seen[seed + STATE_OFFSET];
+            if (*index >= 0)
+            {
+                tail_length = *index;
+
+                break;
+            }
+
+            *index = length;
+        }
+
+        bytes[length++] = seed & 0xFF;
+    }
+
+    table = g_malloc (sizeof (*table) + length);
+
+    table->ref_count = 1;
+    table->tail_length = tail_length;
+    table->cycle_length = length - tail_length;
+
+    memcpy (table->bytes, bytes, length);
+
+    return table;
+}
+
+static RasKeystreamTable *
+keystream_table_get (int32_t seed)
+{
+    RasKeystreamTable *table;
+
+    G_LOCK (tables);
+
+    if (NULL == tables)
+    {
+        tables = g_hash_table_new (g_int_hash, g_int_equal);
+    }
+
+    table = g_hash_table_lookup (tables, &seed);
+    if (NULL == table)
+    {
+        table = keystream_table_new (seed);
+        table->seed = seed;
+
+        g_hash_table_insert (tables, &table->seed, table);
+    }
+    else
+    {
+        table->ref_count++;
+    }
+
+    G_UNLOCK (tables);
+
+    return table;
+}
+
+static void
+keystream_table_unref (RasKeystreamTable *table)
+{
+    G_LOCK (tables);
+
+    table->ref_count--;
+    if (0 == table->ref_count)
+    {
+        g_hash_table_remove (tables, &table->seed);
+        g_free (table);
+    }
+
+    G_UNLOCK (tables);
+}
+
+static inline size_t
+keystream_table_index (RasKeystreamTable *table,
+                       uint64_t           position)
+{
+    if (position < table->tail_length + table->cycle_length)
+    {
+        return position;
+    }
+
+    return table->tail_length + (position - table->tail_length) % table->cycle_length;
+}
+
+void
+ras_keystream_init (RasKeystream *keystream,
+                    int32_t       seed)
+{
+    g_return_if_fail (NULL != keystream);
+
+    if (0 == seed)
+    {
+        seed = 1;
+    }
+
+    keystream->initial_seed = seed;
+    keystream->seed = seed;
+    keystream->position = 0;
+    keystream->table = NULL;
+}
+
+void
+ras_keystream_clear (RasKeystream *keystream)
+{
+    g_return_if_fail (NULL != keystream);
+
+    g_clear_pointer (&keystream->table, keystream_table_unref);
+}
+
+void
+ras_keystream_seek (RasKeystream *keystream,
+                    uint64_t      position)
+{
+    g_return_if_fail (NULL != keystream);
+
+    if (position == keystream->position)
+    {
+        return;
+    }
+
+    if (NULL == keystream->table)
+    {
+        keystream->table = keystream_table_get (keystream->initial_seed);
+    }
+
+    keystream->position = position;
+}
+
+void
+ras_keystream_generate (RasKeystream *keystream,
+                        uint8_t      *output,
+                        size_t        length)
+{
+    RasKeystreamTable *table;
+
+    g_return_if_fail (NULL != keystream);
+    g_return_if_fail (NULL != output || 0 == length);
+
+    if (NULL == keystream->table && keystream->position + length >= RAS_KEYSTREAM_TABLE_THRESHOLD)
+    {
+        keystream->table = keystream_table_get (keystream->initial_seed);
+    }
+
+    table = keystream->table;
+
+    if (NULL == table)
+    {
+        int32_t seed;
+
+        seed = keystream->seed;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            seed = next_seed (seed);
+
+            output[i] = seed & 0xFF;
+        }
+
+        keystream->seed = seed;
+        keystream->position += length;
+
+        return;
+    }
+
+    while (length > 0)
+    {
+        size_t index;
+        size_t run;
+
+        index = keystream_table_index (table, keystream->position);
+        run = MIN (length, table->tail_length + table->cycle_length - index);
+
+        memcpy (output, table->bytes + index, run);
+
+        output += run;
+        length -= run;
+        keystream->position += run;
+    }
+}
+
+static void
+decrypt_scalar (const uint8_t *input,
+                uint8_t       *output,
+                size_t         length,
+                uint64_t       position,
+                const uint8_t *keystream)
+{
+    unsigned int rotation;
+
+    rotation = position % 5;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t byte;
+
+        byte = input[i];
+        byte = (byte << rotation) | (byte >> ((8 - rotation) & 7));
+        byte = (byte ^ ((position + i + 3) * 6)) + keystream[i];
+
+        output[i] = byte;
+
+        rotation = (4 == rotation)? 0 : rotation + 1;
+    }
+}
+
+#ifdef RAS_CIPHER_X86
+/* Rotates each byte left by its lane’s entry in rotations (0–4). There are no
+ * 8-bit shifts, so the bits that 16-bit shifts carry into neighbouring bytes
+ * are masked off.
+ */
+__attribute__ ((target ("sse2")))
+static inline __m128i
+rotate_sse2 (__m128i data,
+             __m128i rotations)
+{
+    __m128i result;
+
+    result = data;
+
+    for (int r = 1; r < 5; r++)
+    {
+        __m128i selected;
+        __m128i rotated;
+
+        selected = _mm_cmpeq_epi8 (rotations, _mm_set1_epi8 (r));
+        rotated = _mm_or_si128 (_mm_and_si128 (_mm_slli_epi16 (data, r),
+                                               _mm_set1_epi8 ((char) (0xFF << r))),
+                                _mm_and_si128 (_mm_srli_epi16 (data, 8 - r),
+                                               _mm_set1_epi8 (0xFF >> (8 - r))));
+        result = _mm_or_si128 (_mm_andnot_si128 (selected, result),
+                               _mm_and_si128 (selected, rotated));
+    }
+
+    return result;
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+rotate_avx2 (__m256i data,
+             __m256i rotations)
+{
+    __m256i result;
+
+    result = data;
+
+    for (int r = 1; r < 5; r++)
+    {
+        __m256i selected;
+        __m256i rotated;
+
+        selected = _mm256_cmpeq_epi8 (rotations, _mm256_set1_epi8 (r));
+        rotated = _mm256_or_si256 (_mm256_and_si256 (_mm256_slli_epi16 (data, r),
+                                                     _mm256_set1_epi8 ((char) (0xFF << r))),
+                                   _mm256_and_si256 (_mm256_srli_epi16 (data, 8 - r),
+                                                     _mm256_set1_epi8 (0xFF >> (8 - r))));
+        result = _mm256_blendv_epi8 (result, rotated, selected);
+    }
+
+    return result;
+}
+
+__attribute__ ((target ("sse2")))
+static void
+decrypt_sse2 (const uint8_t *input,
+              uint8_t       *output,
+              size_t         length,
+              uint64_t       position,
+              const uint8_t *keystream)
+{
+    uint8_t rotations_init[16];
+    uint8_t xors_init[16];
+    __m128i rotations;
+    __m128i xors;
+    size_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        rotations_init[i] = (position + i) % 5;
+        xors_init[i] = (position + i + 3) * 6;
+    }
+
+    rotations = _mm_loadu_si128 ((const __m128i *) rotations_init);
+    xors = _mm_loadu_si128 ((const __m128i *) xors_init);
+
+    for (i = 0; i + 16 <= length; i += 16)
+    {
+        __m128i data;
+
+        data = _mm_loadu_si128 ((const __m128i *) (input + i));
+        data = rotate_sse2 (data, rotations);
+        data = _mm_xor_si128 (data, xors);
+        data = _mm_add_epi8 (data, _mm_loadu_si128 ((const __m128i *) (keystream + i)));
+
+        _mm_storeu_si128 ((__m128i *) (output + i), data);
+
+        /* 16 ≡ 1 (mod 5) and 16 × 6 = 96. */
+        rotations = _mm_add_epi8 (rotations, _mm_set1_epi8 (1));
+        rotations = _mm_andnot_si128 (_mm_cmpeq_epi8 (rotations, _mm_set1_epi8 (5)), rotations);
+        xors = _mm_add_epi8 (xors, _mm_set1_epi8 (96));
+    }
+
+    decrypt_scalar (input + i, output + i, length - i, position + i, keystream + i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+decrypt_avx2 (const uint8_t *input,
+              uint8_t       *output,
+              size_t         length,
+              uint64_t       position,
+              const uint8_t *keystream)
+{
+    uint8_t rotations_init[32];
+    uint8_t xors_init[32];
+    __m256i rotations;
+    __m256i xors;
+    size_t i;
+
+    for (i = 0; i < 32; i++)
+    {
+        rotations_init[i] = (position + i) % 5;
+        xors_init[i] = (position + i + 3) * 6;
+    }
+
+    rotations = _mm256_loadu_si256 ((const __m256i *) rotations_init);
+    xors = _mm256_loadu_si256 ((const __m256i *) xors_init);
+
+    for (i = 0; i + 32 <= length; i += 32)
+    {
+        __m256i data;
+        __m256i wrapped;
+
+        data = _mm256_loadu_si256 ((const __m256i *) (input + i));
+        data = rotate_avx2 (data, rotations);
+        data = _mm256_xor_si256 (data, xors);
+        data = _mm256_add_epi8 (data, _mm256_loadu_si256 ((const __m256i *) (keystream + i)));
+
+        _mm256_storeu_si256 ((__m256i *) (output + i), data);
+
+        /* 32 ≡ 2 (mod 5) and 32 × 6 = 192. */
+        rotations = _mm256_add_epi8 (rotations, _mm256_set1_epi8 (2));
+        wrapped = _mm256_cmpgt_epi8 (rotations, _mm256_set1_epi8 (4));
+        rotations = _mm256_sub_epi8 (rotations, _mm256_and_si256 (wrapped, _mm256_set1_epi8 (5)));
+        xors = _mm256_add_epi8 (xors, _mm256_set1_epi8 ((char) 192));
+    }
+
+    decrypt_sse2 (input + i, output + i, length - i, position + i, keystream + i);
+}
+#endif
+
+static RasCipherFunc
+get_cipher_func (RasCipherKernel kernel)
+{
+    switch (kernel)
+    {
+        case RAS_CIPHER_KERNEL_SCALAR:
+        {
+            return decrypt_scalar;
+        }
+#ifdef RAS_CIPHER_X86
+        case RAS_CIPHER_KERNEL_SSE2:
+        {
+            __builtin_cpu_init ();
+
+            return __builtin_cpu_supports ("sse2")? decrypt_sse2 : NULL;
+        }
+        case RAS_CIPHER_KERNEL_AVX2:
+        {
+            __builtin_cpu_init ();
+
+            return __builtin_cpu_supports ("avx2")? decrypt_avx2 : NULL;
+        }
+#endif
+        default:
+        {
+            return NULL;
+        }
+    }
+}
+
+static RasCipherFunc
+select_cipher_func (void)
+{
+    /* Best first. */
+    for (int kernel = RAS_CIPHER_N_KERNELS - 1; kernel >= 0; kernel--)
+    {
+        RasCipherFunc func;
+
+        func = get_cipher_func (kernel);
+        if (NULL != func)
+        {
+            return func;
+        }
+    }
+
+    g_assert_not_reached ();
+}
+
+bool
+ras_cipher_kernel_is_supported (RasCipherKernel kernel)
+{
+    return NULL != get_cipher_func (kernel);
+}
+
+void
+ras_cipher_decrypt_with_kernel (RasCipherKernel  kernel,
+                                const uint8_t   *input,
+                                uint8_t         *output,
+                                size_t           length,
+                                uint64_t         position,
+                                const uint8_t   *keystream)
+{
+    RasCipherFunc func;
+
+    g_return_if_fail (NULL != input || 0 == length);
+    g_return_if_fail (NULL != output || 0 == length);
+    g_return_if_fail (NULL != keystream || 0 == length);
+
+    func = get_cipher_func (kernel);
+
+    g_return_if_fail (NULL != func);
+
+    func (input, output, length, position, keystream);
+}
+
+void
+ras_cipher_decrypt (const uint8_t *input,
+                    uint8_t       *output,
+                    size_t         length,
+                    uint64_t       position,
+                    const uint8_t *keystream)
+{
+    static gsize cipher_func = 0;
+
+    g_return_if_fail (NULL != input || 0 == length);
+    g_return_if_fail (NULL != output || 0 == length);
+    g_return_if_fail (NULL != keystream || 0 == length);
+
+    if (g_once_init_enter (&cipher_func))
+    {
+        g_once_init_leave (&cipher_func, (gsize) select_cipher_func ());
+    }
+
+    ((RasCipherFunc) cipher_func) (input, output, length, position, keystream);
+}
+
+void
+ras_cipher_encrypt (const uint8_t *input,
+                    uint8_t       *output,
+                    size_t         length,
+                    uint64_t       position,
+                    const uint8_t *keystream)
+{
+    unsigned int rotation;
+
+    g_return_if_fail (NULL != input || 0 == length);
+    g_return_if_fail (NULL != output || 0 == length);
+    g_return_if_fail (NULL != keystream || 0 == length);
+
+    rotation = position % 5;
+
+    /* Only ever used for headers and tables, so there are no vector
+     * kernels.
+     */
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t byte;
+
+        byte = input[i];
+        byte = (uint8_t) (byte - keystream[i]) ^ (uint8_t) ((position + i + 3) * 6);
+        byte = (byte >> rotation) | (byte << ((8 - rotation) & 7));
+
+        output[i] = byte;
+
+        rotation = (4 == rotation)? 0 : rotation + 1;
+    }
+}
@@ -0,0 +1,112 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* Keystream buffers of this size stay comfortably in L1. */
+#define RAS_CIPHER_BLOCK_SIZE 0x1000
+/* Keystreams switch from the recurrence to a table once they get this far,
+ * as past it the table pays for itself even for sequential use.
+ */
+#define RAS_KEYSTREAM_TABLE_THRESHOLD 0x10000
+
+typedef struct _RasKeystreamTable RasKeystreamTable;
+
+/* Implementations of ras_cipher_decrypt(), from the slowest. The best one the
+ * CPU supports is used.
+ */
+typedef enum
+{
+    RAS_CIPHER_KERNEL_SCALAR,
+    RAS_CIPHER_KERNEL_SSE2,
+    RAS_CIPHER_KERNEL_AVX2,
+    RAS_CIPHER_N_KERNELS,
+} RasCipherKernel;
+
+typedef struct
+{
+    int32_t initial_seed;
+    int32_t seed;
+    uint64_t position;
+
+    /* Set once the keystream has been seeked or used for a large amount of
+     * data; shared between keystreams with the same seed.
+     */
+    RasKeystreamTable *table;
+} RasKeystream;
+
+void ras_keystream_init     (RasKeystream  *keystream,
+                             int32_t        seed);
+void ras_keystream_clear    (RasKeystream  *keystream);
+
+void ras_keystream_seek     (RasKeystream  *keystream,
+                             uint64_t       position);
+void ras_keystream_generate (RasKeystream  *keystream,
+                             uint8_t       *output,
+                             size_t         length);
+
+/**
+ * ras_cipher_decrypt:
+ * @input: the data to decrypt
+ * @output: (out): where to store the decrypted data, may be @input
+ * @length: number of bytes to decrypt
+ * @position: offset of @input from the start of the table
+ * @keystream: keystream bytes for @input
+ */
+void ras_cipher_decrypt     (const uint8_t *input,
+                             uint8_t       *output,
+                             size_t         length,
+                             uint64_t       position,
+                             const uint8_t *keystream);
+
+bool ras_cipher_kernel_is_supported (RasCipherKernel  kernel);
+/* Like ras_cipher_decrypt(), but with a specific kernel, which has to be
+ * supported, so that kernels can be checked against each other.
+ */
+void ras_cipher_decrypt_with_kernel (RasCipherKernel  kernel,
+                                     const uint8_t   *input,
+                                     uint8_t         *output,
+                                     size_t           length,
+                                     uint64_t         position,
+                                     const uint8_t   *keystream);
+
+/**
+ * ras_cipher_encrypt:
+ * @input: the data to encrypt
+ * @output: (out): where to store the encrypted data, may be @input
+ * @length: number of bytes to encrypt
+ * @position: offset of @input from the start of the table
+ * @keystream: keystream bytes for @input
+ *
+ * The inverse of ras_cipher_decrypt().
+ */
+void ras_cipher_encrypt     (const uint8_t *input,
+                             uint8_t       *output,
+                             size_t         length,
+                             uint64_t       position,
+                             const uint8_t *keystream);
+
+G_END_DECLS
@@ -20,6 +20,9 @@
 
 #include "ras-file.h"
 
+#include <iso646.h>
+#include <string.h>
+
 struct _RasDirectory
 {
     GObject parent_instance;
@@ -27,7 +30,12 @@ struct _RasDirectory
     char *name;
     GDateTime *creation_date_time;
 
-    GList *files;
+    /* In table order. */
+    GPtrArray *files;
+
+    /* Not referenced, the archive owns all directories. */
+    RasDirectory *parent;
+    GPtrArray *children;
 };
 
 G_DEFINE_TYPE (RasDirectory, ras_directory, G_TYPE_OBJECT)
@@ -41,6 +49,8 @@ finalize (GObject *object)
 
     g_clear_pointer (&directory->name, g_free);
     g_clear_pointer (&directory->creation_date_time, g_date_time_unref);
+    g_clear_pointer (&directory->files, g_ptr_array_unref);
+    g_clear_pointer (&directory->children, g_ptr_array_unref);
 
     G_OBJECT_CLASS (ras_directory_parent_class)->finalize (object);
 }
@@ -58,7 +68,9 @@ ras_directory_class_init (RasDirectoryClass *klass)
 static void
 ras_directory_init (RasDirectory *self)
 {
-    self->files = NULL;
+    self->files = g_ptr_array_new ();
+    self->parent = NULL;
+    self->children = g_ptr_array_new ();
 }
 
 void
@@ -68,15 +80,97 @@ ras_directory_add_file (RasDirectory *self,
     g_return_if_fail (RAS_IS_DIRECTORY (self));
     g_return_if_fail (RAS_IS_FILE (file));
 
-    self->files = g_list_prepend (self->files, file);
+    g_ptr_array_add (self->files, file);
+}
+
+void
+ras_directory_add_child (RasDirectory *self,
+                         RasDirectory *child)
+{
+    g_return_if_fail (RAS_IS_DIRECTORY (self));
+    g_return_if_fail (RAS_IS_DIRECTORY (child));
+    g_return_if_fail (NULL == child->parent);
+
+    child->parent = self;
+
+    g_ptr_array_add (self->children, child);
+}
+
+RasDirectory *
+ras_directory_get_child (RasDirectory *self,
+                         size_t        index)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
+
+    if (index >= self->children->len)
+    {
+        return NULL;
+    }
+
+    return g_ptr_array_index (self->children, index);
+}
+
+size_t
+ras_directory_get_child_count (RasDirectory *self)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), 0);
+
+    return self->children->len;
+}
+
+RasDirectory *
+ras_directory_get_parent (RasDirectory *self)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
+
+    return self->parent;
+}
+
+GDateTime *
+ras_directory_get_creation_date_time (RasDirectory *self)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
+
+    return self->creation_date_time;
+}
+
+RasFile *
+ras_directory_get_file (RasDirectory *self,
+                        size_t        index)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
+
+    if (index >= self->files->len)
+    {
+        return NULL;
+    }
+
+    return g_ptr_array_index (self->files, index);
+}
+
+size_t
+ras_directory_get_file_count (RasDirectory *self)
+{
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), 0);
+
+    return self->files->len;
 }
 
 GList *
 ras_directory_get_files (RasDirectory *self)
 {
+    GList *files;
+
     g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
 
-    return g_list_copy (self->files);
+    files = NULL;
+
+    for (size_t i = self->files->len; i > 0; i--)
+    {
+        files = g_list_prepend (files, g_ptr_array_index (self->files, i - 1));
+    }
+
+    return files;
 }
 
 char *
@@ -88,22 +182,41 @@ ras_directory_get_name (RasDirectory *self,
     if (replace_backslashes)
     {
         const char *name;
-        g_autoptr (GRegex) regex = NULL;
 
         name = self->name;
         if (g_str_has_prefix (name, "\\"))
         {
             name++;
         }
-        regex = g_regex_new ("\\\\", 0, 0, NULL);
-
 
-        return g_regex_replace_literal (regex, name, -1, 0, "/", 0, NULL);
+        return g_strdelimit (g_strdup (name), "\\", '/');
     }
 
     return g_strdup (self->name);
 }
 
+char *
+ras_directory_get_basename (RasDirectory *self)
+{
+    const char *end;
+    const char *start;
+
+    g_return_val_if_fail (RAS_IS_DIRECTORY (self), NULL);
+
+    end = self->name + strlen (self->name);
+    while (end > self->name && '\\' == end[-1])
+    {
+        end--;
+    }
+    start = end;
+    while (start > self->name && '\\' not_eq start[-1])
+    {
+        start--;
+    }
+
+    return g_strndup (start, end - start);
+}
+
 bool
 ras_directory_is_root (RasDirectory *self)
 {
@@ -123,6 +236,10 @@ ras_directory_new (const char *name,
     directory = g_object_new (RAS_TYPE_DIRECTORY, NULL);
 
     directory->name = g_strdup (name);
+    if (NULL != creation_date_time)
+    {
+        directory->creation_date_time = g_date_time_ref (creation_date_time);
+    }
 
     return directory;
 }
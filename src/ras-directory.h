@@ -21,6 +21,7 @@
 #include "ras-types.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include <glib-object.h>
 
@@ -28,15 +29,28 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (RasDirectory, ras_directory, RAS, DIRECTORY, GObject)
 
-void          ras_directory_add_file  (RasDirectory *directory,
-                                       RasFile      *file);
-GList        *ras_directory_get_files (RasDirectory *directory);
-char         *ras_directory_get_name  (RasDirectory *directory,
-                                       bool          replace_backslashes);
-
-bool          ras_directory_is_root   (RasDirectory *directory);
-
-RasDirectory *ras_directory_new       (const char *name,
-                                       GDateTime  *creation_date_time);
+void          ras_directory_add_child              (RasDirectory *directory,
+                                                    RasDirectory *child);
+RasDirectory *ras_directory_get_child              (RasDirectory *directory,
+                                                    size_t        index);
+size_t        ras_directory_get_child_count        (RasDirectory *directory);
+RasDirectory *ras_directory_get_parent             (RasDirectory *directory);
+
+void          ras_directory_add_file               (RasDirectory *directory,
+                                                    RasFile      *file);
+RasFile      *ras_directory_get_file               (RasDirectory *directory,
+                                                    size_t        index);
+size_t        ras_directory_get_file_count         (RasDirectory *directory);
+GList        *ras_directory_get_files              (RasDirectory *directory);
+
+char         *ras_directory_get_basename           (RasDirectory *directory);
+GDateTime    *ras_directory_get_creation_date_time (RasDirectory *directory);
+char         *ras_directory_get_name               (RasDirectory *directory,
+                                                    bool          replace_backslashes);
+
+bool          ras_directory_is_root                (RasDirectory *directory);
+
+RasDirectory *ras_directory_new                    (const char *name,
+                                                    GDateTime  *creation_date_time);
 
 G_END_DECLS
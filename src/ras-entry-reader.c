@@ -0,0 +1,222 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-entry-reader.h"
+
+#include "ras-archive.h"
+#include "ras-stats.h"
+#include "ras-trace.h"
+
+#include <iso646.h>
+#include <string.h>
+
+/* How much of the token stream is read at a time when the archive is not in
+ * memory.
+ */
+#define INPUT_CHUNK_SIZE 0x10000
+
+RasEntryReader *
+ras_entry_reader_new (RasSource  *source,
+                      uint64_t    offset,
+                      size_t      length,
+                      const char *name)
+{
+    RasEntryReader *reader;
+    const uint8_t *data;
+
+    g_return_val_if_fail (NULL != source, NULL);
+    g_return_val_if_fail (NULL != name, NULL);
+
+    reader = g_new0 (RasEntryReader, 1);
+
+    reader->source = ras_source_ref (source);
+    reader->offset = offset;
+    reader->length = length;
+    reader->name = g_strdup (name);
+
+    data = ras_source_get_data (source);
+    if (NULL != data)
+    {
+        ras_lzss_decoder_init (&reader->decoder, data + offset, length);
+    }
+    else
+    {
+        reader->input = g_malloc (INPUT_CHUNK_SIZE);
+
+        ras_lzss_decoder_init (&reader->decoder, reader->input, 0);
+    }
+
+    return reader;
+}
+
+void
+ras_entry_reader_free (RasEntryReader *reader)
+{
+    g_return_if_fail (NULL != reader);
+
+    g_clear_pointer (&reader->source, ras_source_unref);
+    g_free (reader->name);
+    g_free (reader->input);
+    g_free (reader);
+}
+
+size_t
+ras_entry_reader_get_input_position (RasEntryReader *reader)
+{
+    g_return_val_if_fail (NULL != reader, 0);
+
+    return reader->input_position + reader->decoder.input_offset;
+}
+
+void
+ras_entry_reader_restore (RasEntryReader       *reader,
+                          const RasLzssDecoder *decoder,
+                          size_t                input_position)
+{
+    g_return_if_fail (NULL != reader);
+    g_return_if_fail (NULL != decoder);
+
+    reader->decoder = *decoder;
+
+    /* The input of the copy is long gone, so the next decode reads it
+     * again.
+     */
+    if (NULL != reader->input)
+    {
+        reader->input_position = input_position;
+
+        ras_lzss_decoder_set_input (&reader->decoder, reader->input, 0);
+    }
+}
+
+bool
+ras_entry_reader_is_finished (RasEntryReader *reader)
+{
+    g_return_val_if_fail (NULL != reader, false);
+
+    return ras_entry_reader_get_input_position (reader) == reader->length
+        && 0 == reader->decoder.match_remaining;
+}
+
+/* Moves the unconsumed input to the front and reads more after it. */
+static bool
+refill (RasEntryReader  *reader,
+        GCancellable    *cancellable,
+        GError         **error)
+{
+    size_t consumed;
+    size_t remaining;
+    size_t available;
+    size_t length;
+
+    consumed = reader->decoder.input_offset;
+    remaining = reader->decoder.input_length - consumed;
+    available = reader->length - reader->input_position - consumed - remaining;
+
+    /* The last token needs more input than the entry has left. */
+    if (NULL == reader->input || 0 == available)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                     "Truncated compressed entry %s", reader->name);
+
+        return false;
+    }
+
+    reader->input_position += consumed;
+
+    memmove (reader->input, reader->input + consumed, remaining);
+
+    length = MIN (INPUT_CHUNK_SIZE - remaining, available);
+
+    if (!ras_source_read (reader->source,
+                          reader->offset + reader->input_position + remaining,
+                          reader->input + remaining, length,
+                          cancellable, error))
+    {
+        return false;
+    }
+
+    ras_lzss_decoder_set_input (&reader->decoder, reader->input, remaining + length);
+
+    return true;
+}
+
+bool
+ras_entry_reader_decode (RasEntryReader  *reader,
+                         uint8_t         *output,
+                         size_t           length,
+                         size_t          *bytes_written,
+                         GCancellable    *cancellable,
+                         GError         **error)
+{
+    g_return_val_if_fail (NULL != reader, false);
+    g_return_val_if_fail (NULL != output || 0 == length, false);
+    g_return_val_if_fail (NULL != bytes_written, false);
+
+    for (;;)
+    {
+        RasDecodeMark mark;
+        uint64_t span;
+
+        ras_stats_mark (&mark, &reader->decoder);
+        span = ras_trace_begin ();
+
+        ras_lzss_decoder_decode (&reader->decoder, output, length, bytes_written);
+
+        ras_trace_end (span, "decode", reader->name);
+        ras_stats_add_decode (ras_source_get_stats (reader->source), &mark, &reader->decoder);
+
+        if (*bytes_written > 0 || 0 == length || ras_entry_reader_is_finished (reader))
+        {
+            return true;
+        }
+
+        if (!refill (reader, cancellable, error))
+        {
+            return false;
+        }
+    }
+}
+
+bool
+ras_entry_reader_check_size (RasEntryReader  *reader,
+                             uint64_t         size,
+                             GError         **error)
+{
+    g_return_val_if_fail (NULL != reader, false);
+
+    if (reader->decoder.output_offset < size)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                     "Truncated compressed entry %s", reader->name);
+
+        return false;
+    }
+    if (!ras_entry_reader_is_finished (reader))
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Compressed entry %s is larger than its declared size", reader->name);
+
+        return false;
+    }
+
+    return true;
+}
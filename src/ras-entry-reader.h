@@ -0,0 +1,85 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-lzss.h"
+#include "ras-source.h"
+
+#include <gio/gio.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* Feeds the token stream of a compressed entry to a decoder, from memory if
+ * the archive is there and a chunk at a time otherwise, so that memory use
+ * does not grow with the entry.
+ */
+typedef struct
+{
+    RasSource *source;
+    /* Of the token stream in the source. */
+    uint64_t offset;
+    size_t length;
+    /* For errors and traces. */
+    char *name;
+
+    RasLzssDecoder decoder;
+    /* Part of the token stream starting at input_position, unless the
+     * archive is in memory.
+     */
+    uint8_t *input;
+    size_t input_position;
+} RasEntryReader;
+
+RasEntryReader *ras_entry_reader_new                (RasSource             *source,
+                                                     uint64_t               offset,
+                                                     size_t                 length,
+                                                     const char            *name);
+void            ras_entry_reader_free               (RasEntryReader        *reader);
+
+/* Where the decoder is in the token stream. */
+size_t          ras_entry_reader_get_input_position (RasEntryReader        *reader);
+/* Resumes from a copy of the decoder taken at @input_position. */
+void            ras_entry_reader_restore            (RasEntryReader        *reader,
+                                                     const RasLzssDecoder  *decoder,
+                                                     size_t                 input_position);
+
+bool            ras_entry_reader_is_finished        (RasEntryReader        *reader);
+/* Decodes up to @length bytes, reading more input as needed. Writes nothing
+ * only once the tokens are finished.
+ */
+bool            ras_entry_reader_decode             (RasEntryReader        *reader,
+                                                     uint8_t               *output,
+                                                     size_t                 length,
+                                                     size_t                *bytes_written,
+                                                     GCancellable          *cancellable,
+                                                     GError               **error);
+/* Checks an entry once @size bytes have been decoded or the tokens have run
+ * out, whichever came first.
+ */
+bool            ras_entry_reader_check_size         (RasEntryReader        *reader,
+                                                     uint64_t               size,
+                                                     GError               **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RasEntryReader, ras_entry_reader_free)
+
+G_END_DECLS
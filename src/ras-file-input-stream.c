@@ -0,0 +1,387 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-file-input-stream.h"
+
+#include "ras-archive.h"
+#include "ras-lzss.h"
+#include "ras-stats.h"
+
+#include <iso646.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Output between checkpoints, doubled whenever MAX_CHECKPOINTS is reached. */
+#define CHECKPOINT_INTERVAL 0x10000
+#define MAX_CHECKPOINTS 32
+#define SKIP_BUFFER_SIZE 0x1000
+
+typedef struct
+{
+    size_t input_position;
+    RasLzssDecoder decoder;
+} RasCheckpoint;
+
+struct _RasFileInputStream
+{
+    GFileInputStream parent_instance;
+
+    RasSource *source;
+    /* Of the file data of stored files. */
+    uint64_t offset;
+    size_t size;
+    size_t position;
+
+    /* Only for compressed files. */
+    RasEntryReader *reader;
+    /* Checkpoint i is at i * checkpoint_interval bytes of output. */
+    GArray *checkpoints;
+    size_t checkpoint_interval;
+    uint8_t *skip_buffer;
+};
+
+G_DEFINE_TYPE (RasFileInputStream, ras_file_input_stream, G_TYPE_FILE_INPUT_STREAM)
+
+static void
+ras_file_input_stream_finalize (GObject *object)
+{
+    RasFileInputStream *self;
+
+    self = RAS_FILE_INPUT_STREAM (object);
+
+    g_clear_pointer (&self->source, ras_source_unref);
+    g_clear_pointer (&self->reader, ras_entry_reader_free);
+    g_clear_pointer (&self->checkpoints, g_array_unref);
+    g_clear_pointer (&self->skip_buffer, g_free);
+
+    G_OBJECT_CLASS (ras_file_input_stream_parent_class)->finalize (object);
+}
+
+static void
+add_checkpoint (RasFileInputStream *self)
+{
+    RasCheckpoint *checkpoint;
+
+    if (self->reader->decoder.output_offset not_eq self->checkpoints->len * self->checkpoint_interval)
+    {
+        return;
+    }
+
+    g_array_set_size (self->checkpoints, self->checkpoints->len + 1);
+
+    checkpoint = &g_array_index (self->checkpoints, RasCheckpoint, self->checkpoints->len - 1);
+    checkpoint->input_position = ras_entry_reader_get_input_position (self->reader);
+    checkpoint->decoder = self->reader->decoder;
+
+    if (self->checkpoints->len < MAX_CHECKPOINTS)
+    {
+        return;
+    }
+
+    /* Keep the even ones, which are at multiples of the new interval. */
+    for (unsigned int i = 1; 2 * i < self->checkpoints->len; i++)
+    {
+        g_array_index (self->checkpoints, RasCheckpoint, i) =
+            g_array_index (self->checkpoints, RasCheckpoint, 2 * i);
+    }
+
+    g_array_set_size (self->checkpoints, (self->checkpoints->len + 1) / 2);
+
+    self->checkpoint_interval *= 2;
+}
+
+static void
+restore_checkpoint (RasFileInputStream *self,
+                    size_t              index)
+{
+    RasCheckpoint *checkpoint;
+
+    checkpoint = &g_array_index (self->checkpoints, RasCheckpoint, index);
+
+    ras_entry_reader_restore (self->reader, &checkpoint->decoder, checkpoint->input_position);
+}
+
+/* Decodes at least one byte, stopping at the next checkpoint. */
+static gssize
+decode (RasFileInputStream  *self,
+        uint8_t             *output,
+        size_t               length,
+        GCancellable        *cancellable,
+        GError             **error)
+{
+    RasLzssDecoder *decoder;
+    uint64_t next_checkpoint;
+    size_t bytes_written;
+
+    decoder = &self->reader->decoder;
+    next_checkpoint = self->checkpoints->len * self->checkpoint_interval;
+    if (next_checkpoint > decoder->output_offset)
+    {
+        length = MIN (length, next_checkpoint - decoder->output_offset);
+    }
+
+    if (!ras_entry_reader_decode (self->reader, output, length, &bytes_written,
+                                  cancellable, error))
+    {
+        return -1;
+    }
+    /* The tokens ran out before the end of the file. */
+    if (0 == bytes_written)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                     "Truncated compressed entry %s", self->reader->name);
+
+        return -1;
+    }
+
+    ras_stats_add (ras_source_get_stats (self->source), RAS_STAT_COMPRESSED_BYTES, bytes_written);
+
+    add_checkpoint (self);
+
+    return bytes_written;
+}
+
+/* Brings the decoder to the stream position. */
+static bool
+seek_decoder (RasFileInputStream  *self,
+              GCancellable        *cancellable,
+              GError             **error)
+{
+    size_t index;
+
+    index = MIN (self->position / self->checkpoint_interval, self->checkpoints->len - 1);
+
+    if (self->reader->decoder.output_offset > self->position
+        || index * self->checkpoint_interval > self->reader->decoder.output_offset)
+    {
+        restore_checkpoint (self, index);
+    }
+
+    while (self->reader->decoder.output_offset < self->position)
+    {
+        gssize length;
+
+        if (NULL == self->skip_buffer)
+        {
+            self->skip_buffer = g_malloc (SKIP_BUFFER_SIZE);
+        }
+
+        length = decode (self, self->skip_buffer,
+                         MIN (self->position - self->reader->decoder.output_offset, SKIP_BUFFER_SIZE),
+                         cancellable, error);
+        if (length < 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static gssize
+ras_file_input_stream_read (GInputStream  *stream,
+                            void          *buffer,
+                            gsize          count,
+                            GCancellable  *cancellable,
+                            GError       **error)
+{
+    RasFileInputStream *self;
+    gssize length;
+
+    self = RAS_FILE_INPUT_STREAM (stream);
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        return -1;
+    }
+
+    count = MIN (count, self->size - self->position);
+    count = MIN (count, G_MAXSSIZE);
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    if (NULL == self->reader)
+    {
+        if (!ras_source_read (self->source, self->offset + self->position, buffer, count,
+                              cancellable, error))
+        {
+            return -1;
+        }
+
+        ras_stats_add (ras_source_get_stats (self->source), RAS_STAT_STORED_BYTES, count);
+
+        length = count;
+    }
+    else
+    {
+        if (!seek_decoder (self, cancellable, error))
+        {
+            return -1;
+        }
+
+        length = decode (self, buffer, count, cancellable, error);
+        if (length < 0)
+        {
+            return -1;
+        }
+    }
+
+    self->position += length;
+
+    return length;
+}
+
+static goffset
+ras_file_input_stream_tell (GFileInputStream *stream)
+{
+    return RAS_FILE_INPUT_STREAM (stream)->position;
+}
+
+static gboolean
+ras_file_input_stream_can_seek (GFileInputStream *stream)
+{
+    (void) stream;
+
+    return true;
+}
+
+static gboolean
+ras_file_input_stream_seek (GFileInputStream  *stream,
+                            goffset            offset,
+                            GSeekType          type,
+                            GCancellable      *cancellable,
+                            GError           **error)
+{
+    RasFileInputStream *self;
+    goffset size;
+    goffset position;
+
+    self = RAS_FILE_INPUT_STREAM (stream);
+    size = self->size;
+
+    (void) cancellable;
+
+    switch (type)
+    {
+        case G_SEEK_CUR:
+            position = self->position;
+            break;
+
+        case G_SEEK_SET:
+            position = 0;
+            break;
+
+        case G_SEEK_END:
+            position = size;
+            break;
+
+        default:
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                 "Invalid seek type");
+
+            return false;
+    }
+
+    if ((offset < 0 && -offset > position) || (offset > 0 && offset > size - position))
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                             "Seeking outside of the file");
+
+        return false;
+    }
+
+    /* Compressed data is decoded up to the new position on the next read. */
+    self->position = position + offset;
+
+    return true;
+}
+
+static void
+ras_file_input_stream_class_init (RasFileInputStreamClass *klass)
+{
+    GObjectClass *object_class;
+    GInputStreamClass *input_stream_class;
+    GFileInputStreamClass *file_input_stream_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    input_stream_class = G_INPUT_STREAM_CLASS (klass);
+    file_input_stream_class = G_FILE_INPUT_STREAM_CLASS (klass);
+
+    object_class->finalize = ras_file_input_stream_finalize;
+
+    /* Skipping falls back to seeking. */
+    input_stream_class->read_fn = ras_file_input_stream_read;
+
+    file_input_stream_class->tell = ras_file_input_stream_tell;
+    file_input_stream_class->can_seek = ras_file_input_stream_can_seek;
+    file_input_stream_class->seek = ras_file_input_stream_seek;
+}
+
+static void
+ras_file_input_stream_init (RasFileInputStream *self)
+{
+    self->source = NULL;
+    self->offset = 0;
+    self->size = 0;
+    self->position = 0;
+    self->reader = NULL;
+    self->checkpoints = NULL;
+    self->checkpoint_interval = CHECKPOINT_INTERVAL;
+    self->skip_buffer = NULL;
+}
+
+GFileInputStream *
+ras_file_input_stream_new_stored (RasSource *source,
+                                  uint64_t   offset,
+                                  size_t     size)
+{
+    RasFileInputStream *stream;
+
+    g_return_val_if_fail (NULL != source, NULL);
+
+    stream = g_object_new (RAS_TYPE_FILE_INPUT_STREAM, NULL);
+
+    stream->source = ras_source_ref (source);
+    stream->offset = offset;
+    stream->size = size;
+
+    return G_FILE_INPUT_STREAM (stream);
+}
+
+GFileInputStream *
+ras_file_input_stream_new_compressed (RasEntryReader *reader,
+                                      size_t          size)
+{
+    RasFileInputStream *stream;
+
+    g_return_val_if_fail (NULL != reader, NULL);
+
+    stream = g_object_new (RAS_TYPE_FILE_INPUT_STREAM, NULL);
+
+    stream->source = ras_source_ref (reader->source);
+    stream->size = size;
+    stream->reader = reader;
+    stream->checkpoints = g_array_sized_new (false, false, sizeof (RasCheckpoint), MAX_CHECKPOINTS);
+
+    add_checkpoint (stream);
+
+    return G_FILE_INPUT_STREAM (stream);
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-entry-reader.h"
+#include "ras-source.h"
+#include "ras-types.h"
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+G_DECLARE_FINAL_TYPE (RasFileInputStream, ras_file_input_stream,
+                      RAS, FILE_INPUT_STREAM, GFileInputStream)
+
+/**
+ * ras_file_input_stream_new_stored:
+ * @source: the archive
+ * @offset: offset of the file data in @source
+ * @size: size of the file
+ *
+ * Creates a seekable stream for a stored file, which reads straight from
+ * @source.
+ */
+GFileInputStream *ras_file_input_stream_new_stored     (RasSource *source,
+                                                        uint64_t   offset,
+                                                        size_t     size);
+/**
+ * ras_file_input_stream_new_compressed:
+ * @reader: (transfer full): the token stream of the file
+ * @size: size of the decompressed file
+ *
+ * Creates a seekable stream for a compressed file, which is decoded as it is
+ * read. Seeking backwards resumes decoding from the nearest of a bounded
+ * number of checkpoints.
+ */
+GFileInputStream *ras_file_input_stream_new_compressed (RasEntryReader *reader,
+                                                        size_t          size);
+
+G_END_DECLS
@@ -16,12 +16,41 @@
  * along with libras.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "ras-buffer.h"
+#define _GNU_SOURCE
+
 #include "ras-file.h"
 
+#include "ras-archive.h"
+#include "ras-entry-reader.h"
+#include "ras-file-input-stream.h"
+#include "ras-lzss.h"
+#include "ras-stats.h"
+#include "ras-trace.h"
+#include "ras-utils.h"
+
+#include <iso646.h>
 #include <string.h>
 
-#define CMPHEADER "RA->"
+#ifdef HAVE_GIO_UNIX
+#include <gio/gfiledescriptorbased.h>
+#include <gio/gunixoutputstream.h>
+#endif
+#if defined (HAVE_GIO_UNIX) && defined (__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* fallocate() is specific to Linux. */
+#define HAVE_MAPPED_EXTRACTION
+#endif
+
+#define EXTRACT_BLOCK_SIZE 0x10000
+/* Compressed entries at least this large are decoded straight into the
+ * output file, if it can be mapped.
+ */
+#define EXTRACT_MAP_MIN_SIZE 0x100000
 
 struct _RasFile
 {
@@ -36,7 +65,8 @@ struct _RasFile
     uint32_t compression_method;
     GDateTime *creation_date_time;
 
-    const uint8_t *data;
+    RasSource *source;
+    uint64_t offset;
 };
 
 G_DEFINE_TYPE (RasFile, ras_file, G_TYPE_OBJECT)
@@ -50,6 +80,7 @@ finalize (GObject *object)
 
     g_clear_pointer (&file->name, g_free);
     g_clear_pointer (&file->creation_date_time, g_date_time_unref);
+    g_clear_pointer (&file->source, ras_source_unref);
 
     G_OBJECT_CLASS (ras_file_parent_class)->finalize (object);
 }
@@ -78,6 +109,22 @@ ras_file_get_compression_method (RasFile *self)
     return self->compression_method;
 }
 
+GDateTime *
+ras_file_get_creation_date_time (RasFile *self)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), NULL);
+
+    return self->creation_date_time;
+}
+
+uint32_t
+ras_file_get_entry_size (RasFile *self)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), 0);
+
+    return self->entry_size;
+}
+
 char *
 ras_file_get_name (RasFile *self)
 {
@@ -86,21 +133,120 @@ ras_file_get_name (RasFile *self)
     return g_strdup (self->name);
 }
 
+uint32_t
+ras_file_get_size (RasFile *self)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), 0);
+
+    return self->size;
+}
+
+uint32_t
+ras_file_get_directory_index (RasFile *self)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), 0);
+
+    return self->parent_directory_index;
+}
+
+static bool
+check_bounds (RasFile  *self,
+              GError  **error)
+{
+    uint64_t size;
+
+    size = ras_source_get_size (self->source);
+
+    /* Otherwise, reads will fail instead. */
+    if (RAS_SOURCE_SIZE_UNKNOWN == size)
+    {
+        return true;
+    }
+
+    if (self->offset > size || size - self->offset < self->entry_size)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                     "Entry %s extends past the end of the archive", self->name);
+
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+check_compressed_header (RasFile        *self,
+                         const uint8_t  *data,
+                         GError        **error)
+{
+    if (self->entry_size < RAS_LZSS_HEADER_LENGTH
+        || memcmp (data, RAS_LZSS_HEADER, strlen (RAS_LZSS_HEADER)) not_eq 0)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Malformed compressed entry %s", self->name);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Reads and checks what comes before the tokens of a compressed entry. */
+static bool
+read_compressed_header (RasFile        *self,
+                        uint8_t        *header,
+                        GCancellable   *cancellable,
+                        GError        **error)
+{
+    if (self->entry_size >= RAS_LZSS_HEADER_LENGTH
+        && !ras_source_read (self->source, self->offset, header, RAS_LZSS_HEADER_LENGTH,
+                             cancellable, error))
+    {
+        return false;
+    }
+
+    return check_compressed_header (self, header, error);
+}
+
+static RasEntryReader *
+entry_reader_new (RasFile       *self,
+                  GCancellable  *cancellable,
+                  GError       **error)
+{
+    uint8_t header[RAS_LZSS_HEADER_LENGTH];
+
+    if (!read_compressed_header (self, header, cancellable, error))
+    {
+        return NULL;
+    }
+
+    return ras_entry_reader_new (self->source,
+                                 self->offset + RAS_LZSS_HEADER_LENGTH,
+                                 self->entry_size - RAS_LZSS_HEADER_LENGTH,
+                                 self->name);
+}
+
+/* Streams count their entry when opened and the bytes as they are read. */
 static void
-ras_file_write_out_decompression_buffer (RasBuffer *buffer,
-                                         gpointer   user_data)
+count_decoded (RasFile  *self,
+               uint64_t  n_entries,
+               uint64_t  n_bytes)
 {
-    GOutputStream *stream;
-    uint16_t length;
-    const uint8_t *data;
-    g_autoptr (GError) error = NULL;
+    RasStats *stats;
 
-    stream = G_OUTPUT_STREAM (user_data);
-    data = ras_buffer_get_data (buffer, &length);
+    stats = ras_source_get_stats (self->source);
 
-    if (!g_output_stream_write_all (stream, data, length, NULL, NULL, &error))
+    if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
     {
-        g_message ("Error: %s", error->message);
+        ras_stats_add (stats, RAS_STAT_STORED_ENTRIES, n_entries);
+        ras_stats_add (stats, RAS_STAT_STORED_BYTES, n_bytes);
+    }
+    else
+    {
+        ras_stats_add (stats, RAS_STAT_COMPRESSED_ENTRIES, n_entries);
+        ras_stats_add (stats, RAS_STAT_COMPRESSED_BYTES, n_bytes);
     }
 }
 
@@ -110,50 +256,714 @@ decompress (RasFile        *self,
             GCancellable   *cancellable,
             GError        **error)
 {
-    g_autoptr (RasBuffer) buffer = NULL;
+    g_autoptr (RasEntryReader) reader = NULL;
+    g_autofree uint8_t *buffer = NULL;
+
+    reader = entry_reader_new (self, cancellable, error);
+    if (NULL == reader)
+    {
+        return false;
+    }
 
-    g_return_val_if_fail (memcmp (self->data, CMPHEADER, strlen (CMPHEADER)) == 0, false);
+    buffer = g_malloc (EXTRACT_BLOCK_SIZE);
 
-    buffer = ras_buffer_new ();
+    while (reader->decoder.output_offset < self->size)
+    {
+        size_t length;
+        uint64_t span;
 
-    g_signal_connect (buffer, "filled",
-                      G_CALLBACK (ras_file_write_out_decompression_buffer),
-                      stream);
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return false;
+        }
 
-    for (const uint8_t *s = self->data + 12; self->data + self->entry_size > s; )
+        if (!ras_entry_reader_decode (reader, buffer,
+                                      MIN (self->size - reader->decoder.output_offset, EXTRACT_BLOCK_SIZE),
+                                      &length, cancellable, error))
+        {
+            return false;
+        }
+        if (0 == length)
+        {
+            break;
+        }
+
+        span = ras_trace_begin ();
+
+        if (!g_output_stream_write_all (stream, buffer, length, NULL, cancellable, error))
+        {
+            return false;
+        }
+
+        ras_trace_end (span, "write", NULL);
+    }
+
+    if (!ras_entry_reader_check_size (reader, self->size, error))
     {
-        uint8_t byte;
+        return false;
+    }
 
-        byte = *(s++);
+    count_decoded (self, 1, reader->decoder.output_offset);
+
+    return true;
+}
+
+#ifdef HAVE_GIO_UNIX
+/* Returns -1 if @stream does not write to a file descriptor directly. */
+static int
+get_output_fd (GOutputStream *stream)
+{
+    if (G_IS_FILE_DESCRIPTOR_BASED (stream))
+    {
+        return g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (stream));
+    }
+    if (G_IS_UNIX_OUTPUT_STREAM (stream))
+    {
+        return g_unix_output_stream_get_fd (G_UNIX_OUTPUT_STREAM (stream));
+    }
 
-        for (int i = 0; i < 8 && self->data + self->entry_size > s; i++)
+    return -1;
+}
+#endif
+
+#ifdef HAVE_MAPPED_EXTRACTION
+static bool
+decode_mapped (RasFile        *self,
+               uint8_t        *output,
+               GCancellable   *cancellable,
+               GError        **error)
+{
+    g_autoptr (RasEntryReader) reader = NULL;
+    RasLzssDecoder *decoder;
+
+    reader = entry_reader_new (self, cancellable, error);
+    if (NULL == reader)
+    {
+        return false;
+    }
+    decoder = &reader->decoder;
+
+    while (decoder->output_offset < self->size)
+    {
+        size_t length;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
         {
-            if (byte & (1 << i))
-            {
-                ras_buffer_push_literal (buffer, *s);
+            return false;
+        }
 
-                s += 1;
-            }
-            else
-            {
-                uint16_t pointer;
-                uint8_t length;
+        if (!ras_entry_reader_decode (reader,
+                                      output + decoder->output_offset,
+                                      MIN (self->size - decoder->output_offset, EXTRACT_BLOCK_SIZE),
+                                      &length, cancellable, error))
+        {
+            return false;
+        }
+        if (0 == length)
+        {
+            break;
+        }
+    }
+
+    if (!ras_entry_reader_check_size (reader, self->size, error))
+    {
+        return false;
+    }
+
+    count_decoded (self, 1, decoder->output_offset);
+    ras_stats_add (ras_source_get_stats (self->source), RAS_STAT_MAPPED_ENTRIES, 1);
+
+    return true;
+}
+
+/* Fails with %G_IO_ERROR_NOT_SUPPORTED, having written nothing that a write
+ * from the start of the file would not replace, if @fd is not a regular file
+ * that can be preallocated and mapped.
+ */
+static bool
+extract_mapped (RasFile        *self,
+                int             fd,
+                GCancellable   *cancellable,
+                GError        **error)
+{
+    struct stat st;
+    uint8_t *output;
+    bool success;
+
+    if (-1 == fstat (fd, &st) || !S_ISREG (st.st_mode) || 0 not_eq lseek (fd, 0, SEEK_CUR))
+    {
+        g_set_error_literal (error,
+                             G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Output is not a regular file");
+
+        return false;
+    }
+
+    if (-1 == fallocate (fd, 0, 0, self->size))
+    {
+        int errsv;
+
+        errsv = errno;
+
+        g_set_error (error,
+                     G_IO_ERROR,
+                     (EOPNOTSUPP == errsv || ENOSYS == errsv)? G_IO_ERROR_NOT_SUPPORTED
+                                                             : g_io_error_from_errno (errsv),
+                     "Failed to allocate output: %s", g_strerror (errsv));
+
+        return false;
+    }
+
+    output = mmap (NULL, self->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == output)
+    {
+        int errsv;
+
+        errsv = errno;
+
+        g_set_error (error,
+                     G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                     "Failed to map output: %s", g_strerror (errsv));
+
+        return false;
+    }
+
+    success = decode_mapped (self, output, cancellable, error);
+
+    munmap (output, self->size);
+
+    /* Leave the stream where writing the entry would have. */
+    if (success && -1 == lseek (fd, self->size, SEEK_SET))
+    {
+        int errsv;
+
+        errsv = errno;
+
+        g_set_error (error,
+                     G_IO_ERROR, g_io_error_from_errno (errsv),
+                     "Failed to seek output: %s", g_strerror (errsv));
+
+        return false;
+    }
+
+    return success;
+}
+#endif
+
+bool
+ras_file_decode_into (RasFile  *self,
+                      uint8_t  *destination,
+                      size_t    length,
+                      GError  **error)
+{
+    g_autoptr (RasEntryReader) reader = NULL;
+    size_t bytes_written;
+
+    g_return_val_if_fail (RAS_IS_FILE (self), false);
+    g_return_val_if_fail (NULL != destination || 0 == self->size, false);
+    g_return_val_if_fail (length >= self->size, false);
+
+    if (!check_bounds (self, error))
+    {
+        return false;
+    }
+
+    if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
+    {
+        if (self->entry_size < self->size)
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated entry %s", self->name);
+
+            return false;
+        }
+
+        if (!ras_source_read (self->source, self->offset, destination, self->size,
+                              NULL, error))
+        {
+            return false;
+        }
+
+        count_decoded (self, 1, self->size);
+
+        return true;
+    }
+    else if (RAS_FILE_COMPRESSION_METHOD_COMPRESS not_eq self->compression_method)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Unsupported compression method %u for entry %s",
+                     self->compression_method, self->name);
 
-                pointer = (*(s + 1) & 0xF0) << 4  | *s;
-                length = (*(s + 1) & 0xF) + 3;
+        return false;
+    }
 
-                ras_buffer_push_pointer (buffer, pointer, length);
+    reader = entry_reader_new (self, NULL, error);
+    if (NULL == reader)
+    {
+        return false;
+    }
 
-                s += 2;
+    while (reader->decoder.output_offset < self->size)
+    {
+        if (!ras_entry_reader_decode (reader,
+                                      destination + reader->decoder.output_offset,
+                                      self->size - reader->decoder.output_offset,
+                                      &bytes_written, NULL, error))
+        {
+            return false;
+        }
+        if (0 == bytes_written)
+        {
+            break;
+        }
+    }
+
+    if (!ras_entry_reader_check_size (reader, self->size, error))
+    {
+        return false;
+    }
+
+    count_decoded (self, 1, self->size);
+
+    return true;
+}
+
+bool
+ras_file_verify (RasFile       *self,
+                 GCancellable  *cancellable,
+                 GError       **error)
+{
+    uint8_t header[RAS_LZSS_HEADER_LENGTH];
+    g_autoptr (RasEntryReader) reader = NULL;
+    uint32_t declared_size;
+    uint32_t token_length;
+    g_autofree uint8_t *buffer = NULL;
+
+    g_return_val_if_fail (RAS_IS_FILE (self), false);
+
+    if (!check_bounds (self, error))
+    {
+        return false;
+    }
+
+    if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
+    {
+        if (self->entry_size < self->size)
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated entry %s", self->name);
+
+            return false;
+        }
+
+        return true;
+    }
+    else if (RAS_FILE_COMPRESSION_METHOD_COMPRESS not_eq self->compression_method)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Unsupported compression method %u for entry %s",
+                     self->compression_method, self->name);
+
+        return false;
+    }
+
+    if (!read_compressed_header (self, header, cancellable, error))
+    {
+        return false;
+    }
+
+    reader = ras_entry_reader_new (self->source,
+                                   self->offset + RAS_LZSS_HEADER_LENGTH,
+                                   self->entry_size - RAS_LZSS_HEADER_LENGTH,
+                                   self->name);
+
+    declared_size = GUINT32_FROM_LE (*(uint32_t *) (header + 4));
+    token_length = GUINT32_FROM_LE (*(uint32_t *) (header + 8));
+
+    if (declared_size not_eq self->size)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Compressed entry %s declares a size of %u bytes instead of %u",
+                     self->name, declared_size, self->size);
+
+        return false;
+    }
+    if (token_length > reader->length)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                     "Tokens of compressed entry %s run past the end of the entry", self->name);
+
+        return false;
+    }
+
+    buffer = g_malloc (EXTRACT_BLOCK_SIZE);
+
+    /* Decoded past the declared size, if it comes to that, to tell how long
+     * the entry really is. Decoding fails if the last token needs more input
+     * than the entry has left.
+     */
+    while (!ras_entry_reader_is_finished (reader))
+    {
+        size_t length;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return false;
+        }
+
+        if (!ras_entry_reader_decode (reader, buffer, EXTRACT_BLOCK_SIZE, &length,
+                                      cancellable, error))
+        {
+            return false;
+        }
+    }
+
+    count_decoded (self, 1, reader->decoder.output_offset);
+
+    if (reader->decoder.output_offset not_eq self->size)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR,
+                     (reader->decoder.output_offset < self->size)? RAS_ERROR_TRUNCATED : RAS_ERROR_MALFORMED,
+                     "Compressed entry %s decodes to %" G_GUINT64_FORMAT " bytes instead of %u",
+                     self->name, reader->decoder.output_offset, self->size);
+
+        return false;
+    }
+
+    return true;
+}
+
+GBytes *
+ras_file_get_bytes (RasFile  *self,
+                    GError  **error)
+{
+    g_autofree uint8_t *buffer = NULL;
+
+    g_return_val_if_fail (RAS_IS_FILE (self), NULL);
+
+    if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
+    {
+        if (!check_bounds (self, error))
+        {
+            return NULL;
+        }
+        if (self->entry_size < self->size)
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated entry %s", self->name);
+
+            return NULL;
+        }
+
+        count_decoded (self, 1, self->size);
+
+        /* A slice of the archive when it is in memory. */
+        return ras_source_get_bytes (self->source, self->offset, self->size,
+                                     NULL, error);
+    }
+
+    buffer = g_malloc (self->size);
+
+    if (!ras_file_decode_into (self, buffer, self->size, error))
+    {
+        return NULL;
+    }
+
+    return g_bytes_new_take (g_steal_pointer (&buffer), self->size);
+}
+
+GFileInputStream *
+ras_file_read (RasFile  *self,
+               GError  **error)
+{
+    RasEntryReader *reader;
+
+    g_return_val_if_fail (RAS_IS_FILE (self), NULL);
+
+    if (!check_bounds (self, error))
+    {
+        return NULL;
+    }
+
+    if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
+    {
+        if (self->entry_size < self->size)
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated entry %s", self->name);
+
+            return NULL;
+        }
+
+        count_decoded (self, 1, 0);
+
+        return ras_file_input_stream_new_stored (self->source, self->offset, self->size);
+    }
+    else if (RAS_FILE_COMPRESSION_METHOD_COMPRESS not_eq self->compression_method)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Unsupported compression method %u for entry %s",
+                     self->compression_method, self->name);
+
+        return NULL;
+    }
+
+    reader = entry_reader_new (self, NULL, error);
+    if (NULL == reader)
+    {
+        return NULL;
+    }
+
+    count_decoded (self, 1, 0);
+
+    return ras_file_input_stream_new_compressed (reader, self->size);
+}
+
+static bool
+copy_stored (RasFile        *self,
+             GOutputStream  *stream,
+             GCancellable   *cancellable,
+             GError        **error)
+{
+    const uint8_t *data;
+    g_autofree uint8_t *buffer = NULL;
+
+    data = ras_source_get_data (self->source);
+    if (NULL == data)
+    {
+        buffer = g_malloc (EXTRACT_BLOCK_SIZE);
+    }
+
+    for (uint32_t offset = 0; offset < self->size; )
+    {
+        const uint8_t *block;
+        size_t length;
+        uint64_t span;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return false;
+        }
+
+        length = MIN (self->size - offset, EXTRACT_BLOCK_SIZE);
+
+        if (NULL != data)
+        {
+            block = data + self->offset + offset;
+        }
+        else
+        {
+            if (!ras_source_read (self->source, self->offset + offset, buffer, length,
+                                  cancellable, error))
+            {
+                return false;
             }
+
+            block = buffer;
+        }
+
+        span = ras_trace_begin ();
+
+        if (!g_output_stream_write_all (stream, block, length, NULL, cancellable, error))
+        {
+            return false;
         }
+
+        ras_trace_end (span, "write", NULL);
+
+        offset += length;
     }
 
-    ras_file_write_out_decompression_buffer (buffer, stream);
+    count_decoded (self, 1, self->size);
 
     return true;
 }
 
+typedef struct
+{
+    GInputStream *input;
+    GOutputStream *output;
+    uint8_t *buffer;
+
+    goffset bytes_done;
+    goffset bytes_total;
+    GFileProgressCallback progress_callback;
+    void *progress_data;
+} RasExtractData;
+
+static void
+extract_data_free (void *data)
+{
+    RasExtractData *extract_data;
+
+    extract_data = data;
+
+    g_clear_object (&extract_data->input);
+    g_clear_object (&extract_data->output);
+    g_free (extract_data->buffer);
+
+    g_free (extract_data);
+}
+
+static void read_next_block (GTask *task);
+
+static void
+on_block_written (GObject      *source_object,
+                  GAsyncResult *result,
+                  void         *user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    RasExtractData *data;
+    size_t bytes_written;
+    GError *error = NULL;
+
+    task = user_data;
+    data = g_task_get_task_data (task);
+
+    if (!g_output_stream_write_all_finish (G_OUTPUT_STREAM (source_object), result,
+                                           &bytes_written, &error))
+    {
+        g_task_return_error (task, error);
+
+        return;
+    }
+
+    data->bytes_done += bytes_written;
+
+    if (NULL != data->progress_callback)
+    {
+        data->progress_callback (data->bytes_done, data->bytes_total, data->progress_data);
+    }
+
+    read_next_block (g_steal_pointer (&task));
+}
+
+static void
+on_block_read (GObject      *source_object,
+               GAsyncResult *result,
+               void         *user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    RasExtractData *data;
+    gssize length;
+    GError *error = NULL;
+
+    task = user_data;
+    data = g_task_get_task_data (task);
+    length = g_input_stream_read_finish (G_INPUT_STREAM (source_object), result, &error);
+
+    if (length < 0)
+    {
+        g_task_return_error (task, error);
+
+        return;
+    }
+    if (0 == length)
+    {
+        g_task_return_boolean (task, true);
+
+        return;
+    }
+
+    g_output_stream_write_all_async (data->output, data->buffer, length,
+                                     g_task_get_priority (task),
+                                     g_task_get_cancellable (task),
+                                     on_block_written, g_steal_pointer (&task));
+}
+
+/* The default read_async() of the input stream decodes on a worker thread. */
+static void
+read_next_block (GTask *task)
+{
+    RasExtractData *data;
+
+    data = g_task_get_task_data (task);
+
+    g_input_stream_read_async (data->input, data->buffer, EXTRACT_BLOCK_SIZE,
+                               g_task_get_priority (task),
+                               g_task_get_cancellable (task),
+                               on_block_read, task);
+}
+
+void
+ras_file_extract_async (RasFile               *self,
+                        GOutputStream         *stream,
+                        int                    io_priority,
+                        GCancellable          *cancellable,
+                        GFileProgressCallback  progress_callback,
+                        void                  *progress_data,
+                        GAsyncReadyCallback    callback,
+                        void                  *user_data)
+{
+    g_autoptr (GTask) task = NULL;
+    GFileInputStream *input;
+    RasExtractData *data;
+    GError *error = NULL;
+
+    g_return_if_fail (RAS_IS_FILE (self));
+    g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+
+    task = g_task_new (self, cancellable, callback, user_data);
+
+    g_task_set_source_tag (task, ras_file_extract_async);
+    g_task_set_priority (task, io_priority);
+
+    input = ras_file_read (self, &error);
+    if (NULL == input)
+    {
+        g_task_return_error (task, error);
+
+        return;
+    }
+
+    data = g_new0 (RasExtractData, 1);
+
+    data->input = G_INPUT_STREAM (input);
+    data->output = g_object_ref (stream);
+    data->buffer = g_malloc (EXTRACT_BLOCK_SIZE);
+    data->bytes_total = self->size;
+    data->progress_callback = progress_callback;
+    data->progress_data = progress_data;
+
+    g_task_set_task_data (task, data, extract_data_free);
+
+    read_next_block (g_steal_pointer (&task));
+}
+
+bool
+ras_file_extract_finish (RasFile       *self,
+                         GAsyncResult  *result,
+                         GError       **error)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), false);
+    g_return_val_if_fail (g_task_is_valid (result, self), false);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+bool
+ras_file_can_extract_mapped (RasFile *self)
+{
+    g_return_val_if_fail (RAS_IS_FILE (self), false);
+
+#ifdef HAVE_MAPPED_EXTRACTION
+    return RAS_FILE_COMPRESSION_METHOD_COMPRESS == self->compression_method
+           && self->size >= EXTRACT_MAP_MIN_SIZE;
+#else
+    return false;
+#endif
+}
+
 bool
 ras_file_extract (RasFile        *self,
                   GOutputStream  *stream,
@@ -163,19 +973,100 @@ ras_file_extract (RasFile        *self,
     g_return_val_if_fail (RAS_IS_FILE (self), false);
     g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), false);
 
+    if (!check_bounds (self, error))
+    {
+        return false;
+    }
+
     if (RAS_FILE_COMPRESSION_METHOD_STORE == self->compression_method)
     {
-        return g_output_stream_write_all (stream, self->data, self->entry_size,
-                                          NULL, cancellable, error);
+        /* Stored entries are extracted to their size, whichever path is
+         * taken, as by ras_file_read().
+         */
+        if (self->entry_size < self->size)
+        {
+            g_set_error (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated entry %s", self->name);
+
+            return false;
+        }
+
+#ifdef HAVE_GIO_UNIX
+        if (-1 not_eq get_output_fd (stream))
+        {
+            g_autoptr (GError) local_error = NULL;
+
+            if (ras_source_copy_to_fd (self->source, self->offset, get_output_fd (stream),
+                                       self->size, cancellable, &local_error))
+            {
+                count_decoded (self, 1, self->size);
+
+                return true;
+            }
+            if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+            {
+                g_propagate_error (error, g_steal_pointer (&local_error));
+
+                return false;
+            }
+        }
+#endif
+
+        return copy_stored (self, stream, cancellable, error);
     }
     else if (RAS_FILE_COMPRESSION_METHOD_COMPRESS == self->compression_method)
     {
+#ifdef HAVE_MAPPED_EXTRACTION
+        if (ras_file_can_extract_mapped (self) && -1 not_eq get_output_fd (stream))
+        {
+            g_autoptr (GError) local_error = NULL;
+
+            if (extract_mapped (self, get_output_fd (stream), cancellable, &local_error))
+            {
+                return true;
+            }
+            if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+            {
+                g_propagate_error (error, g_steal_pointer (&local_error));
+
+                return false;
+            }
+        }
+#endif
+
         return decompress (self, stream, cancellable, error);
     }
 
     return true;
 }
 
+static void
+append_uint32 (GByteArray *table,
+               uint32_t    value)
+{
+    value = GUINT32_TO_LE (value);
+
+    g_byte_array_append (table, (const uint8_t *) &value, sizeof (value));
+}
+
+void
+ras_file_append_table_entry (RasFile    *self,
+                             GByteArray *table)
+{
+    g_return_if_fail (RAS_IS_FILE (self));
+    g_return_if_fail (NULL != table);
+
+    g_byte_array_append (table, (const uint8_t *) self->name, strlen (self->name) + 1);
+    append_uint32 (table, self->size);
+    append_uint32 (table, self->entry_size);
+    append_uint32 (table, self->_);
+    append_uint32 (table, self->parent_directory_index);
+    append_uint32 (table, self->__);
+    append_uint32 (table, self->compression_method);
+    ras_append_system_time (table, self->creation_date_time);
+}
+
 RasFile *
 ras_file_new (const char           *name,
               uint32_t              size,
@@ -185,12 +1076,14 @@ ras_file_new (const char           *name,
               uint32_t              __,
               RasCompressionMethod  compression_method,
               GDateTime            *creation_date_time,
-              const uint8_t        *data)
+              RasSource            *source,
+              uint64_t              offset)
 {
     RasFile *file;
 
     g_return_val_if_fail (NULL != name, NULL);
     g_return_val_if_fail (NULL != creation_date_time, NULL);
+    g_return_val_if_fail (NULL != source, NULL);
 
     file = g_object_new (RAS_TYPE_FILE, NULL);
 
@@ -202,7 +1095,8 @@ ras_file_new (const char           *name,
     file->__ = __;
     file->compression_method = compression_method;
     file->creation_date_time = g_date_time_ref (creation_date_time);
-    file->data = data;
+    file->source = ras_source_ref (source);
+    file->offset = offset;
 
     return file;
 }
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "ras-source.h"
 #include "ras-types.h"
 
 #include <gio/gio.h>
@@ -37,12 +38,76 @@ typedef enum
 } RasCompressionMethod;
 
 RasCompressionMethod  ras_file_get_compression_method (RasFile               *file);
+GDateTime            *ras_file_get_creation_date_time (RasFile               *file);
+uint32_t              ras_file_get_directory_index    (RasFile               *file);
+uint32_t              ras_file_get_entry_size         (RasFile               *file);
 char                 *ras_file_get_name               (RasFile               *file);
+uint32_t              ras_file_get_size               (RasFile               *file);
 
+bool                  ras_file_decode_into            (RasFile               *file,
+                                                       uint8_t               *destination,
+                                                       size_t                 length,
+                                                       GError               **error);
+
+/**
+ * ras_file_verify:
+ * @file: a #RasFile
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Checks that the data of @file lies within the archive and, if it is
+ * compressed, that it decodes to exactly the size in the file table without
+ * running past the end of the entry. Decoded data is discarded.
+ *
+ * Returns: whether @file is intact
+ */
+bool                  ras_file_verify                 (RasFile               *file,
+                                                       GCancellable          *cancellable,
+                                                       GError               **error);
+
+GBytes               *ras_file_get_bytes              (RasFile               *file,
+                                                       GError               **error);
+GFileInputStream     *ras_file_read                   (RasFile               *file,
+                                                       GError               **error);
+
+/* Whether ras_file_extract() decodes the entry straight into the output
+ * file, which it can only do if the file was opened for reading as well, as
+ * by g_file_replace_readwrite().
+ */
+bool                  ras_file_can_extract_mapped     (RasFile               *file);
 bool                  ras_file_extract                (RasFile               *file,
                                                        GOutputStream         *stream,
                                                        GCancellable          *cancellable,
                                                        GError               **error);
+/**
+ * ras_file_extract_async:
+ * @file: a #RasFile
+ * @stream: where to write the contents of @file
+ * @io_priority: the I/O priority of the request
+ * @cancellable: (nullable): a #GCancellable
+ * @progress_callback: (nullable): called after every block is written
+ * @progress_data: data for @progress_callback
+ * @callback: called when the file has been extracted
+ * @user_data: data for @callback
+ *
+ * Decodes @file on a worker thread a block at a time and writes it to
+ * @stream asynchronously. Callbacks run in the thread-default main context.
+ */
+void                  ras_file_extract_async          (RasFile               *file,
+                                                       GOutputStream         *stream,
+                                                       int                    io_priority,
+                                                       GCancellable          *cancellable,
+                                                       GFileProgressCallback  progress_callback,
+                                                       void                  *progress_data,
+                                                       GAsyncReadyCallback    callback,
+                                                       void                  *user_data);
+bool                  ras_file_extract_finish         (RasFile               *file,
+                                                       GAsyncResult          *result,
+                                                       GError               **error);
+
+/* Appends the entry as it was read, for rewriting the table it came from. */
+void                  ras_file_append_table_entry     (RasFile               *file,
+                                                       GByteArray            *table);
 
 RasFile              *ras_file_new                    (const char            *name,
                                                        uint32_t               size,
@@ -52,4 +117,5 @@ RasFile              *ras_file_new                    (const char            *na
                                                        uint32_t               __,
                                                        RasCompressionMethod   compression_method,
                                                        GDateTime             *creation_date_time,
-                                                       const uint8_t          *data);
+                                                       RasSource             *source,
+                                                       uint64_t               offset);
@@ -0,0 +1,1000 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-lzss.h"
+
+#include <iso646.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define WINDOW_MASK (RAS_LZSS_WINDOW_SIZE - 1)
+/* Okumura’s encoder keeps the look-ahead in the ring buffer, so that is as far
+ * back as RasMaker ever points.
+ */
+#define MAX_DISTANCE (RAS_LZSS_WINDOW_SIZE - RAS_LZSS_MAX_MATCH_LENGTH)
+/* Pointers are ring buffer positions, and the ring starts being filled at
+ * N - F, so they lag behind the output offset by F.
+ */
+#define POINTER_BIAS RAS_LZSS_MAX_MATCH_LENGTH
+
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+
+#define BUFFER_SIZE 0x10000
+/* Enough input to look for a match and, lazily, at the next position. */
+#define LOOKAHEAD (RAS_LZSS_MAX_MATCH_LENGTH + 1)
+
+/* The flag byte and up to 8 tokens; only ever flushed whole, so that the
+ * output can be drained between calls.
+ */
+typedef struct
+{
+    uint8_t data[1 + 8 * 2];
+    size_t length;
+    unsigned int tokens;
+} TokenGroup;
+
+typedef struct
+{
+    unsigned int max_chain;
+    /* Matches shorter than this are compared against the next position’s
+     * before being committed to; 0 disables lazy matching.
+     */
+    unsigned int lazy_length;
+    /* Stop walking the chain once a match this long is found. */
+    unsigned int nice_length;
+    /* Without lazy matching, longer matches are skipped over without adding
+     * the positions they cover to the hash chains.
+     */
+    unsigned int insert_length;
+} RasLzssConfig;
+
+static const RasLzssConfig configs[] =
+{
+    [RAS_LZSS_LEVEL_FASTEST] = {    1,  0,  8,  4, },
+    [2]                      = {    4,  0, 10,  6, },
+    [3]                      = {    8,  0, 18, 18, },
+    [4]                      = {   16,  4, 18, 18, },
+    [5]                      = {   32,  8, 18, 18, },
+    [RAS_LZSS_LEVEL_DEFAULT] = {   64, 18, 18, 18, },
+    [7]                      = {  256, 18, 18, 18, },
+    [8]                      = { 1024, 18, 18, 18, },
+    [RAS_LZSS_LEVEL_BEST]    = { 4096, 18, 18, 18, },
+};
+
+struct _RasLzssEncoder
+{
+    const RasLzssConfig *config;
+
+    /* Holds input from buffer_start onwards, which includes at least a
+     * window’s worth of history before position.
+     */
+    uint8_t *buffer;
+    size_t buffer_start;
+    size_t buffer_length;
+
+    size_t position;
+    size_t inserted;
+
+    /* Lazy matching found a longer match at position. */
+    bool has_next_match;
+    unsigned int next_length;
+    size_t next_distance;
+
+    /* Positions are stored biased by one, so that 0 terminates a chain. */
+    uint32_t head[HASH_SIZE];
+    uint32_t chain[RAS_LZSS_WINDOW_SIZE];
+
+    TokenGroup group;
+};
+
+struct _RasLzssJoiner
+{
+    /* Of the start of the next segment. */
+    uint64_t output_offset;
+
+    TokenGroup group;
+};
+
+static inline const uint8_t *
+buffer_at (RasLzssEncoder *self,
+           size_t          position)
+{
+    return self->buffer + (position - self->buffer_start);
+}
+
+static inline size_t
+buffer_end (RasLzssEncoder *self)
+{
+    return self->buffer_start + self->buffer_length;
+}
+
+static inline uint32_t
+hash (const uint8_t *data)
+{
+    uint32_t value;
+
+    value = data[0] | (data[1] << 8) | ((uint32_t) data[2] << 16);
+
+    return (value * 0x9E3779B1U) >> (32 - HASH_BITS);
+}
+
+static inline void
+insert (RasLzssEncoder *self,
+        size_t          position)
+{
+    uint32_t *head;
+
+    head = &self->head[hash (buffer_at (self, position))];
+
+    self->chain[position & WINDOW_MASK] = *head;
+    *head = position + 1;
+}
+
+static void
+insert_until (RasLzssEncoder *self,
+              size_t          position)
+{
+    size_t end;
+
+    /* Hashing needs the minimum match length worth of input. */
+    end = buffer_end (self) - (RAS_LZSS_MIN_MATCH_LENGTH - 1);
+    if (position > end)
+    {
+        position = end;
+    }
+
+    for (; self->inserted < position; self->inserted++)
+    {
+        insert (self, self->inserted);
+    }
+}
+
+static unsigned int
+find_match (RasLzssEncoder *self,
+            size_t          position,
+            size_t         *distance)
+{
+    const uint8_t *current;
+    unsigned int max_length;
+    unsigned int best_length;
+    unsigned int chain_length;
+    uint32_t *head;
+    uint32_t candidate;
+
+    if (buffer_end (self) - position < RAS_LZSS_MIN_MATCH_LENGTH)
+    {
+        return 0;
+    }
+
+    insert_until (self, position);
+
+    current = buffer_at (self, position);
+    max_length = MIN (buffer_end (self) - position, RAS_LZSS_MAX_MATCH_LENGTH);
+    best_length = RAS_LZSS_MIN_MATCH_LENGTH - 1;
+    chain_length = self->config->max_chain;
+    head = &self->head[hash (current)];
+    candidate = *head;
+
+    if (self->inserted == position)
+    {
+        self->chain[position & WINDOW_MASK] = candidate;
+        *head = position + 1;
+
+        self->inserted++;
+    }
+
+    while (0 not_eq candidate && chain_length-- > 0)
+    {
+        size_t candidate_position;
+        const uint8_t *match;
+
+        candidate_position = candidate - 1;
+        if (position - candidate_position > MAX_DISTANCE)
+        {
+            break;
+        }
+
+        match = buffer_at (self, candidate_position);
+
+        if (match[best_length] == current[best_length] && match[0] == current[0])
+        {
+            unsigned int length;
+
+            for (length = 1; length < max_length && match[length] == current[length]; length++)
+            {
+            }
+
+            if (length > best_length)
+            {
+                best_length = length;
+                *distance = position - candidate_position;
+
+                if (length >= self->config->nice_length || length == max_length)
+                {
+                    break;
+                }
+            }
+        }
+
+        candidate = self->chain[candidate_position & WINDOW_MASK];
+    }
+
+    if (best_length < RAS_LZSS_MIN_MATCH_LENGTH)
+    {
+        return 0;
+    }
+
+    return best_length;
+}
+
+static void
+group_init (TokenGroup *group)
+{
+    group->data[0] = 0;
+    group->length = 1;
+    group->tokens = 0;
+}
+
+static void
+group_flush (TokenGroup *group,
+             GByteArray *output)
+{
+    if (0 == group->tokens)
+    {
+        return;
+    }
+
+    g_byte_array_append (output, group->data, group->length);
+
+    group_init (group);
+}
+
+static void
+group_add_literal (TokenGroup *group,
+                   uint8_t     literal,
+                   GByteArray *output)
+{
+    group->data[0] |= 1 << group->tokens;
+    group->data[group->length++] = literal;
+
+    if (8 == ++group->tokens)
+    {
+        group_flush (group, output);
+    }
+}
+
+/* @length is the second byte of the token, i.e. biased and shifted. */
+static void
+group_add_match (TokenGroup   *group,
+                 unsigned int  pointer,
+                 unsigned int  length,
+                 GByteArray   *output)
+{
+    group->data[group->length++] = pointer & 0xFF;
+    group->data[group->length++] = ((pointer >> 4) & 0xF0) | length;
+
+    if (8 == ++group->tokens)
+    {
+        group_flush (group, output);
+    }
+}
+
+static void
+emit_literal (RasLzssEncoder *self,
+              uint8_t         literal,
+              GByteArray     *output)
+{
+    group_add_literal (&self->group, literal, output);
+}
+
+static void
+emit_match (RasLzssEncoder *self,
+            size_t          position,
+            size_t          distance,
+            unsigned int    length,
+            GByteArray     *output)
+{
+    unsigned int pointer;
+
+    pointer = (position - distance - POINTER_BIAS) & WINDOW_MASK;
+
+    group_add_match (&self->group, pointer, length - RAS_LZSS_MIN_MATCH_LENGTH, output);
+}
+
+static void
+encode (RasLzssEncoder *self,
+        bool            finish,
+        GByteArray     *output)
+{
+    const RasLzssConfig *config;
+
+    config = self->config;
+
+    while (self->position < buffer_end (self))
+    {
+        size_t distance;
+        unsigned int length;
+
+        if (!finish && buffer_end (self) - self->position < LOOKAHEAD)
+        {
+            break;
+        }
+
+        if (self->has_next_match)
+        {
+            length = self->next_length;
+            distance = self->next_distance;
+
+            self->has_next_match = false;
+        }
+        else
+        {
+            length = find_match (self, self->position, &distance);
+        }
+
+        if (length > 0 && length < config->lazy_length)
+        {
+            self->next_length = find_match (self, self->position + 1, &self->next_distance);
+            if (self->next_length > length)
+            {
+                self->has_next_match = true;
+
+                length = 0;
+            }
+        }
+
+        if (0 == length)
+        {
+            emit_literal (self, *buffer_at (self, self->position), output);
+
+            self->position++;
+
+            continue;
+        }
+
+        emit_match (self, self->position, distance, length, output);
+
+        if (0 == config->lazy_length && length > config->insert_length)
+        {
+            insert_until (self, self->position + 1);
+
+            self->inserted = self->position + length;
+        }
+
+        self->position += length;
+    }
+}
+
+static void
+slide (RasLzssEncoder *self)
+{
+    size_t start;
+    size_t offset;
+
+    start = MIN (self->position, self->inserted);
+    if (start < self->buffer_start + RAS_LZSS_WINDOW_SIZE)
+    {
+        return;
+    }
+    start -= RAS_LZSS_WINDOW_SIZE;
+
+    offset = start - self->buffer_start;
+
+    memmove (self->buffer, self->buffer + offset, self->buffer_length - offset);
+
+    self->buffer_start = start;
+    self->buffer_length -= offset;
+}
+
+RasLzssEncoder *
+ras_lzss_encoder_new (RasLzssLevel level)
+{
+    RasLzssEncoder *encoder;
+
+    g_return_val_if_fail (level >= RAS_LZSS_LEVEL_FASTEST, NULL);
+    g_return_val_if_fail (level <= RAS_LZSS_LEVEL_BEST, NULL);
+
+    encoder = g_new0 (RasLzssEncoder, 1);
+
+    encoder->config = &configs[level];
+    encoder->buffer = g_malloc (BUFFER_SIZE);
+    group_init (&encoder->group);
+
+    return encoder;
+}
+
+void
+ras_lzss_encoder_free (RasLzssEncoder *encoder)
+{
+    if (NULL == encoder)
+    {
+        return;
+    }
+
+    g_free (encoder->buffer);
+    g_free (encoder);
+}
+
+void
+ras_lzss_encoder_push (RasLzssEncoder *self,
+                       const uint8_t  *data,
+                       size_t          size,
+                       GByteArray     *output)
+{
+    g_return_if_fail (NULL != self);
+    g_return_if_fail (NULL != data || 0 == size);
+    g_return_if_fail (NULL != output);
+
+    while (size > 0)
+    {
+        size_t length;
+
+        slide (self);
+
+        length = MIN (size, BUFFER_SIZE - self->buffer_length);
+
+        memcpy (self->buffer + self->buffer_length, data, length);
+
+        self->buffer_length += length;
+        data += length;
+        size -= length;
+
+        encode (self, false, output);
+    }
+}
+
+void
+ras_lzss_encoder_finish (RasLzssEncoder *self,
+                         GByteArray     *output)
+{
+    g_return_if_fail (NULL != self);
+    g_return_if_fail (NULL != output);
+
+    encode (self, true, output);
+
+    group_flush (&self->group, output);
+}
+
+/* Starts a compressed entry, with the length of the token stream to be
+ * filled in by finish_entry().
+ */
+static GByteArray *
+start_entry (size_t size)
+{
+    GByteArray *output;
+    uint32_t value;
+
+    /* Worst case is all literals, at 9 bits apiece. */
+    output = g_byte_array_sized_new (RAS_LZSS_HEADER_LENGTH + size + size / 8 + 1);
+
+    g_byte_array_append (output, (const uint8_t *) RAS_LZSS_HEADER, strlen (RAS_LZSS_HEADER));
+    value = GUINT32_TO_LE (size);
+    g_byte_array_append (output, (const uint8_t *) &value, sizeof (value));
+    value = 0;
+    g_byte_array_append (output, (const uint8_t *) &value, sizeof (value));
+
+    return output;
+}
+
+static GBytes *
+finish_entry (GByteArray *output)
+{
+    uint32_t value;
+
+    value = GUINT32_TO_LE (output->len - RAS_LZSS_HEADER_LENGTH);
+    memcpy (output->data + 8, &value, sizeof (value));
+
+    return g_byte_array_free_to_bytes (output);
+}
+
+GBytes *
+ras_lzss_compress (const uint8_t *data,
+                   size_t         size,
+                   RasLzssLevel   level)
+{
+    g_autoptr (RasLzssEncoder) encoder = NULL;
+    GByteArray *output;
+
+    g_return_val_if_fail (NULL != data || 0 == size, NULL);
+    g_return_val_if_fail (size <= G_MAXUINT32, NULL);
+
+    encoder = ras_lzss_encoder_new (level);
+    if (NULL == encoder)
+    {
+        return NULL;
+    }
+    output = start_entry (size);
+
+    ras_lzss_encoder_push (encoder, data, size, output);
+    ras_lzss_encoder_finish (encoder, output);
+
+    return finish_entry (output);
+}
+
+RasLzssJoiner *
+ras_lzss_joiner_new (void)
+{
+    RasLzssJoiner *joiner;
+
+    joiner = g_new0 (RasLzssJoiner, 1);
+
+    group_init (&joiner->group);
+
+    return joiner;
+}
+
+void
+ras_lzss_joiner_free (RasLzssJoiner *joiner)
+{
+    g_free (joiner);
+}
+
+void
+ras_lzss_joiner_push (RasLzssJoiner *self,
+                      const uint8_t *tokens,
+                      size_t         length,
+                      size_t         size,
+                      GByteArray    *output)
+{
+    unsigned int shift;
+
+    g_return_if_fail (NULL != self);
+    g_return_if_fail (NULL != tokens || 0 == length);
+    g_return_if_fail (NULL != output);
+
+    /* Pointers are ring buffer positions, which move along with the start of
+     * the segment; distances stay the same.
+     */
+    shift = self->output_offset & WINDOW_MASK;
+
+    for (size_t i = 0; i < length; )
+    {
+        uint8_t flags;
+
+        flags = tokens[i++];
+
+        /* The last group of the segment may be short. */
+        for (unsigned int bit = 0; bit < 8 && i < length; bit++)
+        {
+            unsigned int pointer;
+
+            if (0 not_eq (flags & (1 << bit)))
+            {
+                group_add_literal (&self->group, tokens[i], output);
+
+                i++;
+
+                continue;
+            }
+
+            g_return_if_fail (i + 1 < length);
+
+            pointer = tokens[i] | ((tokens[i + 1] & 0xF0) << 4);
+            pointer = (pointer + shift) & WINDOW_MASK;
+
+            group_add_match (&self->group, pointer, tokens[i + 1] & 0xF, output);
+
+            i += 2;
+        }
+    }
+
+    self->output_offset += size;
+}
+
+void
+ras_lzss_joiner_finish (RasLzssJoiner *self,
+                        GByteArray    *output)
+{
+    g_return_if_fail (NULL != self);
+    g_return_if_fail (NULL != output);
+
+    group_flush (&self->group, output);
+}
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    RasLzssLevel level;
+
+    size_t segment_count;
+    size_t next_segment;
+    GByteArray **segments;
+} SegmentContext;
+
+static void *
+compress_segment_worker (void *data)
+{
+    SegmentContext *context;
+
+    context = data;
+
+    for (;;)
+    {
+        size_t index;
+        size_t offset;
+        g_autoptr (RasLzssEncoder) encoder = NULL;
+        GByteArray *output;
+
+        index = g_atomic_pointer_add (&context->next_segment, 1);
+        if (index >= context->segment_count)
+        {
+            break;
+        }
+
+        offset = index * RAS_LZSS_SEGMENT_SIZE;
+
+        encoder = ras_lzss_encoder_new (context->level);
+        output = g_byte_array_sized_new (RAS_LZSS_SEGMENT_SIZE + RAS_LZSS_SEGMENT_SIZE / 8 + 1);
+
+        ras_lzss_encoder_push (encoder, context->data + offset,
+                               MIN (context->size - offset, RAS_LZSS_SEGMENT_SIZE),
+                               output);
+        ras_lzss_encoder_finish (encoder, output);
+
+        context->segments[index] = output;
+    }
+
+    return NULL;
+}
+
+void
+ras_lzss_compress_segments (const uint8_t *data,
+                            size_t         size,
+                            RasLzssLevel   level,
+                            unsigned int   n_threads,
+                            RasLzssJoiner *joiner,
+                            GByteArray    *output)
+{
+    SegmentContext context = { 0 };
+    g_autoptr (GPtrArray) threads = NULL;
+
+    g_return_if_fail (NULL != data || 0 == size);
+    g_return_if_fail (level >= RAS_LZSS_LEVEL_FASTEST);
+    g_return_if_fail (level <= RAS_LZSS_LEVEL_BEST);
+    g_return_if_fail (NULL != joiner);
+    g_return_if_fail (NULL != output);
+
+    context.data = data;
+    context.size = size;
+    context.level = level;
+    context.segment_count = (size + RAS_LZSS_SEGMENT_SIZE - 1) / RAS_LZSS_SEGMENT_SIZE;
+    context.segments = g_new0 (GByteArray *, context.segment_count);
+
+    if (0 == n_threads)
+    {
+        n_threads = g_get_num_processors ();
+    }
+    n_threads = MIN (n_threads, MAX (context.segment_count, 1));
+
+    threads = g_ptr_array_new ();
+
+    /* The calling thread is a worker too. */
+    for (unsigned int i = 1; i < n_threads; i++)
+    {
+        GThread *thread;
+
+        thread = g_thread_try_new ("ras-compress", compress_segment_worker, &context, NULL);
+        if (NULL == thread)
+        {
+            break;
+        }
+
+        g_ptr_array_add (threads, thread);
+    }
+
+    compress_segment_worker (&context);
+
+    for (size_t i = 0; i < threads->len; i++)
+    {
+        g_thread_join (g_ptr_array_index (threads, i));
+    }
+
+    for (size_t i = 0; i < context.segment_count; i++)
+    {
+        size_t offset;
+
+        offset = i * RAS_LZSS_SEGMENT_SIZE;
+
+        ras_lzss_joiner_push (joiner,
+                              context.segments[i]->data, context.segments[i]->len,
+                              MIN (size - offset, RAS_LZSS_SEGMENT_SIZE),
+                              output);
+
+        g_byte_array_unref (context.segments[i]);
+    }
+
+    g_free (context.segments);
+}
+
+GBytes *
+ras_lzss_compress_parallel (const uint8_t *data,
+                            size_t         size,
+                            RasLzssLevel   level,
+                            unsigned int   n_threads)
+{
+    g_autoptr (RasLzssJoiner) joiner = NULL;
+    GByteArray *output;
+
+    g_return_val_if_fail (NULL != data || 0 == size, NULL);
+    g_return_val_if_fail (size <= G_MAXUINT32, NULL);
+    g_return_val_if_fail (level >= RAS_LZSS_LEVEL_FASTEST, NULL);
+    g_return_val_if_fail (level <= RAS_LZSS_LEVEL_BEST, NULL);
+
+    joiner = ras_lzss_joiner_new ();
+    output = start_entry (size);
+
+    ras_lzss_compress_segments (data, size, level, n_threads, joiner, output);
+    ras_lzss_joiner_finish (joiner, output);
+
+    return finish_entry (output);
+}
+
+void
+ras_lzss_decoder_init (RasLzssDecoder *decoder,
+                       const uint8_t  *input,
+                       size_t          length)
+{
+    g_return_if_fail (NULL != decoder);
+    g_return_if_fail (NULL != input || 0 == length);
+
+    decoder->input = input;
+    decoder->input_length = length;
+    decoder->input_offset = 0;
+    decoder->flags = 0;
+    decoder->flag_bit = 8;
+    decoder->match_distance = 0;
+    decoder->match_remaining = 0;
+    decoder->output_offset = 0;
+    decoder->n_literals = 0;
+    decoder->n_matches = 0;
+    decoder->match_length = 0;
+
+    /* Okumura’s ring buffer starts out filled with spaces, and pointers
+     * into it before the first byte of output are valid.
+     */
+    memset (decoder->window, ' ', sizeof (decoder->window));
+}
+
+void
+ras_lzss_decoder_set_input (RasLzssDecoder *decoder,
+                            const uint8_t  *input,
+                            size_t          length)
+{
+    g_return_if_fail (NULL != decoder);
+    g_return_if_fail (NULL != input || 0 == length);
+
+    decoder->input = input;
+    decoder->input_length = length;
+    decoder->input_offset = 0;
+}
+
+static uint8_t *
+copy_match (RasLzssDecoder *decoder,
+            uint8_t        *output_start,
+            uint8_t        *output,
+            uint8_t        *output_end)
+{
+    size_t distance;
+    size_t length;
+
+    distance = decoder->match_distance;
+    length = MIN (decoder->match_remaining, (size_t) (output_end - output));
+
+    decoder->match_remaining -= length;
+
+    if ((size_t) (output - output_start) >= distance)
+    {
+        const uint8_t *source;
+
+        source = output - distance;
+
+        if (distance >= length)
+        {
+            memcpy (output, source, length);
+
+            return output + length;
+        }
+
+        for (size_t i = 0; i < length; i++)
+        {
+            output[i] = source[i];
+        }
+
+        return output + length;
+    }
+
+    /* The match starts in output from a previous call. */
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t produced;
+
+        produced = output - output_start;
+
+        if (produced >= distance)
+        {
+            *output = *(output - distance);
+        }
+        else
+        {
+            uint64_t offset;
+
+            offset = decoder->output_offset + produced - distance;
+
+            *output = decoder->window[offset & WINDOW_MASK];
+        }
+
+        output++;
+    }
+
+    return output;
+}
+
+static void
+update_window (RasLzssDecoder *decoder,
+               const uint8_t  *output,
+               size_t          length)
+{
+    uint64_t offset;
+    size_t index;
+    size_t head;
+
+    offset = decoder->output_offset;
+
+    if (length > RAS_LZSS_WINDOW_SIZE)
+    {
+        offset += length - RAS_LZSS_WINDOW_SIZE;
+        output += length - RAS_LZSS_WINDOW_SIZE;
+        length = RAS_LZSS_WINDOW_SIZE;
+    }
+
+    index = offset & WINDOW_MASK;
+    head = MIN (length, RAS_LZSS_WINDOW_SIZE - index);
+
+    memcpy (decoder->window + index, output, head);
+    memcpy (decoder->window, output + head, length - head);
+}
+
+void
+ras_lzss_decoder_decode (RasLzssDecoder  *decoder,
+                         uint8_t         *output,
+                         size_t           length,
+                         size_t          *bytes_written)
+{
+    const uint8_t *input;
+    const uint8_t *input_end;
+    uint8_t *output_start;
+    uint8_t *output_end;
+    unsigned int flags;
+    unsigned int flag_bit;
+    /* Kept in registers, rather than updated in the decoder every token. */
+    uint64_t n_literals;
+    uint64_t n_matches;
+    uint64_t match_length;
+
+    g_return_if_fail (NULL != decoder);
+    g_return_if_fail (NULL != output || 0 == length);
+
+    input = decoder->input + decoder->input_offset;
+    input_end = decoder->input + decoder->input_length;
+    output_start = output;
+    output_end = output + length;
+    flags = decoder->flags;
+    flag_bit = decoder->flag_bit;
+    n_literals = 0;
+    n_matches = 0;
+    match_length = 0;
+
+    if (decoder->match_remaining > 0)
+    {
+        output = copy_match (decoder, output_start, output, output_end);
+    }
+
+    while (output < output_end)
+    {
+        if (8 == flag_bit)
+        {
+            if (input >= input_end)
+            {
+                break;
+            }
+
+            flags = *(input++);
+            flag_bit = 0;
+
+            /* Runs of incompressible data. */
+            if (0xFF == flags && input_end - input >= 8 && output_end - output >= 8)
+            {
+                memcpy (output, input, 8);
+
+                input += 8;
+                output += 8;
+                flag_bit = 8;
+                n_literals += 8;
+
+                continue;
+            }
+        }
+
+        if (input >= input_end)
+        {
+            break;
+        }
+
+        if (flags & (1 << flag_bit))
+        {
+            *(output++) = *(input++);
+
+            n_literals++;
+        }
+        else
+        {
+            unsigned int pointer;
+            size_t source;
+            size_t distance;
+
+            /* Either the data is truncated or the rest of the pointer is in
+             * the next piece of input.
+             */
+            if (input_end - input < 2)
+            {
+                break;
+            }
+
+            pointer = ((input[1] & 0xF0) << 4) | input[0];
+            source = (pointer + POINTER_BIAS) & WINDOW_MASK;
+            distance = (decoder->output_offset + (output - output_start) - source) & WINDOW_MASK;
+
+            decoder->match_distance = (0 == distance)? RAS_LZSS_WINDOW_SIZE : distance;
+            decoder->match_remaining = (input[1] & 0xF) + RAS_LZSS_MIN_MATCH_LENGTH;
+
+            n_matches++;
+            match_length += decoder->match_remaining;
+
+            input += 2;
+
+            output = copy_match (decoder, output_start, output, output_end);
+        }
+
+        flag_bit++;
+    }
+
+    update_window (decoder, output_start, output - output_start);
+
+    decoder->input_offset = input - decoder->input;
+    decoder->flags = flags;
+    decoder->flag_bit = flag_bit;
+    decoder->output_offset += output - output_start;
+    decoder->n_literals += n_literals;
+    decoder->n_matches += n_matches;
+    decoder->match_length += match_length;
+
+    if (NULL != bytes_written)
+    {
+        *bytes_written = output - output_start;
+    }
+}
+
+bool
+ras_lzss_decoder_is_finished (RasLzssDecoder *decoder)
+{
+    g_return_val_if_fail (NULL != decoder, false);
+
+    return decoder->input_offset == decoder->input_length && 0 == decoder->match_remaining;
+}
@@ -0,0 +1,160 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* Okumura’s LZSS, as used by RasMaker: a 4 KiB window, 12-bit pointers with
+ * 4-bit lengths biased by 3, and a flag byte in front of every 8 tokens
+ * (set bits mark literals).
+ */
+#define RAS_LZSS_WINDOW_SIZE 0x1000
+#define RAS_LZSS_MIN_MATCH_LENGTH 3
+#define RAS_LZSS_MAX_MATCH_LENGTH 0x12
+
+/* “RA->”, followed by the decompressed size and the length of the token
+ * stream.
+ */
+#define RAS_LZSS_HEADER "RA->"
+#define RAS_LZSS_HEADER_LENGTH 12
+
+/* Input is split into segments of this size for parallel compression. Each
+ * starts with an empty window, which costs a little compression at segment
+ * starts.
+ */
+#define RAS_LZSS_SEGMENT_SIZE 0x100000
+
+typedef enum
+{
+    RAS_LZSS_LEVEL_FASTEST = 1,
+    RAS_LZSS_LEVEL_DEFAULT = 6,
+    RAS_LZSS_LEVEL_BEST = 9,
+} RasLzssLevel;
+
+typedef struct _RasLzssEncoder RasLzssEncoder;
+/* Joins token streams of segments that were compressed separately into one
+ * that decodes to their concatenation.
+ */
+typedef struct _RasLzssJoiner RasLzssJoiner;
+
+/* Decoding state, which can be resumed with a different output buffer or
+ * copied to be resumed from later.
+ */
+typedef struct
+{
+    const uint8_t *input;
+    size_t input_length;
+    size_t input_offset;
+
+    uint8_t flags;
+    unsigned int flag_bit;
+
+    size_t match_distance;
+    unsigned int match_remaining;
+
+    uint64_t output_offset;
+
+    /* Tokens decoded so far, and the output of the matches among them. */
+    uint64_t n_literals;
+    uint64_t n_matches;
+    uint64_t match_length;
+
+    /* Output from previous calls, indexed by output offset. */
+    uint8_t window[RAS_LZSS_WINDOW_SIZE];
+} RasLzssDecoder;
+
+RasLzssEncoder *ras_lzss_encoder_new         (RasLzssLevel     level);
+void            ras_lzss_encoder_free        (RasLzssEncoder  *encoder);
+
+void            ras_lzss_encoder_push        (RasLzssEncoder  *encoder,
+                                              const uint8_t   *data,
+                                              size_t           size,
+                                              GByteArray      *output);
+void            ras_lzss_encoder_finish      (RasLzssEncoder  *encoder,
+                                              GByteArray      *output);
+
+GBytes         *ras_lzss_compress            (const uint8_t   *data,
+                                              size_t           size,
+                                              RasLzssLevel     level);
+
+RasLzssJoiner  *ras_lzss_joiner_new          (void);
+void            ras_lzss_joiner_free         (RasLzssJoiner   *joiner);
+
+/* @size is the decompressed size of the segment that @tokens encode. */
+void            ras_lzss_joiner_push         (RasLzssJoiner   *joiner,
+                                              const uint8_t   *tokens,
+                                              size_t           length,
+                                              size_t           size,
+                                              GByteArray      *output);
+void            ras_lzss_joiner_finish       (RasLzssJoiner   *joiner,
+                                              GByteArray      *output);
+
+/**
+ * ras_lzss_compress_segments:
+ * @data: the data to compress
+ * @size: the size of @data
+ * @level: the compression level
+ * @n_threads: the number of threads to use, or 0 for one per CPU
+ * @joiner: the #RasLzssJoiner to join the segments with
+ * @output: where to append the tokens
+ *
+ * Compresses @data in segments of %RAS_LZSS_SEGMENT_SIZE in parallel. Tokens
+ * of the last group are held back by @joiner until the next call or
+ * ras_lzss_joiner_finish().
+ */
+void            ras_lzss_compress_segments   (const uint8_t   *data,
+                                              size_t           size,
+                                              RasLzssLevel     level,
+                                              unsigned int     n_threads,
+                                              RasLzssJoiner   *joiner,
+                                              GByteArray      *output);
+GBytes         *ras_lzss_compress_parallel   (const uint8_t   *data,
+                                              size_t           size,
+                                              RasLzssLevel     level,
+                                              unsigned int     n_threads);
+
+void            ras_lzss_decoder_init        (RasLzssDecoder  *decoder,
+                                              const uint8_t   *input,
+                                              size_t           length);
+/* Replaces the input once the decoder has stopped for lack of it; any of
+ * the old input that was not consumed has to be passed again.
+ */
+void            ras_lzss_decoder_set_input   (RasLzssDecoder  *decoder,
+                                              const uint8_t   *input,
+                                              size_t           length);
+/* Decodes until @length bytes have been written or the input runs out.
+ * Malformed input cannot be told apart from input that has not been supplied
+ * yet, so running out is left to the caller to report.
+ */
+void            ras_lzss_decoder_decode      (RasLzssDecoder  *decoder,
+                                              uint8_t         *output,
+                                              size_t           length,
+                                              size_t          *bytes_written);
+bool            ras_lzss_decoder_is_finished (RasLzssDecoder  *decoder);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RasLzssEncoder, ras_lzss_encoder_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RasLzssJoiner, ras_lzss_joiner_free)
+
+G_END_DECLS
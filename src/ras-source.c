@@ -0,0 +1,730 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "ras-source.h"
+
+#include "ras-archive.h"
+#include "ras-trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iso646.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define SKIP_BUFFER_SIZE 0x10000
+/* Kernel copies are split into pieces of this size to check for
+ * cancellation in between.
+ */
+#define COPY_BLOCK_SIZE 0x1000000
+
+typedef enum
+{
+    RAS_SOURCE_TYPE_BYTES,
+    RAS_SOURCE_TYPE_FD,
+    RAS_SOURCE_TYPE_STREAM,
+} RasSourceType;
+
+struct _RasSource
+{
+    gatomicrefcount ref_count;
+
+    RasSourceType type;
+    uint64_t size;
+    bool seekable;
+
+    GBytes *bytes;
+    const uint8_t *data;
+
+    int fd;
+
+    GInputStream *stream;
+
+    /* Where the archive starts in a seekable descriptor or stream, which is
+     * where it was positioned when the source was created. Offsets are
+     * relative to it.
+     */
+    goffset base;
+
+    /* Guards the stream position, and that of non-seekable descriptors. */
+    GMutex mutex;
+    uint64_t position;
+
+    RasStats stats;
+};
+
+static RasSource *
+source_new (RasSourceType type)
+{
+    RasSource *source;
+
+    source = g_new0 (RasSource, 1);
+
+    g_atomic_ref_count_init (&source->ref_count);
+    g_mutex_init (&source->mutex);
+
+    source->type = type;
+    source->size = RAS_SOURCE_SIZE_UNKNOWN;
+    source->fd = -1;
+
+    return source;
+}
+
+RasSource *
+ras_source_new_for_bytes (GBytes *bytes)
+{
+    RasSource *source;
+    size_t size;
+
+    g_return_val_if_fail (NULL != bytes, NULL);
+
+    source = source_new (RAS_SOURCE_TYPE_BYTES);
+
+    source->bytes = g_bytes_ref (bytes);
+    source->data = g_bytes_get_data (bytes, &size);
+    source->size = size;
+    source->seekable = true;
+
+    return source;
+}
+
+RasSource *
+ras_source_new_for_fd (int      fd,
+                       GError **error)
+{
+    RasSource *source;
+    int fd_copy;
+    struct stat st;
+
+    g_return_val_if_fail (fd >= 0, NULL);
+
+    fd_copy = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+    if (-1 == fd_copy)
+    {
+        int saved_errno;
+
+        saved_errno = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "Failed to duplicate file descriptor: %s",
+                     g_strerror (saved_errno));
+
+        return NULL;
+    }
+
+    source = source_new (RAS_SOURCE_TYPE_FD);
+
+    source->fd = fd_copy;
+    source->base = lseek (fd_copy, 0, SEEK_CUR);
+    source->seekable = -1 not_eq source->base;
+
+    if (!source->seekable)
+    {
+        source->base = 0;
+    }
+    else if (0 == fstat (fd_copy, &st) && S_ISREG (st.st_mode) && st.st_size >= source->base)
+    {
+        source->size = st.st_size - source->base;
+    }
+
+    return source;
+}
+
+RasSource *
+ras_source_new_for_stream (GInputStream *stream)
+{
+    RasSource *source;
+
+    g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+    source = source_new (RAS_SOURCE_TYPE_STREAM);
+
+    source->stream = g_object_ref (stream);
+    source->seekable = G_IS_SEEKABLE (stream) && g_seekable_can_seek (G_SEEKABLE (stream));
+    if (source->seekable)
+    {
+        source->base = g_seekable_tell (G_SEEKABLE (stream));
+    }
+
+    return source;
+}
+
+RasSource *
+ras_source_ref (RasSource *source)
+{
+    g_return_val_if_fail (NULL != source, NULL);
+
+    g_atomic_ref_count_inc (&source->ref_count);
+
+    return source;
+}
+
+void
+ras_source_unref (RasSource *source)
+{
+    g_return_if_fail (NULL != source);
+
+    if (!g_atomic_ref_count_dec (&source->ref_count))
+    {
+        return;
+    }
+
+    g_clear_pointer (&source->bytes, g_bytes_unref);
+    g_clear_object (&source->stream);
+    if (-1 not_eq source->fd)
+    {
+        (void) close (source->fd);
+    }
+    g_mutex_clear (&source->mutex);
+
+    g_free (source);
+}
+
+const uint8_t *
+ras_source_get_data (RasSource *source)
+{
+    g_return_val_if_fail (NULL != source, NULL);
+
+    return source->data;
+}
+
+uint64_t
+ras_source_get_size (RasSource *source)
+{
+    g_return_val_if_fail (NULL != source, RAS_SOURCE_SIZE_UNKNOWN);
+
+    return source->size;
+}
+
+bool
+ras_source_is_seekable (RasSource *source)
+{
+    g_return_val_if_fail (NULL != source, false);
+
+    return source->seekable;
+}
+
+RasStats *
+ras_source_get_stats (RasSource *source)
+{
+    g_return_val_if_fail (NULL != source, NULL);
+
+    return &source->stats;
+}
+
+static void
+set_truncated_error (GError **error)
+{
+    g_set_error_literal (error,
+                         RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED,
+                         "Truncated file");
+}
+
+static void
+set_errno_error (int      saved_errno,
+                 GError **error)
+{
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                 "Failed to read archive: %s", g_strerror (saved_errno));
+}
+
+/* Reads up to @length bytes at @offset, or at the current position if the
+ * descriptor cannot seek.
+ */
+static ssize_t
+read_fd (RasSource *source,
+         void      *buffer,
+         size_t     length,
+         uint64_t   offset)
+{
+    ssize_t result;
+
+    do
+    {
+        if (source->seekable)
+        {
+            result = pread (source->fd, buffer, length, source->base + offset);
+        }
+        else
+        {
+            result = read (source->fd, buffer, length);
+        }
+    } while (-1 == result && EINTR == errno);
+
+    return result;
+}
+
+static bool
+read_fd_all (RasSource     *source,
+             uint64_t       offset,
+             uint8_t       *buffer,
+             size_t         length,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+    while (length > 0)
+    {
+        ssize_t result;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return false;
+        }
+
+        result = read_fd (source, buffer, length, offset);
+        if (-1 == result)
+        {
+            set_errno_error (errno, error);
+
+            return false;
+        }
+        if (0 == result)
+        {
+            set_truncated_error (error);
+
+            return false;
+        }
+
+        buffer += result;
+        length -= result;
+        offset += result;
+    }
+
+    return true;
+}
+
+static bool
+read_stream_all (RasSource     *source,
+                 uint8_t       *buffer,
+                 size_t         length,
+                 GCancellable  *cancellable,
+                 GError       **error)
+{
+    size_t bytes_read;
+
+    if (!g_input_stream_read_all (source->stream, buffer, length,
+                                  &bytes_read, cancellable, error))
+    {
+        return false;
+    }
+    if (bytes_read < length)
+    {
+        set_truncated_error (error);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Positions a sequential source at @offset, which must not be behind it. */
+static bool
+seek_forward (RasSource     *source,
+              uint64_t       offset,
+              GCancellable  *cancellable,
+              GError       **error)
+{
+    g_autofree uint8_t *buffer = NULL;
+
+    if (offset < source->position)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Archive input is not seekable");
+
+        return false;
+    }
+
+    while (source->position < offset)
+    {
+        size_t length;
+
+        length = MIN (offset - source->position, SKIP_BUFFER_SIZE);
+
+        if (RAS_SOURCE_TYPE_STREAM == source->type)
+        {
+            gssize skipped;
+
+            skipped = g_input_stream_skip (source->stream, length, cancellable, error);
+            if (skipped < 0)
+            {
+                return false;
+            }
+            if (0 == skipped)
+            {
+                set_truncated_error (error);
+
+                return false;
+            }
+
+            source->position += skipped;
+
+            continue;
+        }
+
+        if (NULL == buffer)
+        {
+            buffer = g_malloc (SKIP_BUFFER_SIZE);
+        }
+
+        if (!read_fd_all (source, source->position, buffer, length, cancellable, error))
+        {
+            return false;
+        }
+
+        source->position += length;
+    }
+
+    return true;
+}
+
+static bool
+source_read (RasSource     *source,
+             uint64_t       offset,
+             void          *buffer,
+             size_t         length,
+             GCancellable  *cancellable,
+             GError       **error)
+{
+    bool success;
+
+    if (RAS_SOURCE_SIZE_UNKNOWN not_eq source->size
+        && (offset > source->size || source->size - offset < length))
+    {
+        set_truncated_error (error);
+
+        return false;
+    }
+
+    if (RAS_SOURCE_TYPE_BYTES == source->type)
+    {
+        memcpy (buffer, source->data + offset, length);
+
+        return true;
+    }
+    if (RAS_SOURCE_TYPE_FD == source->type && source->seekable)
+    {
+        return read_fd_all (source, offset, buffer, length, cancellable, error);
+    }
+
+    g_mutex_lock (&source->mutex);
+
+    if (source->seekable)
+    {
+        success = g_seekable_seek (G_SEEKABLE (source->stream), source->base + offset,
+                                   G_SEEK_SET, cancellable, error);
+    }
+    else
+    {
+        success = seek_forward (source, offset, cancellable, error);
+    }
+
+    if (success)
+    {
+        if (RAS_SOURCE_TYPE_STREAM == source->type)
+        {
+            success = read_stream_all (source, buffer, length, cancellable, error);
+        }
+        else
+        {
+            success = read_fd_all (source, offset, buffer, length, cancellable, error);
+        }
+    }
+
+    if (success)
+    {
+        source->position = offset + length;
+    }
+    else if (!source->seekable && offset >= source->position)
+    {
+        /* Some of the input may have been consumed, so there is no telling
+         * where the source is now.
+         */
+        source->position = G_MAXUINT64;
+    }
+
+    g_mutex_unlock (&source->mutex);
+
+    return success;
+}
+
+bool
+ras_source_read (RasSource     *source,
+                 uint64_t       offset,
+                 void          *buffer,
+                 size_t         length,
+                 GCancellable  *cancellable,
+                 GError       **error)
+{
+    uint64_t start;
+    uint64_t span;
+
+    g_return_val_if_fail (NULL != source, false);
+    g_return_val_if_fail (NULL != buffer || 0 == length, false);
+
+    start = ras_stats_get_time ();
+    span = ras_trace_begin ();
+
+    if (!source_read (source, offset, buffer, length, cancellable, error))
+    {
+        return false;
+    }
+
+    ras_trace_end (span, "read", NULL);
+    ras_stats_add (&source->stats, RAS_STAT_READ_TIME, ras_stats_get_time () - start);
+    ras_stats_add (&source->stats, RAS_STAT_BYTES_READ, length);
+
+    return true;
+}
+
+#ifdef __linux__
+typedef enum
+{
+    COPY_METHOD_COPY_FILE_RANGE,
+    COPY_METHOD_SPLICE,
+    COPY_METHOD_SENDFILE,
+} CopyMethod;
+
+static ssize_t
+copy_fd (CopyMethod  method,
+         int         input_fd,
+         off_t      *offset,
+         int         output_fd,
+         size_t      length)
+{
+    ssize_t result;
+
+    do
+    {
+        switch (method)
+        {
+            case COPY_METHOD_COPY_FILE_RANGE:
+                result = copy_file_range (input_fd, offset, output_fd, NULL, length, 0);
+                break;
+
+            case COPY_METHOD_SPLICE:
+                result = splice (input_fd, offset, output_fd, NULL, length, SPLICE_F_MORE);
+                break;
+
+            default:
+                result = sendfile (output_fd, input_fd, offset, length);
+                break;
+        }
+    } while (-1 == result && EINTR == errno);
+
+    return result;
+}
+
+static bool
+is_unsupported (int saved_errno)
+{
+    return EINVAL == saved_errno
+        || ENOSYS == saved_errno
+        || EOPNOTSUPP == saved_errno
+        || EXDEV == saved_errno;
+}
+
+static bool
+source_copy_to_fd (RasSource     *source,
+                   uint64_t       offset,
+                   int            fd,
+                   size_t         length,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+    struct stat st;
+    CopyMethod method;
+    off_t input_offset;
+    size_t copied;
+
+    if (-1 == fstat (fd, &st))
+    {
+        set_errno_error (errno, error);
+
+        return false;
+    }
+
+    /* Copies between files can share extents on filesystems that support
+     * it, while splice() needs a pipe on one end.
+     */
+    if (S_ISREG (st.st_mode))
+    {
+        method = COPY_METHOD_COPY_FILE_RANGE;
+    }
+    else if (S_ISFIFO (st.st_mode))
+    {
+        method = COPY_METHOD_SPLICE;
+    }
+    else
+    {
+        method = COPY_METHOD_SENDFILE;
+    }
+
+    input_offset = source->base + offset;
+    copied = 0;
+
+    while (copied < length)
+    {
+        ssize_t result;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return false;
+        }
+
+        result = copy_fd (method, source->fd, &input_offset, fd,
+                          MIN (length - copied, COPY_BLOCK_SIZE));
+        if (-1 == result)
+        {
+            int saved_errno;
+
+            saved_errno = errno;
+
+            /* copy_file_range() also refuses files opened for appending. */
+            if (0 == copied && COPY_METHOD_COPY_FILE_RANGE == method
+                && (is_unsupported (saved_errno) || EBADF == saved_errno))
+            {
+                method = COPY_METHOD_SENDFILE;
+
+                continue;
+            }
+
+            g_set_error (error,
+                         G_IO_ERROR,
+                         (0 == copied && is_unsupported (saved_errno))? G_IO_ERROR_NOT_SUPPORTED
+                                                                      : g_io_error_from_errno (saved_errno),
+                         "Failed to copy from archive: %s", g_strerror (saved_errno));
+
+            return false;
+        }
+        if (0 == result)
+        {
+            set_truncated_error (error);
+
+            return false;
+        }
+
+        copied += result;
+    }
+
+    return true;
+}
+#else
+static bool
+source_copy_to_fd (RasSource     *source,
+                   uint64_t       offset,
+                   int            fd,
+                   size_t         length,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+    g_set_error_literal (error,
+                         G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Kernel copies are not supported on this system");
+
+    return false;
+}
+#endif
+
+bool
+ras_source_copy_to_fd (RasSource     *source,
+                       uint64_t       offset,
+                       int            fd,
+                       size_t         length,
+                       GCancellable  *cancellable,
+                       GError       **error)
+{
+    uint64_t start;
+    uint64_t span;
+
+    g_return_val_if_fail (NULL != source, false);
+    g_return_val_if_fail (fd >= 0, false);
+
+    /* Descriptors that cannot seek are read under the lock, in order, so
+     * only those that can are worth the trouble.
+     */
+    if (RAS_SOURCE_TYPE_FD not_eq source->type || !source->seekable)
+    {
+        g_set_error_literal (error,
+                             G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Kernel copies need a seekable file descriptor");
+
+        return false;
+    }
+
+    if (RAS_SOURCE_SIZE_UNKNOWN not_eq source->size
+        && (offset > source->size || source->size - offset < length))
+    {
+        set_truncated_error (error);
+
+        return false;
+    }
+
+    start = ras_stats_get_time ();
+    span = ras_trace_begin ();
+
+    if (!source_copy_to_fd (source, offset, fd, length, cancellable, error))
+    {
+        return false;
+    }
+
+    ras_trace_end (span, "copy", NULL);
+    ras_stats_add (&source->stats, RAS_STAT_READ_TIME, ras_stats_get_time () - start);
+    ras_stats_add (&source->stats, RAS_STAT_BYTES_READ, length);
+
+    return true;
+}
+
+GBytes *
+ras_source_get_bytes (RasSource     *source,
+                      uint64_t       offset,
+                      size_t         length,
+                      GCancellable  *cancellable,
+                      GError       **error)
+{
+    g_autofree uint8_t *buffer = NULL;
+
+    g_return_val_if_fail (NULL != source, NULL);
+
+    if (RAS_SOURCE_TYPE_BYTES == source->type)
+    {
+        if (offset > source->size || source->size - offset < length)
+        {
+            set_truncated_error (error);
+
+            return NULL;
+        }
+
+        return g_bytes_new_from_bytes (source->bytes, offset, length);
+    }
+
+    buffer = g_malloc (length);
+
+    if (!ras_source_read (source, offset, buffer, length, cancellable, error))
+    {
+        return NULL;
+    }
+
+    return g_bytes_new_take (g_steal_pointer (&buffer), length);
+}
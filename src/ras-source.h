@@ -0,0 +1,78 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-stats.h"
+
+#include <gio/gio.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* Where archive data is read from: memory, a file descriptor or a stream.
+ *
+ * Sources that cannot seek only support reads at increasing offsets.
+ */
+typedef struct _RasSource RasSource;
+
+#define RAS_SOURCE_SIZE_UNKNOWN G_MAXUINT64
+
+RasSource     *ras_source_new_for_bytes  (GBytes        *bytes);
+RasSource     *ras_source_new_for_fd     (int            fd,
+                                          GError       **error);
+RasSource     *ras_source_new_for_stream (GInputStream  *stream);
+
+RasSource     *ras_source_ref            (RasSource     *source);
+void           ras_source_unref          (RasSource     *source);
+
+const uint8_t *ras_source_get_data       (RasSource     *source);
+uint64_t       ras_source_get_size       (RasSource     *source);
+bool           ras_source_is_seekable    (RasSource     *source);
+/* Counters for the archive and its files, which share the source. */
+RasStats      *ras_source_get_stats      (RasSource     *source);
+
+bool           ras_source_read           (RasSource     *source,
+                                          uint64_t       offset,
+                                          void          *buffer,
+                                          size_t         length,
+                                          GCancellable  *cancellable,
+                                          GError       **error);
+/* Copies from the archive to @fd without passing the data through user
+ * space, writing at the current position of @fd. Fails with
+ * %G_IO_ERROR_NOT_SUPPORTED, having written nothing, if neither the source
+ * nor @fd allow it.
+ */
+bool           ras_source_copy_to_fd     (RasSource     *source,
+                                          uint64_t       offset,
+                                          int            fd,
+                                          size_t         length,
+                                          GCancellable  *cancellable,
+                                          GError       **error);
+GBytes        *ras_source_get_bytes      (RasSource     *source,
+                                          uint64_t       offset,
+                                          size_t         length,
+                                          GCancellable  *cancellable,
+                                          GError       **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (RasSource, ras_source_unref)
+
+G_END_DECLS
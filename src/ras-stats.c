@@ -0,0 +1,99 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-stats.h"
+
+#include <time.h>
+
+uint64_t
+ras_stats_get_time (void)
+{
+    struct timespec now;
+
+    /* g_get_monotonic_time () only has microseconds, which is coarser than
+     * decrypting a block.
+     */
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * G_GUINT64_CONSTANT (1000000000) + now.tv_nsec;
+}
+
+void
+ras_stats_add (RasStats *stats,
+               RasStat   stat,
+               uint64_t  value)
+{
+    g_return_if_fail (NULL != stats);
+    g_return_if_fail (stat < RAS_N_STATS);
+
+    if (0 == value)
+    {
+        return;
+    }
+
+    (void) __atomic_fetch_add (&stats->counters[stat], value, __ATOMIC_RELAXED);
+}
+
+uint64_t
+ras_stats_get (RasStats *stats,
+               RasStat   stat)
+{
+    g_return_val_if_fail (NULL != stats, 0);
+    g_return_val_if_fail (stat < RAS_N_STATS, 0);
+
+    return __atomic_load_n (&stats->counters[stat], __ATOMIC_RELAXED);
+}
+
+void
+ras_stats_reset (RasStats *stats)
+{
+    g_return_if_fail (NULL != stats);
+
+    for (size_t i = 0; i < RAS_N_STATS; i++)
+    {
+        __atomic_store_n (&stats->counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+void
+ras_stats_mark (RasDecodeMark        *mark,
+                const RasLzssDecoder *decoder)
+{
+    g_return_if_fail (NULL != mark);
+    g_return_if_fail (NULL != decoder);
+
+    mark->time = ras_stats_get_time ();
+    mark->n_literals = decoder->n_literals;
+    mark->n_matches = decoder->n_matches;
+    mark->match_length = decoder->match_length;
+}
+
+void
+ras_stats_add_decode (RasStats             *stats,
+                      const RasDecodeMark  *mark,
+                      const RasLzssDecoder *decoder)
+{
+    g_return_if_fail (NULL != stats);
+    g_return_if_fail (NULL != mark);
+    g_return_if_fail (NULL != decoder);
+
+    ras_stats_add (stats, RAS_STAT_DECODE_TIME, ras_stats_get_time () - mark->time);
+    ras_stats_add (stats, RAS_STAT_LITERALS, decoder->n_literals - mark->n_literals);
+    ras_stats_add (stats, RAS_STAT_MATCHES, decoder->n_matches - mark->n_matches);
+    ras_stats_add (stats, RAS_STAT_MATCH_LENGTH, decoder->match_length - mark->match_length);
+}
@@ -0,0 +1,89 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-lzss.h"
+
+#include <glib.h>
+
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    RAS_STAT_BYTES_READ,
+    RAS_STAT_READ_TIME,
+    RAS_STAT_BYTES_DECRYPTED,
+    RAS_STAT_DECRYPT_TIME,
+    RAS_STAT_CRC_TIME,
+    RAS_STAT_TABLE_PARSE_TIME,
+    RAS_STAT_STORED_ENTRIES,
+    RAS_STAT_STORED_BYTES,
+    RAS_STAT_COMPRESSED_ENTRIES,
+    RAS_STAT_COMPRESSED_BYTES,
+    RAS_STAT_MAPPED_ENTRIES,
+    RAS_STAT_LITERALS,
+    RAS_STAT_MATCHES,
+    RAS_STAT_MATCH_LENGTH,
+    RAS_STAT_DECODE_TIME,
+    RAS_N_STATS,
+} RasStat;
+
+/* Counters shared by an archive and its files, which may be updated from
+ * any thread. Work is counted locally and added once per call, so that
+ * threads do not contend on every block or token.
+ */
+typedef struct
+{
+    /* 64 bits even on 32-bit targets, where nanoseconds would wrap in
+     * seconds.
+     */
+    uint64_t counters[RAS_N_STATS];
+} RasStats;
+
+/* Where a decoder was, to add what it did since to the counters. */
+typedef struct
+{
+    uint64_t time;
+    uint64_t n_literals;
+    uint64_t n_matches;
+    uint64_t match_length;
+} RasDecodeMark;
+
+/* Monotonic time in nanoseconds. */
+uint64_t ras_stats_get_time   (void);
+
+void     ras_stats_add        (RasStats             *stats,
+                               RasStat               stat,
+                               uint64_t              value);
+uint64_t ras_stats_get        (RasStats             *stats,
+                               RasStat               stat);
+void     ras_stats_reset      (RasStats             *stats);
+
+void     ras_stats_mark       (RasDecodeMark        *mark,
+                               const RasLzssDecoder *decoder);
+/* Adds the tokens that @decoder decoded and the time that passed since
+ * @mark.
+ */
+void     ras_stats_add_decode (RasStats             *stats,
+                               const RasDecodeMark  *mark,
+                               const RasLzssDecoder *decoder);
+
+G_END_DECLS
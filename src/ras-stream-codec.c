@@ -18,6 +18,8 @@
 
 #include "ras-stream-codec.h"
 
+#include "ras-cipher.h"
+
 #include <iso646.h>
 
 struct _RasStreamCodec
@@ -25,7 +27,7 @@ struct _RasStreamCodec
     GObject parent_instance;
 
     int32_t initial_seed;
-    int32_t seed;
+    RasKeystream keystream;
 };
 
 static GConverterResult
@@ -52,12 +54,20 @@ ras_stream_codec_convert (GConverter       *converter,
         return G_IO_ERROR_NO_SPACE;
     }
 
-    for (gsize i = 0; i < inbuf_size; i++)
+    for (gsize offset = 0; offset < inbuf_size; )
     {
-        self->seed = (self->seed * 0xAB) - ((self->seed / 0xB1) * 0x763D);
+        uint8_t keystream[RAS_CIPHER_BLOCK_SIZE];
+        gsize length;
+        uint64_t position;
+
+        length = MIN (inbuf_size - offset, sizeof (keystream));
+
+        position = self->keystream.position;
 
-        outbuf_c[i] = (inbuf_c[i] << (i % 5)) | (inbuf_c[i] >> (8 - (i % 5)));
-        outbuf_c[i] = (outbuf_c[i] ^ ((i + 3) * 6)) + (self->seed & 0xFF);
+        ras_keystream_generate (&self->keystream, keystream, length);
+        ras_cipher_decrypt (inbuf_c + offset, outbuf_c + offset, length, position, keystream);
+
+        offset += length;
     }
 
     if (NULL not_eq bytes_read)
@@ -84,7 +94,8 @@ ras_stream_codec_reset (GConverter *converter)
 
     self = RAS_STREAM_CODEC (converter);
 
-    self->seed = self->initial_seed;
+    ras_keystream_clear (&self->keystream);
+    ras_keystream_init (&self->keystream, self->initial_seed);
 }
 
 static void
@@ -99,9 +110,26 @@ G_DEFINE_TYPE_WITH_CODE (RasStreamCodec, ras_stream_codec,
                          G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
                                                 ras_stream_codec_iface_init))
 
+static void
+ras_stream_codec_finalize (GObject *object)
+{
+    RasStreamCodec *self;
+
+    self = RAS_STREAM_CODEC (object);
+
+    ras_keystream_clear (&self->keystream);
+
+    G_OBJECT_CLASS (ras_stream_codec_parent_class)->finalize (object);
+}
+
 static void
 ras_stream_codec_class_init (RasStreamCodecClass *klass)
 {
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = ras_stream_codec_finalize;
 }
 
 static void
@@ -116,13 +144,18 @@ ras_stream_codec_new (int32_t seed)
 
     codec = g_object_new (RAS_TYPE_STREAM_CODEC, NULL);
 
-    if (0 == seed)
-    {
-        seed = 1;
-    }
-
     codec->initial_seed = seed;
-    codec->seed = seed;
+
+    ras_keystream_init (&codec->keystream, seed);
 
     return codec;
 }
+
+void
+ras_stream_codec_seek (RasStreamCodec *self,
+                       uint64_t        offset)
+{
+    g_return_if_fail (RAS_IS_STREAM_CODEC (self));
+
+    ras_keystream_seek (&self->keystream, offset);
+}
@@ -25,6 +25,9 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (RasStreamCodec, ras_stream_codec, RAS, STREAM_CODEC, GObject)
 
-RasStreamCodec *ras_stream_codec_new (int32_t seed);
+void            ras_stream_codec_seek (RasStreamCodec *codec,
+                                       uint64_t        offset);
+
+RasStreamCodec *ras_stream_codec_new  (int32_t         seed);
 
 G_END_DECLS
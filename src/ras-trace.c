@@ -0,0 +1,323 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-trace.h"
+
+#include "ras-stats.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct
+{
+    const char *name;
+    char *detail;
+    uint64_t start;
+    uint64_t duration;
+} RasTraceEvent;
+
+/* Spans recorded by a thread. The lock is only contended while a trace is
+ * being written.
+ */
+typedef struct
+{
+    GMutex mutex;
+    unsigned int thread_id;
+    GArray *events;
+    /* Freed once the events have been written. */
+    bool exited;
+} RasTraceBuffer;
+
+static void buffer_thread_exited (void *data);
+
+static GMutex trace_mutex;
+static GPtrArray *trace_buffers;
+static char *trace_path;
+static int trace_enabled;
+static unsigned int next_thread_id;
+static GPrivate trace_buffer = G_PRIVATE_INIT (buffer_thread_exited);
+
+static void
+clear_event (void *data)
+{
+    RasTraceEvent *event;
+
+    event = data;
+
+    g_clear_pointer (&event->detail, g_free);
+}
+
+static void
+free_buffer (RasTraceBuffer *buffer)
+{
+    g_mutex_clear (&buffer->mutex);
+    g_array_unref (buffer->events);
+
+    g_free (buffer);
+}
+
+static void
+buffer_thread_exited (void *data)
+{
+    RasTraceBuffer *buffer;
+
+    buffer = data;
+
+    g_mutex_lock (&trace_mutex);
+    buffer->exited = true;
+    g_mutex_unlock (&trace_mutex);
+}
+
+static RasTraceBuffer *
+get_buffer (void)
+{
+    RasTraceBuffer *buffer;
+
+    buffer = g_private_get (&trace_buffer);
+    if (NULL != buffer)
+    {
+        return buffer;
+    }
+
+    buffer = g_new0 (RasTraceBuffer, 1);
+
+    g_mutex_init (&buffer->mutex);
+    buffer->events = g_array_new (false, false, sizeof (RasTraceEvent));
+    g_array_set_clear_func (buffer->events, clear_event);
+
+    g_mutex_lock (&trace_mutex);
+
+    if (NULL == trace_buffers)
+    {
+        trace_buffers = g_ptr_array_new ();
+    }
+
+    buffer->thread_id = ++next_thread_id;
+    g_ptr_array_add (trace_buffers, buffer);
+
+    g_mutex_unlock (&trace_mutex);
+
+    g_private_set (&trace_buffer, buffer);
+
+    return buffer;
+}
+
+static void
+stop_at_exit (void)
+{
+    g_autoptr (GError) error = NULL;
+
+    if (!ras_trace_stop (&error))
+    {
+        g_warning ("Failed to write trace: %s", error->message);
+    }
+}
+
+bool
+ras_trace_is_enabled (void)
+{
+    static size_t initialized = 0;
+
+    if (g_once_init_enter (&initialized))
+    {
+        const char *path;
+
+        path = g_getenv ("RAS_TRACE");
+        if (NULL != path && '\0' != *path)
+        {
+            ras_trace_start (path);
+
+            atexit (stop_at_exit);
+        }
+
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return g_atomic_int_get (&trace_enabled);
+}
+
+void
+ras_trace_start (const char *path)
+{
+    g_return_if_fail (NULL != path);
+
+    g_mutex_lock (&trace_mutex);
+
+    g_free (trace_path);
+    trace_path = g_strdup (path);
+
+    g_atomic_int_set (&trace_enabled, true);
+
+    g_mutex_unlock (&trace_mutex);
+}
+
+static void
+append_json_string (GString    *json,
+                    const char *string)
+{
+    g_string_append_c (json, '"');
+
+    for (const char *c = string; '\0' != *c; c++)
+    {
+        if ('"' == *c || '\\' == *c)
+        {
+            g_string_append_c (json, '\\');
+            g_string_append_c (json, *c);
+        }
+        else if ((unsigned char) *c < 0x20)
+        {
+            g_string_append_printf (json, "\\u%04x", (unsigned int) *c);
+        }
+        else
+        {
+            g_string_append_c (json, *c);
+        }
+    }
+
+    g_string_append_c (json, '"');
+}
+
+/* Microseconds with nanosecond precision, without going through the locale. */
+static void
+append_microseconds (GString  *json,
+                     uint64_t  nanoseconds)
+{
+    g_string_append_printf (json, "%" G_GUINT64_FORMAT ".%03u",
+                            nanoseconds / 1000, (unsigned int) (nanoseconds % 1000));
+}
+
+static void
+append_events (GString        *json,
+               RasTraceBuffer *buffer,
+               bool           *first)
+{
+    for (size_t i = 0; i < buffer->events->len; i++)
+    {
+        RasTraceEvent *event;
+
+        event = &g_array_index (buffer->events, RasTraceEvent, i);
+
+        g_string_append (json, *first? "\n" : ",\n");
+        g_string_append (json, "{\"name\": ");
+        append_json_string (json, event->name);
+        g_string_append_printf (json, ", \"cat\": \"ras\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": ",
+                                (int) getpid (), buffer->thread_id);
+        append_microseconds (json, event->start);
+        g_string_append (json, ", \"dur\": ");
+        append_microseconds (json, event->duration);
+        if (NULL != event->detail)
+        {
+            g_string_append (json, ", \"args\": {\"detail\": ");
+            append_json_string (json, event->detail);
+            g_string_append_c (json, '}');
+        }
+        g_string_append_c (json, '}');
+
+        *first = false;
+    }
+}
+
+bool
+ras_trace_stop (GError **error)
+{
+    g_autoptr (GString) json = NULL;
+    g_autofree char *path = NULL;
+    bool first;
+
+    g_mutex_lock (&trace_mutex);
+
+    if (!g_atomic_int_get (&trace_enabled))
+    {
+        g_mutex_unlock (&trace_mutex);
+
+        return true;
+    }
+
+    g_atomic_int_set (&trace_enabled, false);
+
+    path = g_steal_pointer (&trace_path);
+    json = g_string_new ("{\"traceEvents\": [");
+    first = true;
+
+    for (size_t i = 0; NULL != trace_buffers && i < trace_buffers->len; )
+    {
+        RasTraceBuffer *buffer;
+
+        buffer = g_ptr_array_index (trace_buffers, i);
+
+        g_mutex_lock (&buffer->mutex);
+        append_events (json, buffer, &first);
+        g_array_set_size (buffer->events, 0);
+        g_mutex_unlock (&buffer->mutex);
+
+        if (buffer->exited)
+        {
+            g_ptr_array_remove_index_fast (trace_buffers, i);
+            free_buffer (buffer);
+
+            continue;
+        }
+
+        i++;
+    }
+
+    g_mutex_unlock (&trace_mutex);
+
+    g_string_append (json, "\n], \"displayTimeUnit\": \"ns\"}\n");
+
+    return g_file_set_contents (path, json->str, json->len, error);
+}
+
+uint64_t
+ras_trace_begin (void)
+{
+    if (!ras_trace_is_enabled ())
+    {
+        return 0;
+    }
+
+    return ras_stats_get_time ();
+}
+
+void
+ras_trace_end (uint64_t    start,
+               const char *name,
+               const char *detail)
+{
+    RasTraceBuffer *buffer;
+    RasTraceEvent event;
+
+    g_return_if_fail (NULL != name);
+
+    /* Spans that started before tracing did, or end after it stopped. */
+    if (0 == start || !g_atomic_int_get (&trace_enabled))
+    {
+        return;
+    }
+
+    buffer = get_buffer ();
+
+    event.name = name;
+    event.detail = g_strdup (detail);
+    event.start = start;
+    event.duration = ras_stats_get_time () - start;
+
+    g_mutex_lock (&buffer->mutex);
+    g_array_append_val (buffer->events, event);
+    g_mutex_unlock (&buffer->mutex);
+}
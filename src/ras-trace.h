@@ -0,0 +1,63 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+/* Timelines of loading and extraction in the Chrome trace event format, for
+ * chrome://tracing or Perfetto. Tracing starts if the RAS_TRACE environment
+ * variable is set to the path to write the trace to at exit.
+ */
+
+/**
+ * ras_trace_start:
+ * @path: where ras_trace_stop() writes the trace
+ *
+ * Starts recording spans from every thread.
+ */
+void     ras_trace_start      (const char  *path);
+/**
+ * ras_trace_stop:
+ * @error: return location for a #GError
+ *
+ * Stops recording and writes what was recorded since ras_trace_start().
+ *
+ * Returns: whether the trace was written, or %TRUE if tracing was not
+ * started
+ */
+bool     ras_trace_stop       (GError     **error);
+bool     ras_trace_is_enabled (void);
+
+/* Returns the start of a span for ras_trace_end(), or 0 if tracing is not
+ * enabled, which is all that it costs then.
+ */
+uint64_t ras_trace_begin      (void);
+/* Records a span on the calling thread. @name must outlive the trace, and
+ * @detail, which is shown as an argument, is copied.
+ */
+void     ras_trace_end        (uint64_t     start,
+                               const char  *name,
+                               const char  *detail);
+
+G_END_DECLS
@@ -22,14 +22,16 @@
 
 G_BEGIN_DECLS
 
-#define RAS_TYPE_BUFFER ras_buffer_get_type ()
 #define RAS_TYPE_DIRECTORY ras_directory_get_type ()
 #define RAS_TYPE_FILE ras_file_get_type ()
+#define RAS_TYPE_FILE_INPUT_STREAM ras_file_input_stream_get_type ()
 #define RAS_TYPE_STREAM_CODEC ras_stream_codec_get_type ()
+#define RAS_TYPE_VFS_FILE ras_vfs_file_get_type ()
 
-typedef struct _RasBuffer RasBuffer;
 typedef struct _RasDirectory RasDirectory;
 typedef struct _RasFile RasFile;
+typedef struct _RasFileInputStream RasFileInputStream;
 typedef struct _RasStreamCodec RasStreamCodec;
+typedef struct _RasVfsFile RasVfsFile;
 
 G_END_DECLS
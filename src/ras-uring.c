@@ -0,0 +1,607 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-uring.h"
+
+#include "ras-archive.h"
+#include "ras-file.h"
+#include "ras-trace.h"
+
+#include <iso646.h>
+
+#ifdef HAVE_LIBURING
+#include <errno.h>
+#include <fcntl.h>
+#include <liburing.h>
+#include <unistd.h>
+
+enum
+{
+    OP_OPEN,
+    OP_WRITE,
+    OP_CLOSE,
+    /* Of the temporary file that replaces an existing one. */
+    OP_RENAME,
+    OP_UNLINK,
+    N_OPS,
+};
+
+/* Requests in the chain that writes a file. */
+#define N_CHAIN_OPS 3
+
+/* A file being written, which holds the direct descriptor of the same index
+ * while its requests are in flight.
+ */
+typedef struct
+{
+    RasFile *file;
+    char *name;
+    /* What is written first when replacing files, then renamed to @name. */
+    char *temporary_name;
+    uint32_t directory_index;
+    uint8_t *data;
+    size_t size;
+
+    unsigned int pending;
+    bool chain_done;
+    /* The first request of the file to fail and how, as a negative errno. */
+    unsigned int failed_op;
+    int result;
+
+    uint64_t span;
+} RasUringSlot;
+
+typedef struct
+{
+    struct io_uring ring;
+
+    RasUringSlot slots[RAS_URING_DEPTH];
+    unsigned int free_slots[RAS_URING_DEPTH];
+    unsigned int free_count;
+
+    GFile **directories;
+    int *directory_fds;
+    size_t directory_count;
+
+    bool overwrite;
+    RasUringFileDone done;
+    void *user_data;
+    bool stopped;
+
+    /* Files given to the ring, and how many of them were submitted. */
+    size_t queued_count;
+    size_t submitted_count;
+
+    /* Requests submitted but not completed, which may still be using the
+     * slots.
+     */
+    size_t in_flight;
+    /* Set if waiting for them failed, so that the slots are never freed. */
+    bool abandoned;
+} RasUringWriter;
+
+static bool
+probe (void)
+{
+    struct io_uring ring;
+    bool supported;
+
+    if (io_uring_queue_init (N_OPS, &ring, 0) < 0)
+    {
+        return false;
+    }
+
+    /* Sparse file tables came after direct descriptors for openat() and
+     * close(), in Linux 5.19.
+     */
+    supported = 0 == io_uring_register_files_sparse (&ring, RAS_URING_DEPTH);
+
+    io_uring_queue_exit (&ring);
+
+    return supported;
+}
+
+bool
+ras_uring_is_supported (void)
+{
+    static size_t supported = 0;
+
+    if (g_once_init_enter (&supported))
+    {
+        g_once_init_leave (&supported, probe ()? 2 : 1);
+    }
+
+    return 2 == supported;
+}
+
+static void
+clear_slot (RasUringSlot *slot)
+{
+    g_clear_pointer (&slot->name, g_free);
+    g_clear_pointer (&slot->temporary_name, g_free);
+    g_clear_pointer (&slot->data, g_free);
+
+    slot->file = NULL;
+}
+
+static void
+set_error_from_result (RasUringWriter  *writer,
+                       RasUringSlot    *slot,
+                       GError         **error)
+{
+    g_autofree char *directory_path = NULL;
+    g_autofree char *path = NULL;
+    const char *format;
+
+    directory_path = g_file_get_path (writer->directories[slot->directory_index]);
+    path = g_build_filename (directory_path, slot->name, NULL);
+
+    switch (slot->failed_op)
+    {
+        case OP_OPEN:
+            format = "Error opening file “%s”: %s";
+            break;
+
+        case OP_WRITE:
+            format = "Error writing to file “%s”: %s";
+            break;
+
+        case OP_RENAME:
+            format = "Error renaming temporary file to “%s”: %s";
+            break;
+
+        default:
+            format = "Error closing file “%s”: %s";
+            break;
+    }
+
+    g_set_error (error,
+                 G_IO_ERROR, g_io_error_from_errno (-slot->result),
+                 format, path, g_strerror (-slot->result));
+}
+
+static bool
+queue_file (RasUringWriter  *writer,
+            RasFile         *file,
+            GError         **error)
+{
+    unsigned int index;
+    RasUringSlot *slot;
+    struct io_uring_sqe *sqe;
+    int flags;
+
+    index = writer->free_slots[writer->free_count - 1];
+    slot = &writer->slots[index];
+
+    slot->file = file;
+    slot->name = ras_file_get_name (file);
+    slot->directory_index = ras_file_get_directory_index (file);
+    slot->size = ras_file_get_size (file);
+    slot->data = g_malloc (slot->size);
+    slot->pending = N_CHAIN_OPS;
+    slot->chain_done = false;
+    slot->result = 0;
+    slot->span = ras_trace_begin ();
+
+    if (slot->directory_index >= writer->directory_count)
+    {
+        g_set_error (error,
+                     RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED,
+                     "Entry %s has an invalid directory index", slot->name);
+
+        clear_slot (slot);
+
+        return false;
+    }
+
+    if (!ras_file_decode_into (file, slot->data, slot->size, error))
+    {
+        clear_slot (slot);
+
+        return false;
+    }
+
+    writer->free_count--;
+
+    /* Existing files are replaced by renaming over them once written, as
+     * g_file_replace() does, so that they survive failures.
+     */
+    if (writer->overwrite)
+    {
+        slot->temporary_name = g_strdup_printf (".%s.%08x", slot->name, g_random_int ());
+    }
+
+    flags = O_WRONLY | O_CREAT | O_EXCL;
+
+    /* A failed open cancels the rest of the chain, but a failed write still
+     * has to close the file.
+     */
+    sqe = io_uring_get_sqe (&writer->ring);
+    io_uring_prep_openat_direct (sqe, writer->directory_fds[slot->directory_index],
+                                 writer->overwrite? slot->temporary_name : slot->name,
+                                 flags, 0666, index);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe->user_data = index * N_OPS + OP_OPEN;
+
+    sqe = io_uring_get_sqe (&writer->ring);
+    io_uring_prep_write (sqe, index, slot->data, slot->size, 0);
+    sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->user_data = index * N_OPS + OP_WRITE;
+
+    sqe = io_uring_get_sqe (&writer->ring);
+    io_uring_prep_close_direct (sqe, index);
+    sqe->user_data = index * N_OPS + OP_CLOSE;
+
+    return true;
+}
+
+static void
+complete (RasUringWriter       *writer,
+          struct io_uring_cqe  *cqe,
+          GError              **error)
+{
+    unsigned int index;
+    unsigned int op;
+    RasUringSlot *slot;
+
+    index = cqe->user_data / N_OPS;
+    op = cqe->user_data % N_OPS;
+    slot = &writer->slots[index];
+
+    /* Cancellations follow from the failure before them. */
+    if (0 == slot->result && cqe->res < 0 && -ECANCELED not_eq cqe->res)
+    {
+        slot->failed_op = op;
+        slot->result = cqe->res;
+    }
+    else if (0 == slot->result && OP_WRITE == op && (size_t) cqe->res not_eq slot->size)
+    {
+        slot->failed_op = op;
+        slot->result = -ENOSPC;
+    }
+
+    if (--slot->pending > 0)
+    {
+        return;
+    }
+
+    /* The temporary file is renamed if it was written and removed if it was
+     * created but not written.
+     */
+    if (writer->overwrite && !slot->chain_done
+        && (0 == slot->result || OP_OPEN not_eq slot->failed_op))
+    {
+        int directory_fd;
+        struct io_uring_sqe *sqe;
+
+        directory_fd = writer->directory_fds[slot->directory_index];
+        sqe = io_uring_get_sqe (&writer->ring);
+
+        if (0 == slot->result)
+        {
+            io_uring_prep_renameat (sqe, directory_fd, slot->temporary_name,
+                                    directory_fd, slot->name, 0);
+            sqe->user_data = index * N_OPS + OP_RENAME;
+        }
+        else
+        {
+            io_uring_prep_unlinkat (sqe, directory_fd, slot->temporary_name, 0);
+            sqe->user_data = index * N_OPS + OP_UNLINK;
+        }
+
+        slot->pending = 1;
+        slot->chain_done = true;
+
+        return;
+    }
+
+    if (0 not_eq slot->result)
+    {
+        if (NULL == *error)
+        {
+            set_error_from_result (writer, slot, error);
+        }
+    }
+    else
+    {
+        ras_trace_end (slot->span, "extract", slot->name);
+
+        if (NULL != writer->done && !writer->done (slot->file, writer->user_data))
+        {
+            writer->stopped = true;
+        }
+    }
+
+    clear_slot (slot);
+
+    writer->free_slots[writer->free_count++] = index;
+}
+
+/* Keeps up to RAS_URING_DEPTH files in flight until all have been written or
+ * one has failed, then waits for the rest.
+ */
+static void
+run (RasUringWriter  *writer,
+     RasFile        **files,
+     size_t           file_count,
+     GCancellable    *cancellable,
+     GError         **error)
+{
+    size_t next_file;
+
+    next_file = 0;
+
+    for (;;)
+    {
+        int result;
+        struct io_uring_cqe *cqe;
+        unsigned int head;
+        unsigned int cqe_count;
+
+        while (writer->free_count > 0 && next_file < file_count
+               && !writer->stopped && NULL == *error)
+        {
+            if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            {
+                break;
+            }
+
+            if (queue_file (writer, files[next_file++], error))
+            {
+                writer->queued_count++;
+            }
+        }
+
+        if (RAS_URING_DEPTH == writer->free_count)
+        {
+            break;
+        }
+
+        result = io_uring_submit_and_wait (&writer->ring, 1);
+        if (result > 0)
+        {
+            writer->in_flight += result;
+            writer->submitted_count = writer->queued_count;
+        }
+        if (-EINTR == result)
+        {
+            continue;
+        }
+        else if (result < 0)
+        {
+            if (NULL == *error)
+            {
+                g_set_error (error,
+                             G_IO_ERROR, g_io_error_from_errno (-result),
+                             "Failed to submit requests: %s", g_strerror (-result));
+            }
+
+            break;
+        }
+
+        cqe_count = 0;
+
+        io_uring_for_each_cqe (&writer->ring, head, cqe)
+        {
+            complete (writer, cqe, error);
+
+            cqe_count++;
+        }
+        writer->in_flight -= cqe_count;
+
+        io_uring_cq_advance (&writer->ring, cqe_count);
+    }
+}
+
+/* Waits for the requests that were submitted before submission failed. */
+static void
+drain (RasUringWriter *writer)
+{
+    while (writer->in_flight > 0)
+    {
+        struct io_uring_cqe *cqe;
+        int result;
+
+        result = io_uring_wait_cqe (&writer->ring, &cqe);
+        if (-EINTR == result)
+        {
+            continue;
+        }
+        else if (result < 0)
+        {
+            writer->abandoned = true;
+
+            return;
+        }
+
+        io_uring_cqe_seen (&writer->ring, cqe);
+
+        writer->in_flight--;
+    }
+}
+
+static bool
+open_directories (RasUringWriter  *writer,
+                  GError         **error)
+{
+    for (size_t i = 0; i < writer->directory_count; i++)
+    {
+        g_autofree char *path = NULL;
+
+        path = g_file_get_path (writer->directories[i]);
+        if (NULL == path)
+        {
+            g_set_error_literal (error,
+                                 G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                 "Extraction with io_uring needs local directories");
+
+            return false;
+        }
+
+        writer->directory_fds[i] = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (-1 == writer->directory_fds[i])
+        {
+            int errsv;
+
+            errsv = errno;
+
+            g_set_error (error,
+                         G_IO_ERROR, g_io_error_from_errno (errsv),
+                         "Error opening directory “%s”: %s", path, g_strerror (errsv));
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+ras_uring_extract (RasFile           **files,
+                   size_t              file_count,
+                   GFile             **directories,
+                   size_t              directory_count,
+                   bool                overwrite,
+                   RasUringFileDone    done,
+                   void               *user_data,
+                   size_t             *n_started,
+                   GCancellable       *cancellable,
+                   GError            **error)
+{
+    g_autofree RasUringWriter *writer = NULL;
+    int result;
+    GError *local_error = NULL;
+
+    g_return_val_if_fail (NULL != files || 0 == file_count, false);
+    g_return_val_if_fail (NULL != directories || 0 == directory_count, false);
+
+    writer = g_new0 (RasUringWriter, 1);
+
+    if (NULL != n_started)
+    {
+        *n_started = 0;
+    }
+
+    result = io_uring_queue_init (RAS_URING_DEPTH * N_CHAIN_OPS, &writer->ring, 0);
+    if (result < 0)
+    {
+        g_set_error (error,
+                     G_IO_ERROR, g_io_error_from_errno (-result),
+                     "Failed to set up io_uring: %s", g_strerror (-result));
+
+        return false;
+    }
+
+    result = io_uring_register_files_sparse (&writer->ring, RAS_URING_DEPTH);
+    if (result < 0)
+    {
+        g_set_error (error,
+                     G_IO_ERROR, g_io_error_from_errno (-result),
+                     "Failed to set up io_uring: %s", g_strerror (-result));
+
+        io_uring_queue_exit (&writer->ring);
+
+        return false;
+    }
+
+    for (writer->free_count = 0; writer->free_count < RAS_URING_DEPTH; writer->free_count++)
+    {
+        writer->free_slots[writer->free_count] = writer->free_count;
+    }
+    writer->directories = directories;
+    writer->directory_fds = g_new (int, directory_count);
+    writer->directory_count = directory_count;
+    writer->overwrite = overwrite;
+    writer->done = done;
+    writer->user_data = user_data;
+
+    for (size_t i = 0; i < directory_count; i++)
+    {
+        writer->directory_fds[i] = -1;
+    }
+
+    if (open_directories (writer, &local_error))
+    {
+        run (writer, files, file_count, cancellable, &local_error);
+    }
+
+    /* Tearing the ring down does not wait for requests in flight, which
+     * still refer to the data of the slots.
+     */
+    drain (writer);
+
+    io_uring_queue_exit (&writer->ring);
+
+    for (size_t i = 0; i < RAS_URING_DEPTH && !writer->abandoned; i++)
+    {
+        clear_slot (&writer->slots[i]);
+    }
+    for (size_t i = 0; i < directory_count; i++)
+    {
+        if (-1 not_eq writer->directory_fds[i])
+        {
+            close (writer->directory_fds[i]);
+        }
+    }
+    g_free (writer->directory_fds);
+
+    if (NULL != n_started)
+    {
+        *n_started = writer->submitted_count;
+    }
+
+    if (NULL != local_error)
+    {
+        g_propagate_error (error, local_error);
+
+        return false;
+    }
+
+    return true;
+}
+#else
+bool
+ras_uring_is_supported (void)
+{
+    return false;
+}
+
+bool
+ras_uring_extract (RasFile           **files,
+                   size_t              file_count,
+                   GFile             **directories,
+                   size_t              directory_count,
+                   bool                overwrite,
+                   RasUringFileDone    done,
+                   void               *user_data,
+                   size_t             *n_started,
+                   GCancellable       *cancellable,
+                   GError            **error)
+{
+    if (NULL != n_started)
+    {
+        *n_started = 0;
+    }
+
+    g_set_error_literal (error,
+                         G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "libras was built without io_uring support");
+
+    return false;
+}
+#endif
@@ -0,0 +1,77 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "ras-types.h"
+
+#include <gio/gio.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+G_BEGIN_DECLS
+
+/* Extraction of small files with io_uring, which opens, writes and closes
+ * each of them with one chain of requests instead of three system calls.
+ * Only available if libras was built with liburing.
+ */
+
+/* Files up to this size are decoded whole and written with one request. */
+#define RAS_URING_MAX_FILE_SIZE 0x10000
+/* The number of files being written at once. */
+#define RAS_URING_DEPTH 64
+
+/* Called as each file has been written. Returning %FALSE stops further files
+ * from being started.
+ */
+typedef bool (*RasUringFileDone) (RasFile *file,
+                                  void    *user_data);
+
+/* Whether the kernel supports what ras_uring_extract() needs. */
+bool ras_uring_is_supported (void);
+
+/**
+ * ras_uring_extract:
+ * @files: the files to extract
+ * @file_count: the number of @files
+ * @directories: (array length=directory_count): local directories, indexed
+ *               by the directory indices of @files
+ * @directory_count: the number of @directories
+ * @overwrite: whether to replace existing files
+ * @done: (nullable): called as each file has been written
+ * @user_data: data for @done
+ * @n_started: (out) (optional): the number of @files whose requests were
+ *             submitted, which is 0 if io_uring could not be set up
+ * @cancellable: (nullable): a #GCancellable
+ * @error: return location for a #GError
+ *
+ * Files that have been started are finished even if a later one fails.
+ */
+bool ras_uring_extract      (RasFile           **files,
+                             size_t              file_count,
+                             GFile             **directories,
+                             size_t              directory_count,
+                             bool                overwrite,
+                             RasUringFileDone    done,
+                             void               *user_data,
+                             size_t             *n_started,
+                             GCancellable       *cancellable,
+                             GError            **error);
+
+G_END_DECLS
@@ -18,21 +18,206 @@
 
 #include "ras-utils.h"
 
+#include "ras-cipher.h"
+
+#include <iso646.h>
+
 void
 ras_decrypt_with_seed (size_t  size,
                        uint8_t buffer[static size],
                        int32_t seed)
 {
-    if (seed == 0)
+    RasKeystream keystream;
+
+    ras_keystream_init (&keystream, seed);
+
+    for (size_t offset = 0; offset < size; )
+    {
+        uint8_t key[RAS_CIPHER_BLOCK_SIZE];
+        size_t length;
+
+        length = MIN (size - offset, sizeof (key));
+
+        ras_keystream_generate (&keystream, key, length);
+        ras_cipher_decrypt (buffer + offset, buffer + offset, length, offset, key);
+
+        offset += length;
+    }
+
+    ras_keystream_clear (&keystream);
+}
+
+void
+ras_encrypt_with_seed (size_t  size,
+                       uint8_t buffer[static size],
+                       int32_t seed)
+{
+    RasKeystream keystream;
+
+    ras_keystream_init (&keystream, seed);
+
+    for (size_t offset = 0; offset < size; )
+    {
+        uint8_t key[RAS_CIPHER_BLOCK_SIZE];
+        size_t length;
+
+        length = MIN (size - offset, sizeof (key));
+
+        ras_keystream_generate (&keystream, key, length);
+        ras_cipher_encrypt (buffer + offset, buffer + offset, length, offset, key);
+
+        offset += length;
+    }
+
+    ras_keystream_clear (&keystream);
+}
+
+static bool
+is_separator (char c)
+{
+    return '/' == c || '\\' == c;
+}
+
+/* Returns the next character of a normalized path, with separators reported
+ * as “\\”, or “\0” at the end.
+ */
+static char
+next_path_char (const char **path)
+{
+    const char *p;
+
+    p = *path;
+
+    if (is_separator (*p))
     {
-        seed = 1;
+        while (is_separator (*p))
+        {
+            p++;
+        }
+
+        *path = p;
+
+        /* Trailing separators are ignored as well. */
+        return '\0' == *p? '\0' : '\\';
     }
 
-    for (gsize i = 0; i < size; i++)
+    if ('\0' == *p)
     {
-        seed = (seed * 171) - ((seed / 177) * 30269);
+        return '\0';
+    }
+
+    *path = p + 1;
 
-        buffer[i] = (buffer[i] << (i % 5)) | (buffer[i] >> (8 - (i % 5)));
-        buffer[i] = (buffer[i] ^ ((i + 3) * 6)) + (seed & 0xFF);
+    return g_ascii_tolower (*p);
+}
+
+static const char *
+skip_separators (const char *path)
+{
+    while (is_separator (*path))
+    {
+        path++;
     }
+
+    return path;
+}
+
+unsigned int
+ras_path_hash (const void *path)
+{
+    const char *p;
+    unsigned int hash;
+    char c;
+
+    p = skip_separators (path);
+    hash = 5381;
+
+    while ((c = next_path_char (&p)) not_eq '\0')
+    {
+        hash = (hash << 5) + hash + (unsigned char) c;
+    }
+
+    return hash;
+}
+
+int
+ras_path_equal (const void *a,
+                const void *b)
+{
+    const char *p;
+    const char *q;
+    char c;
+
+    p = skip_separators (a);
+    q = skip_separators (b);
+
+    do
+    {
+        c = next_path_char (&p);
+
+        if (c not_eq next_path_char (&q))
+        {
+            return false;
+        }
+    } while (c not_eq '\0');
+
+    return true;
+}
+
+char *
+ras_path_normalize (const char *path)
+{
+    g_auto (GStrv) components = NULL;
+    g_autoptr (GPtrArray) parts = NULL;
+
+    components = g_strsplit_set (path, "/\\", -1);
+    parts = g_ptr_array_new ();
+
+    for (size_t i = 0; NULL != components[i]; i++)
+    {
+        if ('\0' not_eq *components[i])
+        {
+            g_ptr_array_add (parts, components[i]);
+        }
+    }
+
+    if (0 == parts->len)
+    {
+        return NULL;
+    }
+
+    g_ptr_array_add (parts, NULL);
+
+    return g_strjoinv ("\\", (char **) parts->pdata);
+}
+
+void
+ras_append_system_time (GByteArray *table,
+                        GDateTime  *date_time)
+{
+    uint16_t fields[8] = { 0 };
+
+    if (NULL != date_time)
+    {
+        g_autoptr (GDateTime) utc = NULL;
+
+        utc = g_date_time_to_utc (date_time);
+
+        fields[0] = g_date_time_get_year (utc);
+        fields[1] = g_date_time_get_month (utc);
+        /* Sunday is 0. */
+        fields[2] = g_date_time_get_day_of_week (utc) % 7;
+        fields[3] = g_date_time_get_day_of_month (utc);
+        fields[4] = g_date_time_get_hour (utc);
+        fields[5] = g_date_time_get_minute (utc);
+        fields[6] = g_date_time_get_second (utc);
+        fields[7] = g_date_time_get_microsecond (utc) / 1000;
+    }
+
+    for (size_t i = 0; G_N_ELEMENTS (fields) > i; i++)
+    {
+        fields[i] = GUINT16_TO_LE (fields[i]);
+    }
+
+    g_byte_array_append (table, (const uint8_t *) fields, sizeof (fields));
 }
@@ -21,6 +21,7 @@
 
 #include <glib.h>
 
+#include <stdbool.h>
 #include <stdint.h>
 
 G_BEGIN_DECLS
@@ -34,6 +35,52 @@ G_BEGIN_DECLS
 void ras_decrypt_with_seed (size_t        size,
                             unsigned char buffer[static size],
                             int32_t       seed);
+/**
+ * ras_encrypt_with_seed:
+ * @size: size of the buffer to encrypt
+ * @buffer: the buffer, holding the data to encrypt
+ * @seed: encryption seed
+ */
+void ras_encrypt_with_seed (size_t        size,
+                            unsigned char buffer[static size],
+                            int32_t       seed);
+
+/**
+ * ras_path_hash:
+ * @path: a path inside an archive
+ *
+ * Hashes @path the way Windows compares paths: ASCII letters are folded to
+ * lower case, “/” and “\\” are equivalent, and leading or repeated separators
+ * are ignored.
+ */
+unsigned int ras_path_hash  (const void *path);
+/**
+ * ras_path_equal:
+ * @a: a path inside an archive
+ * @b: a path inside an archive
+ *
+ * Compares paths like ras_path_hash() hashes them.
+ */
+int          ras_path_equal (const void *a,
+                             const void *b);
+/**
+ * ras_path_normalize:
+ * @path: a path inside an archive
+ *
+ * Returns: (transfer full) (nullable): the components of @path joined with
+ * “\\”, or %NULL if there are none
+ */
+char        *ras_path_normalize (const char *path);
+
+/**
+ * ras_append_system_time:
+ * @table: the table to append to
+ * @date_time: (nullable): the time to append
+ *
+ * Appends @date_time as a SYSTEMTIME, or zeroes for %NULL.
+ */
+void         ras_append_system_time (GByteArray *table,
+                                     GDateTime  *date_time);
 
 G_END_DECLS
 
@@ -0,0 +1,698 @@
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
+ *
+ * This file is part of libras.
+ *
+ * libras is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libras is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libras.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ras-vfs-file.h"
+
+#include "ras-directory.h"
+#include "ras-file.h"
+#include "ras-utils.h"
+
+#include <iso646.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define RAS_URI_SCHEME "ras"
+
+struct _RasVfsFile
+{
+    GObject parent_instance;
+
+    RasArchive *archive;
+    /* Components separated by “/”, without leading or trailing ones. */
+    char *path;
+};
+
+static void ras_vfs_file_iface_init (GFileIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (RasVfsFile, ras_vfs_file, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_FILE, ras_vfs_file_iface_init))
+
+#define RAS_TYPE_VFS_FILE_ENUMERATOR ras_vfs_file_enumerator_get_type ()
+
+G_DECLARE_FINAL_TYPE (RasVfsFileEnumerator, ras_vfs_file_enumerator,
+                      RAS, VFS_FILE_ENUMERATOR, GFileEnumerator)
+
+struct _RasVfsFileEnumerator
+{
+    GFileEnumerator parent_instance;
+
+    /* Kept alive by the container. */
+    RasDirectory *directory;
+    GFileAttributeMatcher *matcher;
+    /* Subdirectories come first, then files. */
+    size_t index;
+};
+
+G_DEFINE_TYPE (RasVfsFileEnumerator, ras_vfs_file_enumerator, G_TYPE_FILE_ENUMERATOR)
+
+static GFileInfo *
+create_file_info (const char            *name,
+                  RasDirectory          *directory,
+                  RasFile               *file,
+                  GFileAttributeMatcher *matcher)
+{
+    GFileInfo *info;
+    g_autofree char *display_name = NULL;
+    GDateTime *date_time;
+
+    info = g_file_info_new ();
+
+    g_file_info_set_attribute_mask (info, matcher);
+
+    display_name = g_utf8_make_valid (name, -1);
+
+    g_file_info_set_name (info, name);
+    g_file_info_set_display_name (info, display_name);
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, true);
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, false);
+
+    if (NULL != directory)
+    {
+        g_file_info_set_file_type (info, G_FILE_TYPE_DIRECTORY);
+        g_file_info_set_content_type (info, "inode/directory");
+
+        date_time = ras_directory_get_creation_date_time (directory);
+    }
+    else
+    {
+        g_file_info_set_file_type (info, G_FILE_TYPE_REGULAR);
+        g_file_info_set_size (info, ras_file_get_size (file));
+
+        if (g_file_attribute_matcher_matches (matcher, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE))
+        {
+            g_autofree char *content_type = NULL;
+
+            content_type = g_content_type_guess (name, NULL, 0, NULL);
+
+            g_file_info_set_content_type (info, content_type);
+        }
+
+        date_time = ras_file_get_creation_date_time (file);
+    }
+
+    if (NULL != date_time)
+    {
+        g_file_info_set_modification_date_time (info, date_time);
+    }
+
+    g_file_info_unset_attribute_mask (info);
+
+    return info;
+}
+
+static GFileInfo *
+ras_vfs_file_enumerator_next_file (GFileEnumerator  *enumerator,
+                                   GCancellable     *cancellable,
+                                   GError          **error)
+{
+    RasVfsFileEnumerator *self;
+    size_t child_count;
+    size_t index;
+
+    self = RAS_VFS_FILE_ENUMERATOR (enumerator);
+    child_count = ras_directory_get_child_count (self->directory);
+    index = self->index;
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        return NULL;
+    }
+
+    if (index < child_count)
+    {
+        RasDirectory *child;
+        g_autofree char *name = NULL;
+
+        child = ras_directory_get_child (self->directory, index);
+        name = ras_directory_get_basename (child);
+
+        self->index++;
+
+        return create_file_info (name, child, NULL, self->matcher);
+    }
+
+    index -= child_count;
+
+    if (index < ras_directory_get_file_count (self->directory))
+    {
+        RasFile *file;
+        g_autofree char *name = NULL;
+
+        file = ras_directory_get_file (self->directory, index);
+        name = ras_file_get_name (file);
+
+        self->index++;
+
+        return create_file_info (name, NULL, file, self->matcher);
+    }
+
+    return NULL;
+}
+
+static gboolean
+ras_vfs_file_enumerator_close (GFileEnumerator  *enumerator,
+                               GCancellable     *cancellable,
+                               GError          **error)
+{
+    (void) enumerator;
+    (void) cancellable;
+    (void) error;
+
+    return true;
+}
+
+static void
+ras_vfs_file_enumerator_finalize (GObject *object)
+{
+    RasVfsFileEnumerator *self;
+
+    self = RAS_VFS_FILE_ENUMERATOR (object);
+
+    g_clear_pointer (&self->matcher, g_file_attribute_matcher_unref);
+
+    G_OBJECT_CLASS (ras_vfs_file_enumerator_parent_class)->finalize (object);
+}
+
+static void
+ras_vfs_file_enumerator_class_init (RasVfsFileEnumeratorClass *klass)
+{
+    GObjectClass *object_class;
+    GFileEnumeratorClass *enumerator_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+    enumerator_class = G_FILE_ENUMERATOR_CLASS (klass);
+
+    object_class->finalize = ras_vfs_file_enumerator_finalize;
+
+    enumerator_class->next_file = ras_vfs_file_enumerator_next_file;
+    enumerator_class->close_fn = ras_vfs_file_enumerator_close;
+}
+
+static void
+ras_vfs_file_enumerator_init (RasVfsFileEnumerator *self)
+{
+    self->directory = NULL;
+    self->matcher = NULL;
+    self->index = 0;
+}
+
+static bool
+is_separator (char c)
+{
+    return '/' == c || '\\' == c;
+}
+
+/* Resolves @relative_path against @base, both of which may use either
+ * separator, and drops “.” and “..” components.
+ */
+static char *
+canonicalize_path (const char *base,
+                   const char *relative_path)
+{
+    g_autoptr (GPtrArray) components = NULL;
+    const char *paths[2];
+
+    components = g_ptr_array_new_with_free_func (g_free);
+    paths[0] = is_separator (*relative_path)? "" : base;
+    paths[1] = relative_path;
+
+    for (size_t i = 0; G_N_ELEMENTS (paths) > i; i++)
+    {
+        const char *p;
+
+        p = paths[i];
+
+        while ('\0' not_eq *p)
+        {
+            const char *start;
+            size_t length;
+
+            while (is_separator (*p))
+            {
+                p++;
+            }
+            start = p;
+            while ('\0' not_eq *p && !is_separator (*p))
+            {
+                p++;
+            }
+            length = p - start;
+
+            if (0 == length || (1 == length && '.' == start[0]))
+            {
+                continue;
+            }
+            if (2 == length && 0 == strncmp (start, "..", 2))
+            {
+                if (components->len > 0)
+                {
+                    g_ptr_array_remove_index (components, components->len - 1);
+                }
+
+                continue;
+            }
+
+            g_ptr_array_add (components, g_strndup (start, length));
+        }
+    }
+
+    g_ptr_array_add (components, NULL);
+
+    return g_strjoinv ("/", (char **) components->pdata);
+}
+
+static GFile *
+create_file (RasArchive *archive,
+             char       *path)
+{
+    RasVfsFile *file;
+
+    file = g_object_new (RAS_TYPE_VFS_FILE, NULL);
+
+    file->archive = g_object_ref (archive);
+    file->path = path;
+
+    return G_FILE (file);
+}
+
+static RasDirectory *
+get_directory (RasVfsFile *self)
+{
+    if ('\0' == *self->path)
+    {
+        return ras_archive_get_root_directory (self->archive);
+    }
+
+    return ras_archive_lookup_directory (self->archive, self->path);
+}
+
+static RasFile *
+get_file (RasVfsFile *self)
+{
+    if ('\0' == *self->path)
+    {
+        return NULL;
+    }
+
+    return ras_archive_lookup (self->archive, self->path);
+}
+
+static void
+set_not_found_error (RasVfsFile  *self,
+                     GError     **error)
+{
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                 "No such file or directory: %s", self->path);
+}
+
+static GFile *
+ras_vfs_file_dup (GFile *file)
+{
+    RasVfsFile *self;
+
+    self = RAS_VFS_FILE (file);
+
+    return create_file (self->archive, g_strdup (self->path));
+}
+
+static guint
+ras_vfs_file_hash (GFile *file)
+{
+    RasVfsFile *self;
+
+    self = RAS_VFS_FILE (file);
+
+    return g_direct_hash (self->archive) ^ ras_path_hash (self->path);
+}
+
+static gboolean
+ras_vfs_file_equal (GFile *file1,
+                    GFile *file2)
+{
+    RasVfsFile *self;
+    RasVfsFile *other;
+
+    self = RAS_VFS_FILE (file1);
+    other = RAS_VFS_FILE (file2);
+
+    return self->archive == other->archive && ras_path_equal (self->path, other->path);
+}
+
+static gboolean
+ras_vfs_file_is_native (GFile *file)
+{
+    (void) file;
+
+    return false;
+}
+
+static gboolean
+ras_vfs_file_has_uri_scheme (GFile      *file,
+                             const char *uri_scheme)
+{
+    (void) file;
+
+    return 0 == g_ascii_strcasecmp (uri_scheme, RAS_URI_SCHEME);
+}
+
+static char *
+ras_vfs_file_get_uri_scheme (GFile *file)
+{
+    (void) file;
+
+    return g_strdup (RAS_URI_SCHEME);
+}
+
+static char *
+ras_vfs_file_get_basename (GFile *file)
+{
+    RasVfsFile *self;
+    const char *separator;
+
+    self = RAS_VFS_FILE (file);
+
+    if ('\0' == *self->path)
+    {
+        return g_strdup ("/");
+    }
+
+    separator = strrchr (self->path, '/');
+
+    return g_strdup (NULL == separator? self->path : separator + 1);
+}
+
+static char *
+ras_vfs_file_get_path (GFile *file)
+{
+    (void) file;
+
+    return NULL;
+}
+
+static char *
+ras_vfs_file_get_uri (GFile *file)
+{
+    RasVfsFile *self;
+    g_autofree char *escaped_path = NULL;
+
+    self = RAS_VFS_FILE (file);
+    escaped_path = g_uri_escape_string (self->path,
+                                        G_URI_RESERVED_CHARS_ALLOWED_IN_PATH,
+                                        false);
+
+    return g_strconcat (RAS_URI_SCHEME ":///", escaped_path, NULL);
+}
+
+static char *
+ras_vfs_file_get_parse_name (GFile *file)
+{
+    return ras_vfs_file_get_uri (file);
+}
+
+static GFile *
+ras_vfs_file_get_parent (GFile *file)
+{
+    RasVfsFile *self;
+    const char *separator;
+
+    self = RAS_VFS_FILE (file);
+
+    if ('\0' == *self->path)
+    {
+        return NULL;
+    }
+
+    separator = strrchr (self->path, '/');
+    if (NULL == separator)
+    {
+        return create_file (self->archive, g_strdup (""));
+    }
+
+    return create_file (self->archive, g_strndup (self->path, separator - self->path));
+}
+
+static gboolean
+ras_vfs_file_prefix_matches (GFile *prefix,
+                             GFile *file)
+{
+    RasVfsFile *self;
+    RasVfsFile *other;
+    size_t length;
+
+    self = RAS_VFS_FILE (prefix);
+    other = RAS_VFS_FILE (file);
+    length = strlen (self->path);
+
+    if (self->archive not_eq other->archive)
+    {
+        return false;
+    }
+    if (0 == length)
+    {
+        return '\0' not_eq *other->path;
+    }
+
+    return 0 == g_ascii_strncasecmp (self->path, other->path, length)
+        && '/' == other->path[length];
+}
+
+static char *
+ras_vfs_file_get_relative_path (GFile *parent,
+                                GFile *descendant)
+{
+    RasVfsFile *self;
+    RasVfsFile *other;
+    size_t length;
+
+    self = RAS_VFS_FILE (parent);
+    other = RAS_VFS_FILE (descendant);
+    length = strlen (self->path);
+
+    if (!ras_vfs_file_prefix_matches (parent, descendant))
+    {
+        return NULL;
+    }
+
+    return g_strdup (other->path + length + (length > 0));
+}
+
+static GFile *
+ras_vfs_file_resolve_relative_path (GFile      *file,
+                                    const char *relative_path)
+{
+    RasVfsFile *self;
+
+    self = RAS_VFS_FILE (file);
+
+    return create_file (self->archive,
+                        canonicalize_path (self->path, relative_path));
+}
+
+static GFile *
+ras_vfs_file_get_child_for_display_name (GFile       *file,
+                                         const char  *display_name,
+                                         GError     **error)
+{
+    (void) error;
+
+    return ras_vfs_file_resolve_relative_path (file, display_name);
+}
+
+static GFileEnumerator *
+ras_vfs_file_enumerate_children (GFile                *file,
+                                 const char           *attributes,
+                                 GFileQueryInfoFlags   flags,
+                                 GCancellable         *cancellable,
+                                 GError              **error)
+{
+    RasVfsFile *self;
+    RasDirectory *directory;
+    RasVfsFileEnumerator *enumerator;
+
+    self = RAS_VFS_FILE (file);
+    directory = get_directory (self);
+
+    (void) flags;
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        return NULL;
+    }
+
+    if (NULL == directory)
+    {
+        if (NULL != get_file (self))
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY,
+                         "Not a directory: %s", self->path);
+        }
+        else
+        {
+            set_not_found_error (self, error);
+        }
+
+        return NULL;
+    }
+
+    enumerator = g_object_new (RAS_TYPE_VFS_FILE_ENUMERATOR,
+                               "container", file,
+                               NULL);
+
+    enumerator->directory = directory;
+    enumerator->matcher = g_file_attribute_matcher_new (attributes);
+
+    return G_FILE_ENUMERATOR (enumerator);
+}
+
+static GFileInfo *
+ras_vfs_file_query_info (GFile                *file,
+                         const char           *attributes,
+                         GFileQueryInfoFlags   flags,
+                         GCancellable         *cancellable,
+                         GError              **error)
+{
+    RasVfsFile *self;
+    RasDirectory *directory;
+    RasFile *archive_file;
+    g_autoptr (GFileAttributeMatcher) matcher = NULL;
+    g_autofree char *name = NULL;
+
+    self = RAS_VFS_FILE (file);
+    directory = get_directory (self);
+    archive_file = NULL;
+
+    (void) flags;
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        return NULL;
+    }
+
+    if (NULL == directory)
+    {
+        archive_file = get_file (self);
+        if (NULL == archive_file)
+        {
+            set_not_found_error (self, error);
+
+            return NULL;
+        }
+    }
+
+    matcher = g_file_attribute_matcher_new (attributes);
+    name = ras_vfs_file_get_basename (file);
+
+    return create_file_info (name, directory, archive_file, matcher);
+}
+
+static GFileInputStream *
+ras_vfs_file_read (GFile         *file,
+                   GCancellable  *cancellable,
+                   GError       **error)
+{
+    RasVfsFile *self;
+    RasFile *archive_file;
+
+    self = RAS_VFS_FILE (file);
+    archive_file = get_file (self);
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+        return NULL;
+    }
+
+    if (NULL == archive_file)
+    {
+        if (NULL != get_directory (self))
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                         "Is a directory: %s", self->path);
+        }
+        else
+        {
+            set_not_found_error (self, error);
+        }
+
+        return NULL;
+    }
+
+    return ras_file_read (archive_file, error);
+}
+
+static void
+ras_vfs_file_iface_init (GFileIface *iface)
+{
+    iface->dup = ras_vfs_file_dup;
+    iface->hash = ras_vfs_file_hash;
+    iface->equal = ras_vfs_file_equal;
+    iface->is_native = ras_vfs_file_is_native;
+    iface->has_uri_scheme = ras_vfs_file_has_uri_scheme;
+    iface->get_uri_scheme = ras_vfs_file_get_uri_scheme;
+    iface->get_basename = ras_vfs_file_get_basename;
+    iface->get_path = ras_vfs_file_get_path;
+    iface->get_uri = ras_vfs_file_get_uri;
+    iface->get_parse_name = ras_vfs_file_get_parse_name;
+    iface->get_parent = ras_vfs_file_get_parent;
+    iface->prefix_matches = ras_vfs_file_prefix_matches;
+    iface->get_relative_path = ras_vfs_file_get_relative_path;
+    iface->resolve_relative_path = ras_vfs_file_resolve_relative_path;
+    iface->get_child_for_display_name = ras_vfs_file_get_child_for_display_name;
+    iface->enumerate_children = ras_vfs_file_enumerate_children;
+    iface->query_info = ras_vfs_file_query_info;
+    iface->read_fn = ras_vfs_file_read;
+}
+
+static void
+ras_vfs_file_finalize (GObject *object)
+{
+    RasVfsFile *self;
+
+    self = RAS_VFS_FILE (object);
+
+    g_clear_object (&self->archive);
+    g_clear_pointer (&self->path, g_free);
+
+    G_OBJECT_CLASS (ras_vfs_file_parent_class)->finalize (object);
+}
+
+static void
+ras_vfs_file_class_init (RasVfsFileClass *klass)
+{
+    GObjectClass *object_class;
+
+    object_class = G_OBJECT_CLASS (klass);
+
+    object_class->finalize = ras_vfs_file_finalize;
+}
+
+static void
+ras_vfs_file_init (RasVfsFile *self)
+{
+    self->archive = NULL;
+    self->path = NULL;
+}
+
+GFile *
+ras_vfs_file_new (RasArchive *archive,
+                  const char *path)
+{
+    g_return_val_if_fail (RAS_IS_ARCHIVE (archive), NULL);
+    g_return_val_if_fail (NULL != path, NULL);
+
+    return create_file (archive, canonicalize_path ("", path));
+}
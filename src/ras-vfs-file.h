@@ -1,4 +1,4 @@
-/* Copyright (C) 2019 Ernestas Kulik <ernestas DOT kulik AT gmail DOT com>
+/* Copyright (C) 2020 Ernestas Kulik <ernestas AT baltic DOT engineering>
  *
  * This file is part of libras.
  *
@@ -18,24 +18,26 @@
 
 #pragma once
 
-#include "ras-types.h"
+#include "ras-archive.h"
 
-#include <stdint.h>
-
-#include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
-G_DECLARE_FINAL_TYPE (RasBuffer, ras_buffer, RAS, BUFFER, GObject)
-
-const uint8_t *ras_buffer_get_data     (RasBuffer     *buffer,
-                                        uint16_t      *length);
-void           ras_buffer_push_literal (RasBuffer     *buffer,
-                                        uint8_t        literal);
-void           ras_buffer_push_pointer (RasBuffer     *buffer,
-                                        uint16_t       pointer,
-                                        uint8_t        length);
+G_DECLARE_FINAL_TYPE (RasVfsFile, ras_vfs_file, RAS, VFS_FILE, GObject)
 
-RasBuffer     *ras_buffer_new          (void);
+/**
+ * ras_vfs_file_new:
+ * @archive: a #RasArchive
+ * @path: path inside @archive, “/” or “” for the root directory
+ *
+ * Creates a #GFile for a file or directory inside @archive, which can be
+ * enumerated, queried and read like any other. Paths are matched as with
+ * ras_archive_lookup(), and the archive is kept alive by the file.
+ *
+ * Returns: (transfer full): a #GFile
+ */
+GFile *ras_vfs_file_new (RasArchive *archive,
+                         const char *path);
 
 G_END_DECLS
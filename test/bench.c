@@ -0,0 +1,663 @@
+#include <iso646.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ras-archive.h>
+#include <ras-archive-writer.h>
+#include <ras-directory.h>
+#include <ras-file.h>
+#include <ras-lzss.h>
+
+/* Files per directory in generated archives. */
+#define DIRECTORY_SIZE 64
+
+typedef enum
+{
+    SIZE_DISTRIBUTION_FIXED,
+    SIZE_DISTRIBUTION_UNIFORM,
+    SIZE_DISTRIBUTION_EXPONENTIAL,
+} SizeDistribution;
+
+typedef struct
+{
+    unsigned int n_entries;
+    SizeDistribution size_distribution;
+    unsigned int mean_size;
+    /* The fraction of entry data that repeats earlier data. */
+    double compressibility;
+    /* The fraction of entries that are stored rather than compressed. */
+    double stored_fraction;
+    uint32_t seed;
+} GeneratorOptions;
+
+typedef struct
+{
+    GBytes *bytes;
+    RasArchive *archive;
+    unsigned int n_threads;
+
+    GList *paths;
+    /* Decoded by the decode benchmark. */
+    RasFile *file;
+    uint8_t *buffer;
+    GFile *destination;
+    uint64_t total_size;
+
+    /* Work done by each iteration, for rates. */
+    uint64_t operations;
+    uint64_t bytes_processed;
+} BenchContext;
+
+typedef bool (*BenchFunc) (BenchContext  *context,
+                           GError       **error);
+
+static size_t
+get_entry_size (GRand                  *rand,
+                const GeneratorOptions *options)
+{
+    switch (options->size_distribution)
+    {
+        case SIZE_DISTRIBUTION_FIXED:
+        {
+            return options->mean_size;
+        }
+        case SIZE_DISTRIBUTION_UNIFORM:
+        {
+            return g_rand_double_range (rand, 0, 2.0 * options->mean_size);
+        }
+        case SIZE_DISTRIBUTION_EXPONENTIAL:
+        {
+            /* Mostly small entries with a long tail, like game assets. */
+            return -log (1.0 - g_rand_double (rand)) * options->mean_size;
+        }
+    }
+
+    g_assert_not_reached ();
+}
+
+/* Fills @data with runs that either copy earlier data, which compresses, or
+ * are random, which does not.
+ */
+static void
+fill_entry (GRand   *rand,
+            uint8_t *data,
+            size_t   size,
+            double   compressibility)
+{
+    for (size_t i = 0; i < size; )
+    {
+        size_t length;
+
+        /* Not inside MIN (), which would draw twice. */
+        length = g_rand_int_range (rand, 4, 33);
+        length = MIN (length, size - i);
+
+        if (i > 0 && g_rand_double (rand) < compressibility)
+        {
+            size_t distance;
+
+            distance = g_rand_int_range (rand, 1, MIN (i, RAS_LZSS_WINDOW_SIZE - RAS_LZSS_MAX_MATCH_LENGTH) + 1);
+
+            /* Byte by byte, as runs may overlap what they copy. */
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = data[i + j - distance];
+            }
+        }
+        else
+        {
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = g_rand_int (rand);
+            }
+        }
+
+        i += length;
+    }
+}
+
+/* The same options always produce the same archive. */
+static GBytes *
+generate (const GeneratorOptions  *options,
+          GError                 **error)
+{
+    g_autoptr (GOutputStream) stream = NULL;
+    g_autoptr (RasArchiveWriter) writer = NULL;
+    g_autoptr (GRand) rand = NULL;
+    g_autoptr (GDateTime) creation_date_time = NULL;
+    unsigned int n_directories;
+
+    stream = g_memory_output_stream_new_resizable ();
+    writer = ras_archive_writer_new (stream, RAS_FORMAT_VERSION, (int32_t) options->seed,
+                                     NULL, error);
+    if (NULL == writer)
+    {
+        return NULL;
+    }
+
+    rand = g_rand_new_with_seed (options->seed);
+    creation_date_time = g_date_time_new_utc (2020, 1, 1, 0, 0, 0);
+    n_directories = MAX (1, options->n_entries / DIRECTORY_SIZE);
+
+    for (unsigned int i = 0; i < options->n_entries; i++)
+    {
+        size_t size;
+        uint8_t *data;
+        g_autoptr (GInputStream) input = NULL;
+        g_autofree char *path = NULL;
+        RasCompressionMethod compression_method;
+
+        size = get_entry_size (rand, options);
+        data = g_malloc (size);
+
+        fill_entry (rand, data, size, options->compressibility);
+
+        input = g_memory_input_stream_new_from_data (data, size, g_free);
+        path = g_strdup_printf ("data%04u\\file%07u.dat", i % n_directories, i);
+        compression_method = g_rand_double (rand) < options->stored_fraction? RAS_FILE_COMPRESSION_METHOD_STORE
+                                                                             : RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+
+        if (!ras_archive_writer_add_stream (writer, path, input, compression_method,
+                                            creation_date_time, NULL, error))
+        {
+            return NULL;
+        }
+    }
+
+    if (!ras_archive_writer_finish (writer, NULL, error)
+        || !g_output_stream_close (stream, NULL, error))
+    {
+        return NULL;
+    }
+
+    return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (stream));
+}
+
+static bool
+bench_load (BenchContext  *context,
+            GError       **error)
+{
+    g_autoptr (RasArchive) archive = NULL;
+
+    archive = ras_archive_load (context->bytes, error);
+
+    context->operations = 1;
+    context->bytes_processed = 0;
+
+    return NULL != archive;
+}
+
+static bool
+bench_list (BenchContext  *context,
+            GError       **error)
+{
+    size_t directory_count;
+
+    directory_count = ras_archive_get_directory_count (context->archive);
+
+    context->operations = 0;
+    context->bytes_processed = 0;
+
+    for (size_t i = 0; i < directory_count; i++)
+    {
+        RasDirectory *directory;
+        g_autofree char *directory_name = NULL;
+
+        directory = ras_archive_get_directory_by_index (context->archive, i);
+        directory_name = ras_directory_get_name (directory, true);
+
+        for (size_t j = 0; j < ras_directory_get_file_count (directory); j++)
+        {
+            g_autofree char *file_name = NULL;
+
+            file_name = ras_file_get_name (ras_directory_get_file (directory, j));
+
+            context->operations++;
+        }
+    }
+
+    return true;
+}
+
+static bool
+bench_lookup (BenchContext  *context,
+              GError       **error)
+{
+    context->operations = 0;
+    context->bytes_processed = 0;
+
+    for (GList *l = context->paths; NULL != l; l = l->next)
+    {
+        if (NULL == ras_archive_lookup (context->archive, l->data))
+        {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                         "Failed to look up %s", (const char *) l->data);
+
+            return false;
+        }
+
+        context->operations++;
+    }
+
+    return true;
+}
+
+static bool
+bench_decode (BenchContext  *context,
+              GError       **error)
+{
+    context->operations = 1;
+    context->bytes_processed = ras_file_get_size (context->file);
+
+    return ras_file_decode_into (context->file, context->buffer,
+                                 context->bytes_processed, error);
+}
+
+static bool
+bench_encode (BenchContext  *context,
+              GError       **error)
+{
+    g_autoptr (GBytes) compressed = NULL;
+
+    context->operations = 1;
+    context->bytes_processed = ras_file_get_size (context->file);
+
+    compressed = ras_lzss_compress (context->buffer, context->bytes_processed,
+                                    RAS_LZSS_LEVEL_DEFAULT);
+
+    return NULL != compressed;
+}
+
+static bool
+bench_extract (BenchContext  *context,
+               GError       **error)
+{
+    context->operations = ras_archive_get_file_count (context->archive);
+    context->bytes_processed = context->total_size;
+
+    return ras_archive_extract_all (context->archive, context->destination,
+                                    context->n_threads, RAS_EXTRACT_FLAGS_OVERWRITE,
+                                    NULL, error);
+}
+
+static RasFile *
+find_largest_file (RasArchive *archive,
+                   bool        compressed_only)
+{
+    RasFile *largest;
+
+    largest = NULL;
+
+    for (size_t i = 0; i < ras_archive_get_file_count (archive); i++)
+    {
+        RasFile *file;
+
+        file = ras_archive_get_file_by_index (archive, i);
+
+        if (compressed_only
+            && RAS_FILE_COMPRESSION_METHOD_COMPRESS not_eq ras_file_get_compression_method (file))
+        {
+            continue;
+        }
+        if (NULL == largest || ras_file_get_size (file) > ras_file_get_size (largest))
+        {
+            largest = file;
+        }
+    }
+
+    return largest;
+}
+
+static bool
+delete_recursively (GFile   *file,
+                    GError **error)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    if (NULL != enumerator)
+    {
+        for (;;)
+        {
+            GFileInfo *info;
+            GFile *child;
+
+            if (!g_file_enumerator_iterate (enumerator, &info, &child, NULL, error))
+            {
+                return false;
+            }
+            if (NULL == info)
+            {
+                break;
+            }
+
+            if (!delete_recursively (child, error))
+            {
+                return false;
+            }
+        }
+    }
+
+    return g_file_delete (file, NULL, error);
+}
+
+static void
+print_double (const char *name,
+              double      value)
+{
+    char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+    /* Not affected by the locale, unlike printf (). */
+    g_print (", \"%s\": %s", name, g_ascii_formatd (buffer, sizeof (buffer), "%.6f", value));
+}
+
+/* Runs @func for at least @min_time seconds and prints the results as a JSON
+ * object on a line of its own.
+ */
+static bool
+run (const char              *name,
+     BenchFunc                func,
+     BenchContext            *context,
+     const GeneratorOptions  *options,
+     double                   min_time,
+     GError                 **error)
+{
+    int64_t start;
+    int64_t elapsed;
+    unsigned int iterations;
+    double seconds;
+
+    /* Once untimed, so that caches are as warm as they are going to be. */
+    if (!func (context, error))
+    {
+        return false;
+    }
+
+    iterations = 0;
+    start = g_get_monotonic_time ();
+
+    do
+    {
+        if (!func (context, error))
+        {
+            return false;
+        }
+
+        iterations++;
+        elapsed = g_get_monotonic_time () - start;
+    } while (elapsed < min_time * G_USEC_PER_SEC);
+
+    seconds = (double) elapsed / G_USEC_PER_SEC;
+
+    g_print ("{\"benchmark\": \"%s\", \"entries\": %u, \"archive_size\": %" G_GSIZE_FORMAT
+             ", \"iterations\": %u",
+             name, options->n_entries, g_bytes_get_size (context->bytes), iterations);
+    print_double ("seconds", seconds);
+    print_double ("microseconds_per_iteration", seconds * G_USEC_PER_SEC / iterations);
+    print_double ("operations_per_second", (double) context->operations * iterations / seconds);
+    print_double ("megabytes_per_second",
+                  (double) context->bytes_processed * iterations / seconds / (1024 * 1024));
+    g_print ("}\n");
+
+    return true;
+}
+
+static bool
+parse_size_distribution (const char        *value,
+                         SizeDistribution  *size_distribution)
+{
+    if (0 == g_strcmp0 (value, "fixed"))
+    {
+        *size_distribution = SIZE_DISTRIBUTION_FIXED;
+    }
+    else if (0 == g_strcmp0 (value, "uniform"))
+    {
+        *size_distribution = SIZE_DISTRIBUTION_UNIFORM;
+    }
+    else if (0 == g_strcmp0 (value, "exponential"))
+    {
+        *size_distribution = SIZE_DISTRIBUTION_EXPONENTIAL;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_autoptr (GOptionContext) option_context = NULL;
+    int entries = 1024;
+    const char *size_distribution = "exponential";
+    int mean_size = 0x4000;
+    double compressibility = 0.5;
+    double stored_fraction = 0.1;
+    int seed = 1;
+    int jobs = 1;
+    double min_time = 1.0;
+    const char *output = NULL;
+    g_auto (GStrv) benchmarks = NULL;
+    const GOptionEntry option_entries[] =
+    {
+        {
+            "entries", 'n', G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_INT, &entries,
+            "Generate N entries", "N",
+        },
+        {
+            "size-distribution", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_STRING, &size_distribution,
+            "Entry sizes are fixed, uniform or exponential", "DISTRIBUTION",
+        },
+        {
+            "mean-size", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_INT, &mean_size,
+            "Mean entry size in bytes", "BYTES",
+        },
+        {
+            "compressibility", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_DOUBLE, &compressibility,
+            "Fraction of entry data that repeats, from 0 to 1", "FRACTION",
+        },
+        {
+            "stored", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_DOUBLE, &stored_fraction,
+            "Fraction of entries that are stored, from 0 to 1", "FRACTION",
+        },
+        {
+            "seed", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_INT, &seed,
+            "Seed for generating the archive", "SEED",
+        },
+        {
+            "jobs", 'j', G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_INT, &jobs,
+            "Extract using N threads (0 for one per CPU)", "N",
+        },
+        {
+            "min-time", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_DOUBLE, &min_time,
+            "Run each benchmark for at least SECONDS", "SECONDS",
+        },
+        {
+            "output", 'o', G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_FILENAME, &output,
+            "Write the generated archive to FILE and exit", "FILE",
+        },
+        {
+            G_OPTION_REMAINING, 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_STRING_ARRAY, &benchmarks,
+            NULL, NULL,
+        },
+        {
+            NULL, 0, 0,
+            0, NULL,
+            NULL, NULL,
+        }
+    };
+    const struct
+    {
+        const char *name;
+        BenchFunc func;
+    } all_benchmarks[] =
+    {
+        { "load", bench_load },
+        { "list", bench_list },
+        { "lookup", bench_lookup },
+        { "decode", bench_decode },
+        { "encode", bench_encode },
+        { "extract", bench_extract },
+    };
+    GeneratorOptions options = { 0 };
+    BenchContext context = { 0 };
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GList) paths = NULL;
+    g_autofree uint8_t *buffer = NULL;
+    g_autoptr (GFile) destination = NULL;
+    g_autofree char *destination_path = NULL;
+    g_autoptr (GError) error = NULL;
+    int status;
+
+    option_context = g_option_context_new ("[BENCHMARK…]");
+
+    g_option_context_set_summary (option_context,
+                                  "Benchmarks load, list, lookup, decode, encode and extract on a\n"
+                                  "generated archive, or all of them if none are given.");
+    g_option_context_add_main_entries (option_context, option_entries, NULL);
+
+    if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+        g_printerr ("%s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    if (entries < 0 || mean_size < 0 || jobs < 0
+        || compressibility < 0 || compressibility > 1
+        || stored_fraction < 0 || stored_fraction > 1
+        || !parse_size_distribution (size_distribution, &options.size_distribution))
+    {
+        g_printerr ("Invalid generator options\n");
+
+        return EXIT_FAILURE;
+    }
+
+    options.n_entries = entries;
+    options.mean_size = mean_size;
+    options.compressibility = compressibility;
+    options.stored_fraction = stored_fraction;
+    options.seed = seed;
+
+    bytes = generate (&options, &error);
+    if (NULL == bytes)
+    {
+        g_printerr ("Failed to generate archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != output)
+    {
+        if (!g_file_set_contents (output, g_bytes_get_data (bytes, NULL),
+                                  g_bytes_get_size (bytes), &error))
+        {
+            g_printerr ("Failed to write archive: %s\n", error->message);
+
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    archive = ras_archive_load (bytes, &error);
+    if (NULL == archive)
+    {
+        g_printerr ("Failed to load archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    paths = ras_archive_get_paths (archive);
+
+    context.file = find_largest_file (archive, true);
+    if (NULL == context.file)
+    {
+        context.file = find_largest_file (archive, false);
+    }
+
+    for (size_t i = 0; i < ras_archive_get_file_count (archive); i++)
+    {
+        context.total_size += ras_file_get_size (ras_archive_get_file_by_index (archive, i));
+    }
+
+    if (NULL != context.file)
+    {
+        buffer = g_malloc (ras_file_get_size (context.file));
+
+        /* The encode benchmark compresses the file again. */
+        if (!ras_file_decode_into (context.file, buffer, ras_file_get_size (context.file), &error))
+        {
+            g_printerr ("Failed to decode file: %s\n", error->message);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    destination_path = g_dir_make_tmp ("ras-bench-XXXXXX", &error);
+    if (NULL == destination_path)
+    {
+        g_printerr ("Failed to create directory: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+    destination = g_file_new_for_path (destination_path);
+
+    context.bytes = bytes;
+    context.archive = archive;
+    context.n_threads = jobs;
+    context.paths = paths;
+    context.buffer = buffer;
+    context.destination = destination;
+
+    status = EXIT_SUCCESS;
+
+    for (size_t i = 0; i < G_N_ELEMENTS (all_benchmarks) && EXIT_SUCCESS == status; i++)
+    {
+        if (NULL != benchmarks && !g_strv_contains ((const char * const *) benchmarks,
+                                                    all_benchmarks[i].name))
+        {
+            continue;
+        }
+        if ((bench_decode == all_benchmarks[i].func || bench_encode == all_benchmarks[i].func)
+            && NULL == context.file)
+        {
+            continue;
+        }
+
+        if (!run (all_benchmarks[i].name, all_benchmarks[i].func, &context, &options,
+                  min_time, &error))
+        {
+            g_printerr ("Benchmark %s failed: %s\n", all_benchmarks[i].name, error->message);
+            g_clear_error (&error);
+
+            status = EXIT_FAILURE;
+        }
+    }
+
+    if (!delete_recursively (destination, &error))
+    {
+        g_printerr ("Failed to delete %s: %s\n", destination_path, error->message);
+
+        status = EXIT_FAILURE;
+    }
+
+    return status;
+}
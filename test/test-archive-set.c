@@ -0,0 +1,220 @@
+#include <ras-archive-set.h>
+
+#include "test-utils.h"
+
+static const TestEntry base_entries[] =
+{
+    { "readme.txt", 100, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "data\\a.dat", 1000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\b.dat", 1001, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+};
+
+static const TestEntry mod_entries[] =
+{
+    { "data\\a.dat", 2000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\c.dat", 2001, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+};
+
+/* Paths match regardless of case. */
+static const TestEntry patch_entries[] =
+{
+    { "DATA\\A.DAT", 3000, RAS_FILE_COMPRESSION_METHOD_STORE },
+};
+
+static const TestEntry high_entries[] =
+{
+    { "data\\b.dat", 4000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\c.dat", 4001, RAS_FILE_COMPRESSION_METHOD_STORE },
+};
+
+static const TestEntry low_entries[] =
+{
+    { "readme.txt", 5000, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "low.txt", 5001, RAS_FILE_COMPRESSION_METHOD_STORE },
+};
+
+static RasArchive *
+load_archive (const TestEntry *entries,
+              size_t           n_entries)
+{
+    g_autoptr (GBytes) bytes = NULL;
+    RasArchive *archive;
+    g_autoptr (GError) error = NULL;
+
+    bytes = test_build_archive (entries, n_entries);
+    archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    return archive;
+}
+
+/* @expected is the archive that @path should be found in, if any. */
+static void
+check_lookup (RasArchiveSet *set,
+              const char    *path,
+              RasArchive    *expected)
+{
+    RasFile *file;
+    RasArchive *archive;
+
+    archive = NULL;
+    file = ras_archive_set_lookup (set, path, &archive);
+
+    if (NULL == expected)
+    {
+        g_assert_null (file);
+        g_assert_null (archive);
+
+        return;
+    }
+
+    g_assert_true (archive == expected);
+    g_assert_true (file == ras_archive_lookup (expected, path));
+    g_assert_nonnull (file);
+}
+
+static void
+check_archives (RasArchiveSet *set,
+                RasArchive    *first,
+                ...)
+{
+    g_autoptr (GList) archives = NULL;
+    GList *l;
+    va_list args;
+
+    archives = ras_archive_set_get_archives (set);
+    l = archives;
+
+    va_start (args, first);
+
+    for (RasArchive *archive = first; NULL != archive; archive = va_arg (args, RasArchive *))
+    {
+        g_assert_nonnull (l);
+        g_assert_true (l->data == archive);
+
+        l = l->next;
+    }
+
+    va_end (args);
+
+    g_assert_null (l);
+}
+
+static void
+test_lookup (void)
+{
+    g_autoptr (RasArchiveSet) set = NULL;
+    g_autoptr (RasArchive) base = NULL;
+    g_autoptr (RasArchive) mod = NULL;
+    g_autoptr (RasArchive) patch = NULL;
+    g_autoptr (RasArchive) high = NULL;
+    g_autoptr (RasArchive) low = NULL;
+
+    set = ras_archive_set_new ();
+    base = load_archive (base_entries, G_N_ELEMENTS (base_entries));
+    mod = load_archive (mod_entries, G_N_ELEMENTS (mod_entries));
+    patch = load_archive (patch_entries, G_N_ELEMENTS (patch_entries));
+    high = load_archive (high_entries, G_N_ELEMENTS (high_entries));
+    low = load_archive (low_entries, G_N_ELEMENTS (low_entries));
+
+    /* The order of mounting only matters between equal priorities. */
+    ras_archive_set_mount (set, high, 10);
+    ras_archive_set_mount (set, base, 0);
+    ras_archive_set_mount (set, mod, 0);
+    ras_archive_set_mount (set, patch, 0);
+    ras_archive_set_mount (set, low, -5);
+
+    check_archives (set, low, base, mod, patch, high, NULL);
+    g_assert_cmpuint (ras_archive_set_get_file_count (set), ==, 5);
+
+    check_lookup (set, "readme.txt", base);
+    check_lookup (set, "data\\a.dat", patch);
+    check_lookup (set, "data/A.dat", patch);
+    check_lookup (set, "data\\b.dat", high);
+    check_lookup (set, "data\\c.dat", high);
+    check_lookup (set, "low.txt", low);
+    check_lookup (set, "missing.txt", NULL);
+    check_lookup (set, "data", NULL);
+
+    /* Lookups fall back to whichever archive is next in line. */
+    g_assert_true (ras_archive_set_unmount (set, high));
+
+    check_archives (set, low, base, mod, patch, NULL);
+    g_assert_cmpuint (ras_archive_set_get_file_count (set), ==, 5);
+    check_lookup (set, "data\\b.dat", base);
+    check_lookup (set, "data\\c.dat", mod);
+    check_lookup (set, "data\\a.dat", patch);
+
+    g_assert_true (ras_archive_set_unmount (set, patch));
+
+    check_lookup (set, "data\\a.dat", mod);
+
+    /* Paths go once nothing provides them. */
+    g_assert_true (ras_archive_set_unmount (set, mod));
+
+    g_assert_cmpuint (ras_archive_set_get_file_count (set), ==, 4);
+    check_lookup (set, "data\\a.dat", base);
+    check_lookup (set, "data\\c.dat", NULL);
+
+    g_assert_true (ras_archive_set_unmount (set, base));
+
+    check_archives (set, low, NULL);
+    g_assert_cmpuint (ras_archive_set_get_file_count (set), ==, 2);
+    check_lookup (set, "readme.txt", low);
+    check_lookup (set, "data\\a.dat", NULL);
+    check_lookup (set, "data\\b.dat", NULL);
+
+    g_assert_false (ras_archive_set_unmount (set, base));
+
+    /* Mounted again with the priority of low, but later, so on top of it. */
+    ras_archive_set_mount (set, high, -5);
+
+    check_archives (set, low, high, NULL);
+    check_lookup (set, "data\\b.dat", high);
+    check_lookup (set, "readme.txt", low);
+
+    g_assert_true (ras_archive_set_unmount (set, low));
+    g_assert_true (ras_archive_set_unmount (set, high));
+
+    check_archives (set, NULL);
+    g_assert_cmpuint (ras_archive_set_get_file_count (set), ==, 0);
+    check_lookup (set, "readme.txt", NULL);
+}
+
+/* The set keeps its archives alive, along with the paths it indexes. */
+static void
+test_references (void)
+{
+    g_autoptr (RasArchiveSet) set = NULL;
+    RasArchive *base;
+    RasArchive *mod;
+
+    set = ras_archive_set_new ();
+    base = load_archive (base_entries, G_N_ELEMENTS (base_entries));
+    mod = load_archive (mod_entries, G_N_ELEMENTS (mod_entries));
+
+    ras_archive_set_mount (set, base, 0);
+    ras_archive_set_mount (set, mod, 1);
+
+    g_object_unref (base);
+    g_object_unref (mod);
+
+    check_lookup (set, "data\\a.dat", mod);
+
+    g_assert_true (ras_archive_set_unmount (set, mod));
+
+    check_lookup (set, "data\\a.dat", base);
+    check_lookup (set, "readme.txt", base);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/archive-set/lookup", test_lookup);
+    g_test_add_func ("/archive-set/references", test_references);
+
+    return g_test_run ();
+}
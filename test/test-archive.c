@@ -0,0 +1,513 @@
+#include <iso646.h>
+
+#include <ras-archive.h>
+
+#include "test-utils.h"
+
+typedef struct
+{
+    GFile *directory;
+} Fixture;
+
+static void
+fixture_set_up (Fixture    *fixture,
+                const void *user_data)
+{
+    g_autofree char *path = NULL;
+    g_autoptr (GError) error = NULL;
+
+    path = g_dir_make_tmp ("ras-test-XXXXXX", &error);
+    g_assert_no_error (error);
+
+    fixture->directory = g_file_new_for_path (path);
+}
+
+static void
+fixture_tear_down (Fixture    *fixture,
+                   const void *user_data)
+{
+    test_delete_recursively (fixture->directory);
+
+    g_clear_object (&fixture->directory);
+}
+
+static const TestEntry extract_entries[] =
+{
+    { "readme.txt", 100, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "data\\small.dat", 3000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\large.dat", 300000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\maps\\empty.map", 0, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+};
+
+static GFile *
+get_extracted_file (GFile      *directory,
+                    const char *path)
+{
+    g_autofree char *relative_path = NULL;
+
+    relative_path = g_strdelimit (g_strdup (path), "\\", '/');
+
+    return g_file_resolve_relative_path (directory, relative_path);
+}
+
+static void
+test_extract (Fixture    *fixture,
+              const void *user_data)
+{
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GError) error = NULL;
+
+    bytes = test_build_archive (extract_entries, G_N_ELEMENTS (extract_entries));
+    archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    ras_archive_extract_all (archive, fixture->directory, 2, RAS_EXTRACT_FLAGS_NONE,
+                             NULL, &error);
+    g_assert_no_error (error);
+
+    for (size_t i = 0; i < G_N_ELEMENTS (extract_entries); i++)
+    {
+        g_autoptr (GFile) file = NULL;
+
+        file = get_extracted_file (fixture->directory, extract_entries[i].path);
+
+        test_check_file (file, extract_entries[i].path, extract_entries[i].size);
+    }
+
+    /* Existing files are only replaced when asked to. */
+    g_assert_false (ras_archive_extract_all (archive, fixture->directory, 2,
+                                             RAS_EXTRACT_FLAGS_NONE, NULL, &error));
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS);
+    g_clear_error (&error);
+
+    ras_archive_extract_all (archive, fixture->directory, 2, RAS_EXTRACT_FLAGS_OVERWRITE,
+                             NULL, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_extract_mapped (Fixture    *fixture,
+                     const void *user_data)
+{
+    const TestEntry entries[] =
+    {
+        { "large.dat", 0x180003, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    };
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GFile) file = NULL;
+    bool mapped;
+    g_autoptr (GError) error = NULL;
+
+    bytes = test_build_archive (entries, G_N_ELEMENTS (entries));
+    archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    mapped = ras_file_can_extract_mapped (ras_archive_get_file_by_index (archive, 0));
+    file = g_file_get_child (fixture->directory, entries[0].path);
+
+    /* Once into a new file and once over the old one. */
+    for (int i = 0; i < 2; i++)
+    {
+        RasArchiveStats stats;
+
+        ras_archive_reset_stats (archive);
+
+        ras_archive_extract_all (archive, fixture->directory, 1, RAS_EXTRACT_FLAGS_OVERWRITE,
+                                 NULL, &error);
+        g_assert_no_error (error);
+
+        ras_archive_get_stats (archive, &stats);
+        g_assert_cmpuint (stats.compressed_entries, ==, 1);
+        g_assert_cmpuint (stats.mapped_entries, ==, (mapped? 1 : 0));
+
+        test_check_file (file, entries[0].path, entries[0].size);
+    }
+}
+
+static void
+test_extract_unsafe_names (Fixture    *fixture,
+                           const void *user_data)
+{
+    const char *paths[] =
+    {
+        "..\\escaped.dat",
+        "data\\..\\..\\escaped.dat",
+        "..",
+        ".",
+    };
+
+    for (size_t i = 0; i < G_N_ELEMENTS (paths); i++)
+    {
+        const TestEntry entries[] =
+        {
+            { "safe.dat", 10, RAS_FILE_COMPRESSION_METHOD_STORE },
+            { paths[i], 10, RAS_FILE_COMPRESSION_METHOD_STORE },
+        };
+        g_autoptr (GBytes) bytes = NULL;
+        g_autoptr (RasArchive) archive = NULL;
+        g_autoptr (GFile) destination = NULL;
+        g_autoptr (GFile) escaped = NULL;
+        g_autoptr (GFile) safe = NULL;
+        g_autoptr (GError) error = NULL;
+
+        bytes = test_build_archive (entries, G_N_ELEMENTS (entries));
+        archive = ras_archive_load (bytes, &error);
+        g_assert_no_error (error);
+
+        destination = g_file_get_child (fixture->directory, "destination");
+        g_file_make_directory (destination, NULL, &error);
+        g_assert_no_error (error);
+
+        g_assert_false (ras_archive_extract_all (archive, destination, 1,
+                                                 RAS_EXTRACT_FLAGS_NONE, NULL, &error));
+        g_assert_error (error, RAS_ARCHIVE_ERROR, RAS_ERROR_MALFORMED);
+
+        /* Nothing is written once a name is found to be unsafe. */
+        escaped = g_file_get_child (fixture->directory, "escaped.dat");
+        g_assert_false (g_file_query_exists (escaped, NULL));
+        safe = g_file_get_child (destination, "safe.dat");
+        g_assert_false (g_file_query_exists (safe, NULL));
+
+        test_delete_recursively (destination);
+    }
+}
+
+static void
+test_extract_failure (Fixture    *fixture,
+                      const void *user_data)
+{
+    const TestEntry entries[] =
+    {
+        { "file.dat", 100000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    };
+    const char original[] = "original contents";
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GBytes) truncated = NULL;
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autofree char *contents = NULL;
+    size_t length;
+    g_autoptr (GError) error = NULL;
+
+    /* The data comes after the tables, so this cuts the entry short. */
+    bytes = test_build_archive (entries, G_N_ELEMENTS (entries));
+    truncated = g_bytes_new_from_bytes (bytes, 0, g_bytes_get_size (bytes) - 1);
+    archive = ras_archive_load (truncated, &error);
+    g_assert_no_error (error);
+
+    file = g_file_get_child (fixture->directory, "file.dat");
+
+    /* A file that extraction created is removed... */
+    g_assert_false (ras_archive_extract_all (archive, fixture->directory, 1,
+                                             RAS_EXTRACT_FLAGS_NONE, NULL, &error));
+    g_assert_error (error, RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED);
+    g_clear_error (&error);
+
+    g_assert_false (g_file_query_exists (file, NULL));
+
+    /* ...and one that it would have replaced is kept. */
+    g_file_replace_contents (file, original, strlen (original), NULL, false,
+                             G_FILE_CREATE_NONE, NULL, NULL, &error);
+    g_assert_no_error (error);
+
+    g_assert_false (ras_archive_extract_all (archive, fixture->directory, 1,
+                                             RAS_EXTRACT_FLAGS_OVERWRITE, NULL, &error));
+    g_assert_error (error, RAS_ARCHIVE_ERROR, RAS_ERROR_TRUNCATED);
+    g_clear_error (&error);
+
+    g_file_load_contents (file, NULL, &contents, &length, NULL, &error);
+    g_assert_no_error (error);
+    g_assert_cmpmem (contents, length, original, strlen (original));
+}
+
+static RasArchive *
+load_file (GFile *file)
+{
+    g_autofree char *contents = NULL;
+    size_t length;
+    g_autoptr (GBytes) bytes = NULL;
+    RasArchive *archive;
+    g_autoptr (GError) error = NULL;
+
+    g_file_load_contents (file, NULL, &contents, &length, NULL, &error);
+    g_assert_no_error (error);
+
+    bytes = g_bytes_new_take (g_steal_pointer (&contents), length);
+    archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    return archive;
+}
+
+/* Checks that @file holds exactly @entries and returns its dead space. */
+static uint64_t
+check_archive_file (GFile           *file,
+                    const TestEntry *entries,
+                    size_t           n_entries)
+{
+    g_autoptr (RasArchive) archive = NULL;
+
+    archive = load_file (file);
+
+    g_assert_cmpuint (ras_archive_get_file_count (archive), ==, n_entries);
+
+    for (size_t i = 0; i < n_entries; i++)
+    {
+        test_check_entry (archive, entries[i].path, entries[i].size);
+    }
+
+    return ras_archive_get_dead_space_size (archive);
+}
+
+static uint64_t
+get_entry_size (GFile      *file,
+                const char *path)
+{
+    g_autoptr (RasArchive) archive = NULL;
+
+    archive = load_file (file);
+
+    return ras_file_get_entry_size (ras_archive_lookup (archive, path));
+}
+
+static uint64_t
+get_entry_offset (GFile      *file,
+                  const char *path)
+{
+    g_autoptr (RasArchive) archive = NULL;
+    RasFile *entry;
+
+    archive = load_file (file);
+    entry = ras_archive_lookup (archive, path);
+
+    for (size_t i = 0; i < ras_archive_get_file_count (archive); i++)
+    {
+        if (ras_archive_get_file_by_index (archive, i) == entry)
+        {
+            return ras_archive_get_file_offset (archive, i);
+        }
+    }
+
+    g_assert_not_reached ();
+}
+
+/* A compacted archive is its tables followed by its entries back to back. */
+static void
+check_compacted (GFile *file)
+{
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (GFileInfo) info = NULL;
+    uint64_t end;
+    g_autoptr (GError) error = NULL;
+
+    archive = load_file (file);
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE,
+                              NULL, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpuint (ras_archive_get_dead_space_size (archive), ==, 0);
+
+    end = ras_archive_get_file_offset (archive, 0);
+
+    for (size_t i = 0; i < ras_archive_get_file_count (archive); i++)
+    {
+        g_assert_cmpuint (ras_archive_get_file_offset (archive, i), ==, end);
+
+        end += ras_file_get_entry_size (ras_archive_get_file_by_index (archive, i));
+    }
+
+    g_assert_cmpuint (g_file_info_get_size (info), ==, end);
+}
+
+static void
+update (GFile                       *file,
+        const RasArchiveUpdateEntry *entries,
+        size_t                       n_entries)
+{
+    g_autoptr (GError) error = NULL;
+
+    ras_archive_update (file, entries, n_entries, NULL, &error);
+    g_assert_no_error (error);
+}
+
+static void
+compact (GFile *file)
+{
+    g_autoptr (GError) error = NULL;
+
+    ras_archive_compact (file, NULL, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_update (Fixture    *fixture,
+             const void *user_data)
+{
+    const TestEntry entries[] =
+    {
+        { "readme.txt", 5000, RAS_FILE_COMPRESSION_METHOD_STORE },
+        { "data\\replaced.dat", 20000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+        { "data\\removed.dat", 300, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+        { "data\\maps\\kept.map", 70000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    };
+    const TestEntry updated_entries[] =
+    {
+        { "readme.txt", 5000, RAS_FILE_COMPRESSION_METHOD_STORE },
+        { "data\\replaced.dat", 25000, RAS_FILE_COMPRESSION_METHOD_STORE },
+        { "data\\maps\\kept.map", 70000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+        { "new\\added.dat", 1000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    };
+    g_autoptr (GInputStream) discarded = NULL;
+    g_autoptr (GInputStream) replaced = NULL;
+    g_autoptr (GInputStream) added = NULL;
+    g_autoptr (GFile) file = NULL;
+    uint64_t dead_entry_size;
+    uint64_t readme_offset;
+    uint64_t dead_space;
+
+    file = test_build_archive_file (fixture->directory, entries, G_N_ELEMENTS (entries));
+
+    g_assert_cmpuint (check_archive_file (file, entries, G_N_ELEMENTS (entries)), ==, 0);
+
+    dead_entry_size = get_entry_size (file, "data\\replaced.dat")
+                    + get_entry_size (file, "data\\removed.dat");
+    readme_offset = get_entry_offset (file, "readme.txt");
+
+    discarded = test_entry_stream ("data\\replaced.dat", 1);
+    replaced = test_entry_stream ("data\\replaced.dat", 25000);
+    added = test_entry_stream ("new\\added.dat", 1000);
+
+    {
+        const RasArchiveUpdateEntry update_entries[] =
+        {
+            { "data\\replaced.dat", discarded, RAS_FILE_COMPRESSION_METHOD_COMPRESS, NULL },
+            { "new\\added.dat", added, RAS_FILE_COMPRESSION_METHOD_COMPRESS, NULL },
+            { "data/removed.dat", NULL, RAS_FILE_COMPRESSION_METHOD_STORE, NULL },
+            /* Only the last update of a path counts. */
+            { "data\\replaced.dat", replaced, RAS_FILE_COMPRESSION_METHOD_STORE, NULL },
+        };
+
+        update (file, update_entries, G_N_ELEMENTS (update_entries));
+    }
+
+    /* The tables grew into the first entry, which moved to the end. */
+    g_assert_cmpuint (get_entry_offset (file, "readme.txt"), >, readme_offset);
+
+    dead_space = check_archive_file (file, updated_entries, G_N_ELEMENTS (updated_entries));
+    g_assert_cmpuint (dead_space, >=, dead_entry_size);
+
+    compact (file);
+
+    g_assert_cmpuint (check_archive_file (file, updated_entries, G_N_ELEMENTS (updated_entries)), ==, 0);
+    check_compacted (file);
+
+    /* Compacting again changes nothing. */
+    compact (file);
+    check_compacted (file);
+}
+
+/* Enough entries that the tables outgrow all the data there is and every
+ * entry has to move.
+ */
+static void
+test_update_grow (Fixture    *fixture,
+                  const void *user_data)
+{
+    const TestEntry entries[] =
+    {
+        { "small.dat", 100, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+        { "tiny.dat", 10, RAS_FILE_COMPRESSION_METHOD_STORE },
+    };
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GArray) expected = NULL;
+    g_autoptr (GPtrArray) paths = NULL;
+    g_autoptr (GPtrArray) streams = NULL;
+    g_autoptr (GArray) update_entries = NULL;
+
+    file = test_build_archive_file (fixture->directory, entries, G_N_ELEMENTS (entries));
+
+    expected = g_array_new (false, false, sizeof (TestEntry));
+    paths = g_ptr_array_new_with_free_func (g_free);
+    streams = g_ptr_array_new_with_free_func (g_object_unref);
+    update_entries = g_array_new (false, false, sizeof (RasArchiveUpdateEntry));
+
+    g_array_append_vals (expected, entries, G_N_ELEMENTS (entries));
+
+    for (unsigned int i = 0; i < 200; i++)
+    {
+        char *path;
+        GInputStream *stream;
+        TestEntry entry = { 0 };
+        RasArchiveUpdateEntry update_entry = { 0 };
+
+        path = g_strdup_printf ("generated\\directory%u\\entry%03u.dat", i % 7, i);
+        stream = test_entry_stream (path, i);
+
+        g_ptr_array_add (paths, path);
+        g_ptr_array_add (streams, stream);
+
+        entry.path = path;
+        entry.size = i;
+        entry.compression_method = RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+        g_array_append_val (expected, entry);
+
+        update_entry.path = path;
+        update_entry.stream = stream;
+        update_entry.compression_method = RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+        g_array_append_val (update_entries, update_entry);
+    }
+
+    update (file, (RasArchiveUpdateEntry *) update_entries->data, update_entries->len);
+
+    check_archive_file (file, (TestEntry *) expected->data, expected->len);
+
+    /* The room left in front of the data takes more entries without moving
+     * any.
+     */
+    {
+        g_autoptr (GInputStream) stream = NULL;
+        uint64_t offset;
+        const TestEntry entry = { "later.dat", 50, RAS_FILE_COMPRESSION_METHOD_STORE };
+        RasArchiveUpdateEntry update_entry = { "later.dat", NULL, RAS_FILE_COMPRESSION_METHOD_STORE, NULL };
+
+        offset = get_entry_offset (file, "small.dat");
+        stream = test_entry_stream (entry.path, entry.size);
+        update_entry.stream = stream;
+
+        update (file, &update_entry, 1);
+
+        g_array_append_val (expected, entry);
+        check_archive_file (file, (TestEntry *) expected->data, expected->len);
+        g_assert_cmpuint (get_entry_offset (file, "small.dat"), ==, offset);
+    }
+
+    compact (file);
+
+    g_assert_cmpuint (check_archive_file (file, (TestEntry *) expected->data, expected->len), ==, 0);
+    check_compacted (file);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/archive/extract", Fixture, NULL,
+                fixture_set_up, test_extract, fixture_tear_down);
+    g_test_add ("/archive/extract/mapped", Fixture, NULL,
+                fixture_set_up, test_extract_mapped, fixture_tear_down);
+    g_test_add ("/archive/extract/unsafe-names", Fixture, NULL,
+                fixture_set_up, test_extract_unsafe_names, fixture_tear_down);
+    g_test_add ("/archive/extract/failure", Fixture, NULL,
+                fixture_set_up, test_extract_failure, fixture_tear_down);
+
+    g_test_add ("/archive/update", Fixture, NULL,
+                fixture_set_up, test_update, fixture_tear_down);
+    g_test_add ("/archive/update/grow", Fixture, NULL,
+                fixture_set_up, test_update_grow, fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -0,0 +1,369 @@
+#include <ras-archive.h>
+
+#include "test-utils.h"
+
+static const TestEntry entries[] =
+{
+    { "a.dat", 1000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "b.dat", 2000, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "c.dat", 3000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "large.dat", 20000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+};
+
+static RasArchive *
+load_archive (const TestEntry *archive_entries,
+              size_t           n_entries)
+{
+    g_autoptr (GBytes) bytes = NULL;
+    RasArchive *archive;
+    g_autoptr (GError) error = NULL;
+
+    bytes = test_build_archive (archive_entries, n_entries);
+    archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    return archive;
+}
+
+static GBytes *
+get_bytes (RasCache   *cache,
+           RasArchive *archive,
+           const char *path)
+{
+    RasFile *file;
+    GBytes *bytes;
+    g_autoptr (GBytes) contents = NULL;
+    g_autoptr (GError) error = NULL;
+
+    file = ras_archive_lookup (archive, path);
+    g_assert_nonnull (file);
+
+    bytes = ras_cache_get_bytes (cache, file, &error);
+    g_assert_no_error (error);
+
+    contents = test_entry_contents (path, ras_file_get_size (file));
+    g_assert_true (g_bytes_equal (bytes, contents));
+
+    return bytes;
+}
+
+static bool
+is_cached (RasCache   *cache,
+           RasArchive *archive,
+           const char *path)
+{
+    g_autoptr (GBytes) bytes = NULL;
+
+    bytes = ras_cache_lookup (cache, ras_archive_lookup (archive, path));
+
+    return NULL != bytes;
+}
+
+static void
+check_stats (RasCache *cache,
+             uint64_t  hits,
+             uint64_t  misses,
+             uint64_t  evictions,
+             size_t    size,
+             size_t    n_entries)
+{
+    RasCacheStats stats;
+
+    ras_cache_get_stats (cache, &stats);
+
+    g_assert_cmpuint (stats.hits, ==, hits);
+    g_assert_cmpuint (stats.misses, ==, misses);
+    g_assert_cmpuint (stats.evictions, ==, evictions);
+    g_assert_cmpuint (stats.size, ==, size);
+    g_assert_cmpuint (stats.n_entries, ==, n_entries);
+}
+
+static void
+test_get_bytes (void)
+{
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (RasCache) cache = NULL;
+    g_autoptr (GBytes) first = NULL;
+    g_autoptr (GBytes) second = NULL;
+
+    archive = load_archive (entries, G_N_ELEMENTS (entries));
+    cache = ras_cache_new (5500);
+
+    first = get_bytes (cache, archive, "a.dat");
+    check_stats (cache, 0, 1, 0, 1000, 1);
+
+    second = get_bytes (cache, archive, "a.dat");
+    check_stats (cache, 1, 1, 0, 1000, 1);
+    g_assert_true (first == second);
+
+    g_assert_false (is_cached (cache, archive, "b.dat"));
+    check_stats (cache, 1, 2, 0, 1000, 1);
+}
+
+static void
+test_eviction (void)
+{
+    g_autoptr (RasArchive) archive = NULL;
+    g_autoptr (RasCache) cache = NULL;
+    g_autoptr (GBytes) a = NULL;
+    g_autoptr (GBytes) b = NULL;
+    g_autoptr (GBytes) c = NULL;
+    g_autoptr (GBytes) large = NULL;
+    g_autoptr (GBytes) contents = NULL;
+
+    archive = load_archive (entries, G_N_ELEMENTS (entries));
+    cache = ras_cache_new (5500);
+
+    a = get_bytes (cache, archive, "a.dat");
+    b = get_bytes (cache, archive, "b.dat");
+    check_stats (cache, 0, 2, 0, 3000, 2);
+
+    /* Makes b.dat the least recently used. */
+    g_assert_true (is_cached (cache, archive, "a.dat"));
+
+    c = get_bytes (cache, archive, "c.dat");
+    check_stats (cache, 1, 3, 1, 4000, 2);
+
+    g_assert_false (is_cached (cache, archive, "b.dat"));
+    g_assert_true (is_cached (cache, archive, "a.dat"));
+    check_stats (cache, 2, 4, 1, 4000, 2);
+
+    /* Handed out contents outlive their entries. */
+    contents = test_entry_contents ("b.dat", 2000);
+    g_assert_true (g_bytes_equal (b, contents));
+
+    /* Larger than the budget, so it is not cached. */
+    large = get_bytes (cache, archive, "large.dat");
+    check_stats (cache, 2, 5, 1, 4000, 2);
+
+    /* a.dat was used last, so c.dat goes. */
+    ras_cache_set_budget (cache, 3000);
+    g_assert_cmpuint (ras_cache_get_budget (cache), ==, 3000);
+    check_stats (cache, 2, 5, 2, 1000, 1);
+
+    g_assert_false (is_cached (cache, archive, "c.dat"));
+    g_assert_true (is_cached (cache, archive, "a.dat"));
+
+    ras_cache_clear (cache);
+    check_stats (cache, 3, 6, 2, 0, 0);
+
+    g_clear_pointer (&contents, g_bytes_unref);
+    contents = test_entry_contents ("c.dat", 3000);
+    g_assert_true (g_bytes_equal (c, contents));
+}
+
+static void
+test_archive (void)
+{
+    RasArchive *archive;
+    g_autoptr (RasCache) cache = NULL;
+    g_autoptr (RasCache) other_cache = NULL;
+    RasCacheStats stats;
+
+    archive = load_archive (entries, G_N_ELEMENTS (entries));
+    cache = ras_cache_new (6000);
+    other_cache = ras_cache_new (6000);
+
+    ras_archive_set_cache (archive, cache);
+    g_assert_true (ras_archive_get_cache (archive) == cache);
+
+    for (size_t i = 0; i < ras_archive_get_file_count (archive); i++)
+    {
+        g_autoptr (GBytes) bytes = NULL;
+        g_autoptr (GError) error = NULL;
+
+        bytes = ras_archive_get_bytes (archive, i, &error);
+        g_assert_no_error (error);
+    }
+
+    ras_cache_get_stats (cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 3);
+
+    /* The files are dropped from the previous cache. */
+    ras_archive_set_cache (archive, other_cache);
+
+    ras_cache_get_stats (cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+    g_assert_cmpuint (stats.size, ==, 0);
+
+    g_bytes_unref (ras_archive_get_bytes (archive, 0, NULL));
+
+    ras_cache_get_stats (other_cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 1);
+
+    /* And from the current one when the archive is gone. */
+    g_object_unref (archive);
+
+    ras_cache_get_stats (other_cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+}
+
+/* Enough to keep prefetching busy for a while. */
+#define N_PREFETCH_ENTRIES 32
+#define PREFETCH_ENTRY_SIZE 0x40000
+
+static RasArchive *
+load_prefetch_archive (void)
+{
+    TestEntry prefetch_entries[N_PREFETCH_ENTRIES];
+    g_autoptr (GPtrArray) paths = NULL;
+
+    paths = g_ptr_array_new_with_free_func (g_free);
+
+    for (size_t i = 0; i < N_PREFETCH_ENTRIES; i++)
+    {
+        char *path;
+
+        path = g_strdup_printf ("%zu.dat", i);
+        g_ptr_array_add (paths, path);
+
+        prefetch_entries[i].path = path;
+        prefetch_entries[i].size = PREFETCH_ENTRY_SIZE;
+        prefetch_entries[i].compression_method = RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+    }
+
+    return load_archive (prefetch_entries, N_PREFETCH_ENTRIES);
+}
+
+static void
+prefetch_all (RasArchive *archive)
+{
+    size_t indices[N_PREFETCH_ENTRIES];
+
+    for (size_t i = 0; i < N_PREFETCH_ENTRIES; i++)
+    {
+        indices[i] = i;
+    }
+
+    ras_archive_prefetch (archive, indices, N_PREFETCH_ENTRIES, NULL);
+}
+
+static void
+notify_finalized (void    *data,
+                  GObject *object)
+{
+    g_atomic_int_set ((int *) data, true);
+}
+
+/* Prefetching holds a reference to the archive until it is done. */
+static void
+unref_and_wait (RasArchive *archive)
+{
+    int finalized;
+
+    finalized = false;
+
+    g_object_weak_ref (G_OBJECT (archive), notify_finalized, &finalized);
+    g_object_unref (archive);
+
+    while (!g_atomic_int_get (&finalized))
+    {
+        g_main_context_iteration (NULL, false);
+        g_usleep (1000);
+    }
+}
+
+static void
+test_prefetch (void)
+{
+    RasArchive *archive;
+    g_autoptr (RasCache) cache = NULL;
+    RasCacheStats stats;
+
+    archive = load_prefetch_archive ();
+    cache = ras_cache_new (N_PREFETCH_ENTRIES * PREFETCH_ENTRY_SIZE);
+
+    ras_archive_set_cache (archive, cache);
+    prefetch_all (archive);
+
+    do
+    {
+        g_main_context_iteration (NULL, false);
+        g_usleep (1000);
+
+        ras_cache_get_stats (cache, &stats);
+    }
+    while (stats.n_entries < N_PREFETCH_ENTRIES);
+
+    for (size_t i = 0; i < N_PREFETCH_ENTRIES; i++)
+    {
+        g_autoptr (GBytes) bytes = NULL;
+        g_autoptr (GBytes) contents = NULL;
+        g_autofree char *path = NULL;
+
+        path = g_strdup_printf ("%zu.dat", i);
+        bytes = ras_cache_lookup (cache, ras_archive_lookup (archive, path));
+        g_assert_nonnull (bytes);
+
+        contents = test_entry_contents (path, PREFETCH_ENTRY_SIZE);
+        g_assert_true (g_bytes_equal (bytes, contents));
+    }
+
+    unref_and_wait (archive);
+
+    ras_cache_get_stats (cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+}
+
+/* Files prefetched after the cache is replaced must not end up in the old
+ * one, where nothing would remove them.
+ */
+static void
+test_prefetch_replaced (void)
+{
+    RasArchive *archive;
+    g_autoptr (RasCache) cache = NULL;
+    g_autoptr (RasCache) other_cache = NULL;
+    RasCacheStats stats;
+
+    archive = load_prefetch_archive ();
+    cache = ras_cache_new (N_PREFETCH_ENTRIES * PREFETCH_ENTRY_SIZE);
+    other_cache = ras_cache_new (N_PREFETCH_ENTRIES * PREFETCH_ENTRY_SIZE);
+
+    ras_archive_set_cache (archive, cache);
+    prefetch_all (archive);
+    ras_archive_set_cache (archive, other_cache);
+
+    unref_and_wait (archive);
+
+    ras_cache_get_stats (cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+    ras_cache_get_stats (other_cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+}
+
+static void
+test_prefetch_unset (void)
+{
+    RasArchive *archive;
+    g_autoptr (RasCache) cache = NULL;
+    RasCacheStats stats;
+
+    archive = load_prefetch_archive ();
+    cache = ras_cache_new (N_PREFETCH_ENTRIES * PREFETCH_ENTRY_SIZE);
+
+    ras_archive_set_cache (archive, cache);
+    prefetch_all (archive);
+    ras_archive_set_cache (archive, NULL);
+
+    unref_and_wait (archive);
+
+    ras_cache_get_stats (cache, &stats);
+    g_assert_cmpuint (stats.n_entries, ==, 0);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/cache/get-bytes", test_get_bytes);
+    g_test_add_func ("/cache/eviction", test_eviction);
+    g_test_add_func ("/cache/archive", test_archive);
+    g_test_add_func ("/cache/prefetch", test_prefetch);
+    g_test_add_func ("/cache/prefetch/replaced", test_prefetch_replaced);
+    g_test_add_func ("/cache/prefetch/unset", test_prefetch_unset);
+
+    return g_test_run ();
+}
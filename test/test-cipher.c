@@ -0,0 +1,256 @@
+#include <iso646.h>
+#include <string.h>
+
+#include <ras-cipher.h>
+
+/* Enough for the longest run plus the largest misalignment. */
+#define BUFFER_SIZE (RAS_CIPHER_BLOCK_SIZE + 64)
+
+static void
+fill_random (GRand   *rand,
+             uint8_t *data,
+             size_t   length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = g_rand_int (rand);
+    }
+}
+
+/* Checks @kernel against the scalar loop with every misalignment of the input
+ * and output, around the vector widths and at the odd positions that leave
+ * the rotation and XOR patterns mid-cycle.
+ */
+static void
+test_kernel (const void *data)
+{
+    RasCipherKernel kernel;
+    g_autoptr (GRand) rand = NULL;
+    g_autofree uint8_t *input = NULL;
+    g_autofree uint8_t *keystream = NULL;
+    g_autofree uint8_t *expected = NULL;
+    g_autofree uint8_t *output = NULL;
+    const size_t lengths[] =
+    {
+        0, 1, 4, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 100, 255,
+        RAS_CIPHER_BLOCK_SIZE - 1, RAS_CIPHER_BLOCK_SIZE,
+    };
+    const uint64_t positions[] =
+    {
+        0, 1, 2, 3, 4, 5, 7, 13, 255, 256, 0xFFFFFFFF, G_GUINT64_CONSTANT (0x100000003),
+    };
+
+    kernel = GPOINTER_TO_INT (data);
+    if (!ras_cipher_kernel_is_supported (kernel))
+    {
+        g_test_skip ("Not supported by this CPU");
+
+        return;
+    }
+
+    rand = g_rand_new_with_seed (1);
+    input = g_malloc (BUFFER_SIZE);
+    keystream = g_malloc (BUFFER_SIZE);
+    expected = g_malloc (BUFFER_SIZE);
+    output = g_malloc (BUFFER_SIZE);
+
+    fill_random (rand, input, BUFFER_SIZE);
+    fill_random (rand, keystream, BUFFER_SIZE);
+
+    for (size_t i = 0; i < G_N_ELEMENTS (lengths); i++)
+    {
+        for (size_t j = 0; j < G_N_ELEMENTS (positions); j++)
+        {
+            for (size_t offset = 0; offset < 32; offset++)
+            {
+                size_t length;
+
+                length = lengths[i];
+
+                ras_cipher_decrypt_with_kernel (RAS_CIPHER_KERNEL_SCALAR,
+                                                input + offset, expected, length,
+                                                positions[j], keystream + offset);
+                ras_cipher_decrypt_with_kernel (kernel,
+                                                input + offset, output + 31 - offset, length,
+                                                positions[j], keystream + offset);
+
+                g_assert_cmpmem (output + 31 - offset, length, expected, length);
+
+                /* In place, as tables are decrypted. */
+                memcpy (output + offset, input + offset, length);
+
+                ras_cipher_decrypt_with_kernel (kernel,
+                                                output + offset, output + offset, length,
+                                                positions[j], keystream + offset);
+
+                g_assert_cmpmem (output + offset, length, expected, length);
+            }
+        }
+    }
+}
+
+/* Straight from the recurrence, without going through the table. */
+static uint8_t *
+generate_reference (int32_t seed,
+                    size_t  length)
+{
+    uint8_t *bytes;
+
+    bytes = g_malloc (length);
+
+    for (size_t i = 0; i < length; i++)
+    {
+        seed = (int32_t) ((uint32_t) seed * 171U - (uint32_t) (seed / 177) * 30269U);
+
+        bytes[i] = seed & 0xFF;
+    }
+
+    return bytes;
+}
+
+static const int32_t seeds[] =
+{
+    1, 2, 12345, -12345, 30268, G_MAXINT32, G_MININT32,
+};
+
+/* Generates in pieces that straddle the threshold, where the keystream
+ * switches to the table.
+ */
+static void
+test_keystream_sequential (void)
+{
+    const size_t length = 3 * RAS_KEYSTREAM_TABLE_THRESHOLD;
+    const size_t piece_lengths[] =
+    {
+        1, 1000, RAS_CIPHER_BLOCK_SIZE, RAS_KEYSTREAM_TABLE_THRESHOLD - 1,
+    };
+
+    for (size_t i = 0; i < G_N_ELEMENTS (seeds); i++)
+    {
+        g_autofree uint8_t *expected = NULL;
+        g_autofree uint8_t *output = NULL;
+
+        expected = generate_reference (seeds[i], length);
+        output = g_malloc (length);
+
+        for (size_t j = 0; j < G_N_ELEMENTS (piece_lengths); j++)
+        {
+            RasKeystream keystream;
+
+            ras_keystream_init (&keystream, seeds[i]);
+
+            for (size_t offset = 0; offset < length; offset += piece_lengths[j])
+            {
+                ras_keystream_generate (&keystream, output + offset,
+                                        MIN (piece_lengths[j], length - offset));
+            }
+
+            ras_keystream_clear (&keystream);
+
+            g_assert_cmpmem (output, length, expected, length);
+        }
+    }
+}
+
+/* Seeks, forwards and back, to positions on both sides of the threshold and
+ * past the end of the cycle, and checks that the same bytes come out as when
+ * generating up to there.
+ */
+static void
+test_keystream_seek (void)
+{
+    const size_t length = 3 * RAS_KEYSTREAM_TABLE_THRESHOLD;
+    const uint64_t positions[] =
+    {
+        0, 1, 1000,
+        RAS_KEYSTREAM_TABLE_THRESHOLD - 100, RAS_KEYSTREAM_TABLE_THRESHOLD - 1,
+        RAS_KEYSTREAM_TABLE_THRESHOLD, RAS_KEYSTREAM_TABLE_THRESHOLD + 1,
+        2 * RAS_KEYSTREAM_TABLE_THRESHOLD + 12345, 7,
+    };
+
+    for (size_t i = 0; i < G_N_ELEMENTS (seeds); i++)
+    {
+        g_autofree uint8_t *expected = NULL;
+        RasKeystream keystream;
+        RasKeystream other;
+
+        expected = generate_reference (seeds[i], length);
+
+        /* Through one keystream, so that it seeks from wherever the previous
+         * position left it, and through fresh ones that share its table.
+         */
+        ras_keystream_init (&keystream, seeds[i]);
+
+        for (size_t j = 0; j < G_N_ELEMENTS (positions); j++)
+        {
+            uint8_t output[1000];
+
+            ras_keystream_seek (&keystream, positions[j]);
+            ras_keystream_generate (&keystream, output, sizeof (output));
+
+            g_assert_cmpmem (output, sizeof (output), expected + positions[j], sizeof (output));
+
+            ras_keystream_init (&other, seeds[i]);
+            ras_keystream_seek (&other, positions[j]);
+            ras_keystream_generate (&other, output, sizeof (output));
+            ras_keystream_clear (&other);
+
+            g_assert_cmpmem (output, sizeof (output), expected + positions[j], sizeof (output));
+        }
+
+        ras_keystream_clear (&keystream);
+    }
+}
+
+static void
+test_encrypt (void)
+{
+    g_autoptr (GRand) rand = NULL;
+    uint8_t input[100];
+    uint8_t keystream[sizeof (input)];
+    uint8_t encrypted[sizeof (input)];
+    uint8_t decrypted[sizeof (input)];
+
+    rand = g_rand_new_with_seed (1);
+
+    fill_random (rand, input, sizeof (input));
+    fill_random (rand, keystream, sizeof (keystream));
+
+    for (uint64_t position = 0; position < 10; position++)
+    {
+        ras_cipher_encrypt (input, encrypted, sizeof (input), position, keystream);
+        ras_cipher_decrypt (encrypted, decrypted, sizeof (input), position, keystream);
+
+        g_assert_cmpmem (decrypted, sizeof (decrypted), input, sizeof (input));
+    }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    const char *kernel_names[] =
+    {
+        [RAS_CIPHER_KERNEL_SCALAR] = "scalar",
+        [RAS_CIPHER_KERNEL_SSE2] = "sse2",
+        [RAS_CIPHER_KERNEL_AVX2] = "avx2",
+    };
+
+    G_STATIC_ASSERT (G_N_ELEMENTS (kernel_names) == RAS_CIPHER_N_KERNELS);
+
+    g_test_init (&argc, &argv, NULL);
+
+    for (int kernel = 0; kernel < RAS_CIPHER_N_KERNELS; kernel++)
+    {
+        g_autofree char *path = NULL;
+
+        path = g_strdup_printf ("/cipher/kernel/%s", kernel_names[kernel]);
+
+        g_test_add_data_func (path, GINT_TO_POINTER (kernel), test_kernel);
+    }
+    g_test_add_func ("/cipher/encrypt", test_encrypt);
+    g_test_add_func ("/cipher/keystream/sequential", test_keystream_sequential);
+    g_test_add_func ("/cipher/keystream/seek", test_keystream_seek);
+
+    return g_test_run ();
+}
@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <ras-archive.h>
+
+#include "test-utils.h"
+
+/* Past 32 checkpoints at the initial interval of 64 KiB, twice over, so that
+ * the checkpoints are halved twice.
+ */
+static const TestEntry entries[] =
+{
+    { "large.dat", 5 * 0x100000 + 777, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "stored.dat", 300000, RAS_FILE_COMPRESSION_METHOD_STORE },
+};
+
+typedef enum
+{
+    SOURCE_BYTES,
+    SOURCE_FD,
+    SOURCE_STREAM,
+} SourceType;
+
+typedef struct
+{
+    GFile *directory;
+    RasArchive *archive;
+} Fixture;
+
+static void
+fixture_set_up (Fixture    *fixture,
+                const void *user_data)
+{
+    SourceType type;
+    g_autofree char *path = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GError) error = NULL;
+
+    type = GPOINTER_TO_INT (user_data);
+    path = g_dir_make_tmp ("ras-test-XXXXXX", &error);
+    g_assert_no_error (error);
+
+    fixture->directory = g_file_new_for_path (path);
+    file = test_build_archive_file (fixture->directory, entries, G_N_ELEMENTS (entries));
+
+    switch (type)
+    {
+        case SOURCE_BYTES:
+        {
+            g_autoptr (GBytes) bytes = NULL;
+
+            bytes = g_file_load_bytes (file, NULL, NULL, &error);
+            g_assert_no_error (error);
+
+            fixture->archive = ras_archive_load (bytes, &error);
+
+            break;
+        }
+        case SOURCE_FD:
+        {
+            g_autofree char *file_path = NULL;
+            int fd;
+
+            file_path = g_file_get_path (file);
+            fd = open (file_path, O_RDONLY);
+            g_assert_cmpint (fd, >=, 0);
+
+            fixture->archive = ras_archive_load_from_fd (fd, &error);
+
+            close (fd);
+
+            break;
+        }
+        case SOURCE_STREAM:
+        {
+            g_autoptr (GFileInputStream) stream = NULL;
+
+            stream = g_file_read (file, NULL, &error);
+            g_assert_no_error (error);
+
+            fixture->archive = ras_archive_load_from_stream (G_INPUT_STREAM (stream), NULL, &error);
+
+            break;
+        }
+    }
+
+    g_assert_no_error (error);
+}
+
+static void
+fixture_tear_down (Fixture    *fixture,
+                   const void *user_data)
+{
+    g_clear_object (&fixture->archive);
+
+    test_delete_recursively (fixture->directory);
+
+    g_clear_object (&fixture->directory);
+}
+
+static GInputStream *
+open_entry (Fixture         *fixture,
+            const TestEntry *entry)
+{
+    GFileInputStream *stream;
+    g_autoptr (GError) error = NULL;
+
+    stream = ras_file_read (ras_archive_lookup (fixture->archive, entry->path), &error);
+    g_assert_no_error (error);
+
+    return G_INPUT_STREAM (stream);
+}
+
+/* Reads @length bytes at the current position and compares them. */
+static void
+check_read (GInputStream  *stream,
+            GBytes        *contents,
+            size_t         length)
+{
+    const uint8_t *data;
+    size_t size;
+    goffset position;
+    g_autofree uint8_t *buffer = NULL;
+    size_t bytes_read;
+    g_autoptr (GError) error = NULL;
+
+    data = g_bytes_get_data (contents, &size);
+    position = g_seekable_tell (G_SEEKABLE (stream));
+    buffer = g_malloc (length + 1);
+
+    g_input_stream_read_all (stream, buffer, length + 1, &bytes_read, NULL, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpuint (bytes_read, ==, MIN (length + 1, size - position));
+    g_assert_cmpmem (buffer, bytes_read, data + position, bytes_read);
+    g_assert_cmpint (g_seekable_tell (G_SEEKABLE (stream)), ==, position + bytes_read);
+}
+
+static void
+seek (GInputStream *stream,
+      goffset       offset,
+      GSeekType     type)
+{
+    g_autoptr (GError) error = NULL;
+
+    g_seekable_seek (G_SEEKABLE (stream), offset, type, NULL, &error);
+    g_assert_no_error (error);
+}
+
+static void
+test_sequential (Fixture    *fixture,
+                 const void *user_data)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS (entries); i++)
+    {
+        g_autoptr (GInputStream) stream = NULL;
+        g_autoptr (GBytes) contents = NULL;
+
+        stream = open_entry (fixture, &entries[i]);
+        contents = test_entry_contents (entries[i].path, entries[i].size);
+
+        /* Odd lengths, so that reads straddle checkpoints. */
+        while (g_seekable_tell (G_SEEKABLE (stream)) < (goffset) entries[i].size)
+        {
+            check_read (stream, contents, 99991);
+        }
+    }
+}
+
+static void
+test_seek (Fixture    *fixture,
+           const void *user_data)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS (entries); i++)
+    {
+        g_autoptr (GRand) rand = NULL;
+        g_autoptr (GInputStream) stream = NULL;
+        g_autoptr (GBytes) contents = NULL;
+        goffset size;
+
+        rand = g_rand_new_with_seed (i);
+        stream = open_entry (fixture, &entries[i]);
+        contents = test_entry_contents (entries[i].path, entries[i].size);
+        size = entries[i].size;
+
+        /* Far ahead first, which decodes past where checkpoints are halved
+         * while skipping.
+         */
+        seek (stream, -1000, G_SEEK_END);
+        check_read (stream, contents, 1000);
+
+        seek (stream, 0, G_SEEK_SET);
+        check_read (stream, contents, 10);
+
+        for (int j = 0; j < 300; j++)
+        {
+            goffset position;
+            goffset current;
+
+            position = g_rand_int_range (rand, 0, size + 1);
+            current = g_seekable_tell (G_SEEKABLE (stream));
+
+            switch (j % 3)
+            {
+                case 0:
+                    seek (stream, position, G_SEEK_SET);
+                    break;
+
+                case 1:
+                    seek (stream, position - current, G_SEEK_CUR);
+                    break;
+
+                default:
+                    seek (stream, position - size, G_SEEK_END);
+                    break;
+            }
+
+            g_assert_cmpint (g_seekable_tell (G_SEEKABLE (stream)), ==, position);
+
+            /* Mostly short reads, with the odd long one across several
+             * checkpoints.
+             */
+            check_read (stream, contents,
+                        0 == j % 10? g_rand_int_range (rand, 0, 0x40000)
+                                   : g_rand_int_range (rand, 0, 0x1000));
+        }
+
+        /* Seeking outside of the entry fails and stays put. */
+        seek (stream, 5, G_SEEK_SET);
+
+        g_assert_false (g_seekable_seek (G_SEEKABLE (stream), size + 1, G_SEEK_SET, NULL, NULL));
+        g_assert_false (g_seekable_seek (G_SEEKABLE (stream), -6, G_SEEK_CUR, NULL, NULL));
+        g_assert_cmpint (g_seekable_tell (G_SEEKABLE (stream)), ==, 5);
+
+        check_read (stream, contents, 5);
+    }
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/file-input-stream/bytes/sequential", Fixture, GINT_TO_POINTER (SOURCE_BYTES),
+                fixture_set_up, test_sequential, fixture_tear_down);
+    g_test_add ("/file-input-stream/bytes/seek", Fixture, GINT_TO_POINTER (SOURCE_BYTES),
+                fixture_set_up, test_seek, fixture_tear_down);
+    g_test_add ("/file-input-stream/fd/sequential", Fixture, GINT_TO_POINTER (SOURCE_FD),
+                fixture_set_up, test_sequential, fixture_tear_down);
+    g_test_add ("/file-input-stream/fd/seek", Fixture, GINT_TO_POINTER (SOURCE_FD),
+                fixture_set_up, test_seek, fixture_tear_down);
+    g_test_add ("/file-input-stream/stream/sequential", Fixture, GINT_TO_POINTER (SOURCE_STREAM),
+                fixture_set_up, test_sequential, fixture_tear_down);
+    g_test_add ("/file-input-stream/stream/seek", Fixture, GINT_TO_POINTER (SOURCE_STREAM),
+                fixture_set_up, test_seek, fixture_tear_down);
+
+    return g_test_run ();
+}
@@ -1,7 +1,12 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <iso646.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <ras-archive.h>
+#include <ras-archive-writer.h>
 #include <ras-directory.h>
 #include <ras-file.h>
 
@@ -37,29 +42,316 @@ decompress_file (RasFile  *entry,
     return ras_file_extract (entry, G_OUTPUT_STREAM (stream), NULL, error);
 }
 
+/* Adds @file as @path, or the contents of @file if it is a directory and @path
+ * is %NULL.
+ */
+static bool
+compress_path (RasArchiveWriter      *writer,
+               GFile                 *file,
+               const char            *path,
+               RasCompressionMethod   compression_method,
+               GError               **error)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+
+    if (G_FILE_TYPE_DIRECTORY not_eq g_file_query_file_type (file, G_FILE_QUERY_INFO_NONE, NULL))
+    {
+        g_message ("Adding %s…", path);
+
+        return ras_archive_writer_add_file (writer, path, file, compression_method, NULL, error);
+    }
+
+    if (NULL != path && !ras_archive_writer_add_directory (writer, path, NULL, error))
+    {
+        return false;
+    }
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NONE, NULL, error);
+    if (NULL == enumerator)
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        GFileInfo *info;
+        GFile *child;
+        g_autofree char *child_path = NULL;
+
+        if (!g_file_enumerator_iterate (enumerator, &info, &child, NULL, error))
+        {
+            return false;
+        }
+        if (NULL == info)
+        {
+            break;
+        }
+
+        if (NULL == path)
+        {
+            child_path = g_strdup (g_file_info_get_name (info));
+        }
+        else
+        {
+            child_path = g_build_path ("\\", path, g_file_info_get_name (info), NULL);
+        }
+
+        if (!compress_path (writer, child, child_path, compression_method, error))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+compress (const char    *archive_path,
+          char         **paths,
+          bool           force,
+          bool           store,
+          unsigned int   jobs)
+{
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFileOutputStream) stream = NULL;
+    g_autofree char *directory = NULL;
+    g_autoptr (RasArchiveWriter) writer = NULL;
+    g_autoptr (GError) error = NULL;
+    RasCompressionMethod compression_method;
+
+    file = g_file_new_for_commandline_arg (archive_path);
+    if (force)
+    {
+        stream = g_file_replace (file, NULL, false,
+                                 G_FILE_CREATE_REPLACE_DESTINATION, NULL,
+                                 &error);
+    }
+    else
+    {
+        stream = g_file_create (file, G_FILE_CREATE_NONE, NULL, &error);
+    }
+    if (NULL == stream)
+    {
+        g_printerr ("Failed to create archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    /* Spool next to the archive, as the temporary directory may be in
+     * memory.
+     */
+    directory = g_path_get_dirname (archive_path);
+    writer = ras_archive_writer_new (G_OUTPUT_STREAM (stream), RAS_FORMAT_VERSION,
+                                     g_random_int (), directory, &error);
+    if (NULL == writer)
+    {
+        g_printerr ("Failed to create archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    ras_archive_writer_set_n_threads (writer, jobs);
+
+    compression_method = store? RAS_FILE_COMPRESSION_METHOD_STORE
+                              : RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+
+    for (size_t i = 0; NULL != paths[i]; i++)
+    {
+        g_autoptr (GFile) input = NULL;
+        g_autofree char *basename = NULL;
+
+        input = g_file_new_for_commandline_arg (paths[i]);
+
+        /* Directories given on the command line become the root. */
+        if (G_FILE_TYPE_DIRECTORY not_eq g_file_query_file_type (input, G_FILE_QUERY_INFO_NONE, NULL))
+        {
+            basename = g_file_get_basename (input);
+        }
+
+        if (!compress_path (writer, input, basename, compression_method, &error))
+        {
+            g_printerr ("Failed to add %s: %s\n", paths[i], error->message);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!ras_archive_writer_finish (writer, NULL, &error)
+        || !g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error))
+    {
+        g_printerr ("Failed to write archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Adds or replaces the files in @paths under their basenames. */
+static int
+update (const char    *archive_path,
+        char         **paths,
+        bool           store)
+{
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GArray) entries = NULL;
+    g_autoptr (GPtrArray) streams = NULL;
+    g_autoptr (GPtrArray) names = NULL;
+    g_autoptr (GError) error = NULL;
+
+    file = g_file_new_for_commandline_arg (archive_path);
+    entries = g_array_new (false, true, sizeof (RasArchiveUpdateEntry));
+    streams = g_ptr_array_new_with_free_func (g_object_unref);
+    names = g_ptr_array_new_with_free_func (g_free);
+
+    for (size_t i = 0; NULL != paths[i]; i++)
+    {
+        g_autoptr (GFile) input = NULL;
+        GFileInputStream *stream;
+        char *name;
+        RasArchiveUpdateEntry entry = { 0 };
+
+        input = g_file_new_for_commandline_arg (paths[i]);
+        stream = g_file_read (input, NULL, &error);
+        if (NULL == stream)
+        {
+            g_printerr ("Failed to open %s: %s\n", paths[i], error->message);
+
+            return EXIT_FAILURE;
+        }
+        name = g_file_get_basename (input);
+
+        g_ptr_array_add (streams, stream);
+        g_ptr_array_add (names, name);
+
+        entry.path = name;
+        entry.stream = G_INPUT_STREAM (stream);
+        entry.compression_method = store? RAS_FILE_COMPRESSION_METHOD_STORE
+                                        : RAS_FILE_COMPRESSION_METHOD_COMPRESS;
+
+        g_array_append_val (entries, entry);
+
+        g_message ("Updating %s…", name);
+    }
+
+    if (!ras_archive_update (file, (RasArchiveUpdateEntry *) entries->data, entries->len,
+                             NULL, &error))
+    {
+        g_printerr ("Failed to update archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int
+verify (RasArchive *archive,
+        int         jobs)
+{
+    g_autoptr (GPtrArray) errors = NULL;
+    g_autoptr (GError) error = NULL;
+    size_t failed_count = 0;
+
+    if (!ras_archive_verify (archive, jobs, &errors, NULL, &error) && NULL == errors)
+    {
+        g_printerr ("Failed to test archive: %s\n", error->message);
+
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < errors->len; i++)
+    {
+        RasFile *file;
+        g_autofree char *name = NULL;
+        GError *file_error;
+
+        file = ras_archive_get_file_by_index (archive, i);
+        name = ras_file_get_name (file);
+        file_error = g_ptr_array_index (errors, i);
+
+        if (NULL == file_error)
+        {
+            g_print ("OK\t%s\n", name);
+        }
+        else
+        {
+            g_print ("FAILED\t%s: %s\n", name, file_error->message);
+
+            failed_count++;
+        }
+    }
+
+    if (failed_count > 0)
+    {
+        g_printerr ("%zu of %u entries are broken\n", failed_count, errors->len);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 int
 main (int    argc,
       char **argv)
 {
     g_autoptr (GOptionContext) option_context = NULL;
+    gboolean compress_ = false;
+    gboolean update_ = false;
+    gboolean compact = false;
     gboolean decompress = false;
+    gboolean test_ = false;
     gboolean force = false;
+    gboolean store = false;
+    int jobs = 1;
     const char *only = NULL;
     const char *output_dir = "";
     g_auto (GStrv) files = NULL;
     const GOptionEntry option_entries[] =
     {
+        {
+            "compress", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_NONE, &compress_,
+            "Create archive FILE from the files that follow", NULL,
+        },
+        {
+            "update", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_NONE, &update_,
+            "Add or replace the files that follow in archive FILE", NULL,
+        },
+        {
+            "compact", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_NONE, &compact,
+            "Remove dead space from archive FILE", NULL,
+        },
         {
             "decompress", 0, G_OPTION_FLAG_NONE,
             G_OPTION_ARG_NONE, &decompress,
             "Decompress FILE", NULL,
 
         },
+        {
+            "test", 't', G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_NONE, &test_,
+            "Check that every entry in FILE decodes correctly", NULL,
+        },
         {
             "force", 'f', G_OPTION_FLAG_NONE,
             G_OPTION_ARG_NONE, &force,
             "Overwrite existing files", NULL,
         },
+        {
+            "store", 0, G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_NONE, &store,
+            "Store files without compressing them", NULL,
+        },
+        {
+            "jobs", 'j', G_OPTION_FLAG_NONE,
+            G_OPTION_ARG_INT, &jobs,
+            "Extract, test or compress using N threads (0 for one per CPU)", "N",
+        },
         {
             "only", 0, G_OPTION_FLAG_NONE,
             G_OPTION_ARG_STRING, &only,
@@ -81,8 +373,7 @@ main (int    argc,
             NULL, NULL,
         }
     };
-    g_autoptr (GMappedFile) file = NULL;
-    g_autoptr (GBytes) bytes = NULL;
+    int fd;
     g_autoptr (RasArchive) archive = NULL;
     g_autoptr (GError) error = NULL;
     g_autoptr (GList) directory_table = NULL;
@@ -107,15 +398,65 @@ main (int    argc,
         return EXIT_FAILURE;
     }
 
-    file = g_mapped_file_new (files[0], false, &error);
-    if (NULL == file)
+    if (compress_)
     {
-        g_printerr ("Failed to open archive: %s\n", error->message);
+        if (NULL == files[1])
+        {
+            g_printerr ("No files to compress specified\n");
+
+            return EXIT_FAILURE;
+        }
+
+        if (jobs < 0)
+        {
+            g_printerr ("Invalid number of jobs: %d\n", jobs);
+
+            return EXIT_FAILURE;
+        }
+
+        return compress (files[0], files + 1, force, store, jobs);
+    }
+
+    if (update_)
+    {
+        if (NULL == files[1])
+        {
+            g_printerr ("No files to update specified\n");
+
+            return EXIT_FAILURE;
+        }
+
+        return update (files[0], files + 1, store);
+    }
+
+    if (compact)
+    {
+        g_autoptr (GFile) archive_file = NULL;
+
+        archive_file = g_file_new_for_commandline_arg (files[0]);
+
+        if (!ras_archive_compact (archive_file, NULL, &error))
+        {
+            g_printerr ("Failed to compact archive: %s\n", error->message);
+
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    /* Loading from the descriptor lets stored entries be copied by the
+     * kernel when extracting.
+     */
+    fd = open (files[0], O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+    {
+        g_printerr ("Failed to open archive: %s\n", g_strerror (errno));
 
         return EXIT_FAILURE;
     }
-    bytes = g_mapped_file_get_bytes (file);
-    archive = ras_archive_load (bytes, &error);
+    archive = ras_archive_load_from_fd (fd, &error);
+    (void) close (fd);
     if (NULL == archive)
     {
         g_printerr ("Failed to load archive: %s\n", error->message);
@@ -124,37 +465,45 @@ main (int    argc,
     }
     directory_table = ras_archive_get_directory_table (archive);
 
+    if (test_)
+    {
+        if (jobs < 0)
+        {
+            g_printerr ("Invalid number of jobs: %d\n", jobs);
+
+            return EXIT_FAILURE;
+        }
+
+        return verify (archive, jobs);
+    }
+
     if (!decompress)
     {
         uint32_t file_count;
         uint32_t directory_count;
-        g_autoptr (GList) directories = NULL;
 
         file_count = ras_archive_get_file_count (archive);
         directory_count = ras_archive_get_directory_count (archive);
-        directories = ras_archive_get_directory_table (archive);
-        directories = g_list_reverse (directories);
 
         g_print ("%s:\n"
                  "\t%u files in %u directories\n\n",
                  files[0], file_count, directory_count);
 
-        for (GList *directory = directories; NULL != directory; directory = g_list_next (directory))
+        for (uint32_t i = 0; i < directory_count; i++)
         {
+            RasDirectory *directory;
             g_autofree char *directory_name = NULL;
-            g_autoptr (GList) files = NULL;
 
-            directory_name = ras_directory_get_name (directory->data, false);
-            files = ras_directory_get_files (directory->data);
-            files = g_list_reverse (files);
+            directory = ras_archive_get_directory_by_index (archive, i);
+            directory_name = ras_directory_get_name (directory, false);
 
             g_print ("\t%s:\n", directory_name);
 
-            for (GList *file = files; NULL != file; file = g_list_next (file))
+            for (size_t j = 0; j < ras_directory_get_file_count (directory); j++)
             {
                 g_autofree char *file_name = NULL;
 
-                file_name = ras_file_get_name (file->data);
+                file_name = ras_file_get_name (ras_directory_get_file (directory, j));
 
                 g_print ("\t\t%s\n", file_name);
             }
@@ -163,7 +512,29 @@ main (int    argc,
         return EXIT_SUCCESS;
     }
 
-    if (decompress)
+    if (decompress && NULL == only)
+    {
+        g_autoptr (GFile) destination = NULL;
+        RasExtractFlags flags;
+
+        destination = g_file_new_for_path ('\0' == *output_dir? "." : output_dir);
+        flags = force? RAS_EXTRACT_FLAGS_OVERWRITE : RAS_EXTRACT_FLAGS_NONE;
+
+        if (jobs < 0)
+        {
+            g_printerr ("Invalid number of jobs: %d\n", jobs);
+
+            return EXIT_FAILURE;
+        }
+
+        if (!ras_archive_extract_all (archive, destination, jobs, flags, NULL, &error))
+        {
+            g_printerr ("Failed to extract archive: %s\n", error->message);
+
+            return EXIT_FAILURE;
+        }
+    }
+    else if (decompress)
     {
         for (GList *d = directory_table; NULL != d; d = d->next)
         {
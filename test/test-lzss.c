@@ -0,0 +1,328 @@
+#include <iso646.h>
+#include <string.h>
+
+#include <ras-lzss.h>
+
+static const RasLzssLevel levels[] =
+{
+    RAS_LZSS_LEVEL_FASTEST,
+    5,
+    RAS_LZSS_LEVEL_BEST,
+};
+
+/* Decodes in pieces of @chunk_size bytes, so that matches are split across
+ * calls.
+ */
+static void
+check_tokens (const uint8_t *tokens,
+              size_t         length,
+              const uint8_t *data,
+              size_t         size,
+              size_t         chunk_size)
+{
+    g_autofree uint8_t *output = NULL;
+    RasLzssDecoder decoder;
+    size_t offset;
+
+    output = g_malloc (size + 1);
+    offset = 0;
+
+    ras_lzss_decoder_init (&decoder, tokens, length);
+
+    while (offset < size)
+    {
+        size_t bytes_written;
+
+        ras_lzss_decoder_decode (&decoder, output + offset, MIN (chunk_size, size - offset),
+                                 &bytes_written);
+        g_assert_cmpuint (bytes_written, >, 0);
+
+        offset += bytes_written;
+    }
+
+    g_assert_true (ras_lzss_decoder_is_finished (&decoder));
+    g_assert_cmpmem (output, size, data, size);
+}
+
+/* Checks the header of an entry and that its tokens decode to @data. */
+static void
+check_entry (GBytes        *compressed,
+             const uint8_t *data,
+             size_t         size,
+             size_t         chunk_size)
+{
+    const uint8_t *tokens;
+    size_t length;
+    uint32_t value;
+
+    g_assert_nonnull (compressed);
+
+    tokens = g_bytes_get_data (compressed, &length);
+    g_assert_cmpuint (length, >=, RAS_LZSS_HEADER_LENGTH);
+    g_assert_cmpmem (tokens, strlen (RAS_LZSS_HEADER), RAS_LZSS_HEADER, strlen (RAS_LZSS_HEADER));
+
+    memcpy (&value, tokens + 4, sizeof (value));
+    g_assert_cmpuint (GUINT32_FROM_LE (value), ==, size);
+    memcpy (&value, tokens + 8, sizeof (value));
+    g_assert_cmpuint (GUINT32_FROM_LE (value), ==, length - RAS_LZSS_HEADER_LENGTH);
+
+    check_tokens (tokens + RAS_LZSS_HEADER_LENGTH, length - RAS_LZSS_HEADER_LENGTH,
+                  data, size, chunk_size);
+}
+
+static void
+check_round_trip (const uint8_t *data,
+                  size_t         size,
+                  size_t         chunk_size)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS (levels); i++)
+    {
+        g_autoptr (GBytes) compressed = NULL;
+
+        compressed = ras_lzss_compress (data, size, levels[i]);
+
+        check_entry (compressed, data, size, chunk_size);
+    }
+}
+
+static void
+test_empty (void)
+{
+    check_round_trip (NULL, 0, 1);
+}
+
+static void
+test_tiny (void)
+{
+    /* Long enough for a match of the minimum length. */
+    const uint8_t data[] = "aaaaab";
+
+    for (size_t size = 1; size < sizeof (data); size++)
+    {
+        check_round_trip (data, size, 1);
+    }
+}
+
+static void
+test_random (void)
+{
+    g_autoptr (GRand) rand = NULL;
+    size_t size;
+    g_autofree uint8_t *data = NULL;
+
+    rand = g_rand_new_with_seed (1);
+    size = 3 * RAS_LZSS_WINDOW_SIZE + 7;
+    data = g_malloc (size);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = g_rand_int (rand);
+    }
+
+    check_round_trip (data, size, size);
+    check_round_trip (data, size, 1000);
+}
+
+static void
+test_repetitive (void)
+{
+    size_t size;
+    g_autofree uint8_t *data = NULL;
+
+    size = 5 * RAS_LZSS_WINDOW_SIZE + 3;
+    data = g_malloc (size);
+
+    /* Long runs, which are all maximum-length matches, then a short period
+     * that leaves odd match lengths at the end.
+     */
+    memset (data, ' ', size / 2);
+
+    for (size_t i = size / 2; i < size; i++)
+    {
+        data[i] = "abcde"[i % 5];
+    }
+
+    check_round_trip (data, size, size);
+    check_round_trip (data, size, 7);
+}
+
+/* Zero is one thread per processor. */
+static const unsigned int thread_counts[] = { 1, 2, 16, 0 };
+
+/* Several segments and a partial one, of runs copied from earlier between
+ * random ones.
+ */
+static uint8_t *
+generate_segments (size_t *size)
+{
+    g_autoptr (GRand) rand = NULL;
+    uint8_t *data;
+
+    rand = g_rand_new_with_seed (2);
+    *size = 3 * RAS_LZSS_SEGMENT_SIZE + RAS_LZSS_SEGMENT_SIZE / 3;
+    data = g_malloc (*size);
+
+    for (size_t i = 0; i < *size; )
+    {
+        size_t length;
+
+        length = g_rand_int_range (rand, 1, 40);
+        length = MIN (length, *size - i);
+
+        if (i >= RAS_LZSS_WINDOW_SIZE && g_rand_boolean (rand))
+        {
+            size_t distance;
+
+            distance = g_rand_int_range (rand, 1, RAS_LZSS_WINDOW_SIZE);
+
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = data[i + j - distance];
+            }
+        }
+        else
+        {
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = g_rand_int (rand);
+            }
+        }
+
+        i += length;
+    }
+
+    return data;
+}
+
+static void
+test_parallel (void)
+{
+    g_autofree uint8_t *data = NULL;
+    size_t size;
+
+    data = generate_segments (&size);
+
+    for (size_t i = 0; i < G_N_ELEMENTS (levels); i++)
+    {
+        g_autoptr (GBytes) reference = NULL;
+
+        for (size_t j = 0; j < G_N_ELEMENTS (thread_counts); j++)
+        {
+            g_autoptr (GBytes) compressed = NULL;
+
+            compressed = ras_lzss_compress_parallel (data, size, levels[i], thread_counts[j]);
+
+            check_entry (compressed, data, size, 100000);
+
+            /* Segments come out the same whichever thread compresses them. */
+            if (NULL == reference)
+            {
+                reference = g_bytes_ref (compressed);
+            }
+            g_assert_true (g_bytes_equal (compressed, reference));
+        }
+    }
+}
+
+/* Segments can be compressed a few at a time, as they are read. */
+static void
+test_segments (void)
+{
+    g_autofree uint8_t *data = NULL;
+    size_t size;
+    const size_t splits[] = { 0, RAS_LZSS_SEGMENT_SIZE, 3 * RAS_LZSS_SEGMENT_SIZE };
+
+    data = generate_segments (&size);
+
+    for (size_t i = 0; i < G_N_ELEMENTS (thread_counts); i++)
+    {
+        g_autoptr (RasLzssJoiner) joiner = NULL;
+        g_autoptr (GByteArray) output = NULL;
+        g_autoptr (GBytes) reference = NULL;
+        const uint8_t *reference_tokens;
+        size_t reference_length;
+
+        joiner = ras_lzss_joiner_new ();
+        output = g_byte_array_new ();
+
+        for (size_t j = 0; j < G_N_ELEMENTS (splits); j++)
+        {
+            size_t end;
+
+            end = j + 1 < G_N_ELEMENTS (splits)? splits[j + 1] : size;
+
+            ras_lzss_compress_segments (data + splits[j], end - splits[j],
+                                        RAS_LZSS_LEVEL_DEFAULT, thread_counts[i],
+                                        joiner, output);
+        }
+
+        ras_lzss_joiner_finish (joiner, output);
+
+        check_tokens (output->data, output->len, data, size, size);
+
+        reference = ras_lzss_compress_parallel (data, size, RAS_LZSS_LEVEL_DEFAULT, 1);
+        reference_tokens = g_bytes_get_data (reference, &reference_length);
+
+        g_assert_cmpmem (output->data, output->len,
+                         reference_tokens + RAS_LZSS_HEADER_LENGTH,
+                         reference_length - RAS_LZSS_HEADER_LENGTH);
+    }
+}
+
+/* Segments of any size can be joined, as long as each was compressed on
+ * its own.
+ */
+static void
+test_joiner (void)
+{
+    g_autofree uint8_t *data = NULL;
+    size_t size;
+    const size_t segment_sizes[] = { 1, 5000, RAS_LZSS_WINDOW_SIZE, 70001, 0, 3, 123456 };
+    g_autoptr (RasLzssJoiner) joiner = NULL;
+    g_autoptr (GByteArray) output = NULL;
+    size_t offset;
+
+    data = generate_segments (&size);
+    joiner = ras_lzss_joiner_new ();
+    output = g_byte_array_new ();
+    offset = 0;
+
+    for (size_t i = 0; i < G_N_ELEMENTS (segment_sizes); i++)
+    {
+        g_autoptr (GBytes) compressed = NULL;
+        const uint8_t *tokens;
+        size_t length;
+
+        compressed = ras_lzss_compress (data + offset, segment_sizes[i], RAS_LZSS_LEVEL_BEST);
+        tokens = g_bytes_get_data (compressed, &length);
+
+        ras_lzss_joiner_push (joiner,
+                              tokens + RAS_LZSS_HEADER_LENGTH,
+                              length - RAS_LZSS_HEADER_LENGTH,
+                              segment_sizes[i],
+                              output);
+
+        offset += segment_sizes[i];
+    }
+
+    ras_lzss_joiner_finish (joiner, output);
+
+    check_tokens (output->data, output->len, data, offset, 1000);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/lzss/empty", test_empty);
+    g_test_add_func ("/lzss/tiny", test_tiny);
+    g_test_add_func ("/lzss/random", test_random);
+    g_test_add_func ("/lzss/repetitive", test_repetitive);
+    g_test_add_func ("/lzss/parallel", test_parallel);
+    g_test_add_func ("/lzss/segments", test_segments);
+    g_test_add_func ("/lzss/joiner", test_joiner);
+
+    return g_test_run ();
+}
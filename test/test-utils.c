@@ -0,0 +1,179 @@
+#include "test-utils.h"
+
+#include <ras-archive-writer.h>
+
+GBytes *
+test_entry_contents (const char *path,
+                     size_t      size)
+{
+    g_autoptr (GRand) rand = NULL;
+    uint8_t *data;
+
+    rand = g_rand_new_with_seed (g_str_hash (path) ^ size);
+    data = g_malloc (size);
+
+    /* Runs copied from earlier, which compress, between random ones. */
+    for (size_t i = 0; i < size; )
+    {
+        size_t length;
+
+        length = g_rand_int_range (rand, 4, 33);
+        length = MIN (length, size - i);
+
+        if (i >= 64 && g_rand_boolean (rand))
+        {
+            size_t distance;
+
+            distance = g_rand_int_range (rand, 1, 65);
+
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = data[i + j - distance];
+            }
+        }
+        else
+        {
+            for (size_t j = 0; j < length; j++)
+            {
+                data[i + j] = g_rand_int (rand);
+            }
+        }
+
+        i += length;
+    }
+
+    return g_bytes_new_take (data, size);
+}
+
+GInputStream *
+test_entry_stream (const char *path,
+                   size_t      size)
+{
+    g_autoptr (GBytes) contents = NULL;
+
+    contents = test_entry_contents (path, size);
+
+    return g_memory_input_stream_new_from_bytes (contents);
+}
+
+static void
+write_archive (GOutputStream   *stream,
+               const TestEntry *entries,
+               size_t           n_entries)
+{
+    g_autoptr (RasArchiveWriter) writer = NULL;
+    g_autoptr (GError) error = NULL;
+
+    writer = ras_archive_writer_new (stream, RAS_FORMAT_VERSION, 0x1234, NULL, &error);
+    g_assert_no_error (error);
+
+    for (size_t i = 0; i < n_entries; i++)
+    {
+        g_autoptr (GInputStream) input = NULL;
+
+        input = test_entry_stream (entries[i].path, entries[i].size);
+
+        ras_archive_writer_add_stream (writer, entries[i].path, input,
+                                       entries[i].compression_method,
+                                       NULL, NULL, &error);
+        g_assert_no_error (error);
+    }
+
+    ras_archive_writer_finish (writer, NULL, &error);
+    g_assert_no_error (error);
+    g_output_stream_close (stream, NULL, &error);
+    g_assert_no_error (error);
+}
+
+GBytes *
+test_build_archive (const TestEntry *entries,
+                    size_t           n_entries)
+{
+    g_autoptr (GOutputStream) stream = NULL;
+
+    stream = g_memory_output_stream_new_resizable ();
+
+    write_archive (stream, entries, n_entries);
+
+    return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (stream));
+}
+
+GFile *
+test_build_archive_file (GFile           *directory,
+                         const TestEntry *entries,
+                         size_t           n_entries)
+{
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFileOutputStream) stream = NULL;
+    g_autoptr (GError) error = NULL;
+
+    file = g_file_get_child (directory, "test.ras");
+    stream = g_file_replace (file, NULL, false, G_FILE_CREATE_NONE, NULL, &error);
+    g_assert_no_error (error);
+
+    write_archive (G_OUTPUT_STREAM (stream), entries, n_entries);
+
+    return g_steal_pointer (&file);
+}
+
+void
+test_check_entry (RasArchive *archive,
+                  const char *path,
+                  size_t      size)
+{
+    RasFile *file;
+    g_autoptr (GBytes) expected = NULL;
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GError) error = NULL;
+
+    file = ras_archive_lookup (archive, path);
+    g_assert_nonnull (file);
+    g_assert_cmpuint (ras_file_get_size (file), ==, size);
+
+    expected = test_entry_contents (path, size);
+    bytes = ras_file_get_bytes (file, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpmem (g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes),
+                     g_bytes_get_data (expected, NULL), size);
+}
+
+void
+test_check_file (GFile      *file,
+                 const char *path,
+                 size_t      size)
+{
+    g_autoptr (GBytes) expected = NULL;
+    g_autofree char *contents = NULL;
+    size_t length;
+    g_autoptr (GError) error = NULL;
+
+    expected = test_entry_contents (path, size);
+
+    g_file_load_contents (file, NULL, &contents, &length, NULL, &error);
+    g_assert_no_error (error);
+
+    g_assert_cmpmem (contents, length, g_bytes_get_data (expected, NULL), size);
+}
+
+void
+test_delete_recursively (GFile *file)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                            NULL, NULL);
+    if (NULL != enumerator)
+    {
+        GFile *child;
+
+        while (g_file_enumerator_iterate (enumerator, NULL, &child, NULL, NULL)
+               && NULL != child)
+        {
+            test_delete_recursively (child);
+        }
+    }
+
+    (void) g_file_delete (file, NULL, NULL);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <ras-archive.h>
+
+typedef struct
+{
+    const char *path;
+    size_t size;
+    RasCompressionMethod compression_method;
+} TestEntry;
+
+/* The contents of an entry depend only on its path and size, so that any
+ * archive it was written to can be checked against them.
+ */
+GBytes *test_entry_contents (const char *path,
+                             size_t      size);
+GInputStream *test_entry_stream (const char *path,
+                                 size_t      size);
+
+GBytes *test_build_archive (const TestEntry *entries,
+                            size_t           n_entries);
+GFile *test_build_archive_file (GFile           *directory,
+                                const TestEntry *entries,
+                                size_t           n_entries);
+
+void test_check_entry (RasArchive *archive,
+                       const char *path,
+                       size_t      size);
+void test_check_file (GFile      *file,
+                      const char *path,
+                      size_t      size);
+
+void test_delete_recursively (GFile *file);
@@ -0,0 +1,315 @@
+#include <ras-vfs-file.h>
+
+#include "test-utils.h"
+
+static const TestEntry entries[] =
+{
+    { "readme.txt", 100, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "data\\small.dat", 3000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\large.dat", 300000, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "data\\maps\\level1.map", 5000, RAS_FILE_COMPRESSION_METHOD_STORE },
+    { "data\\maps\\empty.map", 0, RAS_FILE_COMPRESSION_METHOD_COMPRESS },
+    { "sounds\\music.ogg", 20000, RAS_FILE_COMPRESSION_METHOD_STORE },
+};
+
+/* Implied by the paths of the entries. */
+static const char * const directories[] =
+{
+    "data",
+    "data\\maps",
+    "sounds",
+};
+
+typedef struct
+{
+    RasArchive *archive;
+    GFile *root;
+} Fixture;
+
+static void
+fixture_set_up (Fixture    *fixture,
+                const void *user_data)
+{
+    g_autoptr (GBytes) bytes = NULL;
+    g_autoptr (GError) error = NULL;
+
+    bytes = test_build_archive (entries, G_N_ELEMENTS (entries));
+
+    fixture->archive = ras_archive_load (bytes, &error);
+    g_assert_no_error (error);
+
+    fixture->root = ras_vfs_file_new (fixture->archive, "/");
+}
+
+static void
+fixture_tear_down (Fixture    *fixture,
+                   const void *user_data)
+{
+    g_clear_object (&fixture->root);
+    g_clear_object (&fixture->archive);
+}
+
+static void
+check_contents (GFile      *file,
+                const char *path,
+                size_t      size)
+{
+    g_autoptr (GFileInputStream) stream = NULL;
+    g_autofree uint8_t *buffer = NULL;
+    size_t bytes_read;
+    g_autoptr (GBytes) contents = NULL;
+    g_autoptr (GError) error = NULL;
+
+    stream = g_file_read (file, NULL, &error);
+    g_assert_no_error (error);
+
+    /* One more than there is, to see that the stream ends. */
+    buffer = g_malloc (size + 1);
+    g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, size + 1, &bytes_read, NULL, &error);
+    g_assert_no_error (error);
+
+    contents = test_entry_contents (path, size);
+    g_assert_cmpmem (buffer, bytes_read,
+                     g_bytes_get_data (contents, NULL), g_bytes_get_size (contents));
+}
+
+/* Collects the archive paths of everything below @directory, using nothing
+ * but GIO, and checks each file on the way.
+ */
+static void
+walk (GFile      *directory,
+      const char *prefix,
+      GHashTable *files,
+      GHashTable *subdirectories)
+{
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    g_autoptr (GError) error = NULL;
+
+    enumerator = g_file_enumerate_children (directory,
+                                            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                            G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                            G_FILE_QUERY_INFO_NONE, NULL, &error);
+    g_assert_no_error (error);
+
+    for (;;)
+    {
+        g_autoptr (GFileInfo) info = NULL;
+        g_autoptr (GFileInfo) child_info = NULL;
+        g_autoptr (GFile) child = NULL;
+        g_autoptr (GFile) parent = NULL;
+        g_autofree char *path = NULL;
+        g_autofree char *basename = NULL;
+
+        info = g_file_enumerator_next_file (enumerator, NULL, &error);
+        g_assert_no_error (error);
+        if (NULL == info)
+        {
+            break;
+        }
+
+        child = g_file_get_child (directory, g_file_info_get_name (info));
+        path = '\0' == *prefix? g_strdup (g_file_info_get_name (info))
+                              : g_strconcat (prefix, "\\", g_file_info_get_name (info), NULL);
+
+        basename = g_file_get_basename (child);
+        g_assert_cmpstr (basename, ==, g_file_info_get_name (info));
+
+        parent = g_file_get_parent (child);
+        g_assert_true (g_file_equal (parent, directory));
+
+        child_info = g_file_query_info (child,
+                                        G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                                        G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                        G_FILE_QUERY_INFO_NONE, NULL, &error);
+        g_assert_no_error (error);
+        g_assert_cmpint (g_file_info_get_file_type (child_info), ==, g_file_info_get_file_type (info));
+
+        if (G_FILE_TYPE_DIRECTORY == g_file_info_get_file_type (info))
+        {
+            walk (child, path, files, subdirectories);
+
+            g_assert_true (g_hash_table_add (subdirectories, g_steal_pointer (&path)));
+        }
+        else
+        {
+            g_assert_cmpint (g_file_info_get_file_type (info), ==, G_FILE_TYPE_REGULAR);
+            g_assert_cmpint (g_file_info_get_size (child_info), ==, g_file_info_get_size (info));
+
+            check_contents (child, path, g_file_info_get_size (info));
+
+            g_assert_true (g_hash_table_insert (files, g_steal_pointer (&path),
+                                                GSIZE_TO_POINTER (g_file_info_get_size (info))));
+        }
+    }
+}
+
+static void
+test_walk (Fixture    *fixture,
+           const void *user_data)
+{
+    g_autoptr (GHashTable) files = NULL;
+    g_autoptr (GHashTable) subdirectories = NULL;
+
+    files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    subdirectories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    walk (fixture->root, "", files, subdirectories);
+
+    g_assert_cmpuint (g_hash_table_size (files), ==, G_N_ELEMENTS (entries));
+    g_assert_cmpuint (g_hash_table_size (files), ==, ras_archive_get_file_count (fixture->archive));
+
+    for (size_t i = 0; i < G_N_ELEMENTS (entries); i++)
+    {
+        void *size;
+
+        g_assert_true (g_hash_table_lookup_extended (files, entries[i].path, NULL, &size));
+        g_assert_cmpuint (GPOINTER_TO_SIZE (size), ==, entries[i].size);
+    }
+
+    g_assert_cmpuint (g_hash_table_size (subdirectories), ==, G_N_ELEMENTS (directories));
+
+    for (size_t i = 0; i < G_N_ELEMENTS (directories); i++)
+    {
+        g_assert_true (g_hash_table_contains (subdirectories, directories[i]));
+    }
+}
+
+static void
+test_errors (Fixture    *fixture,
+             const void *user_data)
+{
+    g_autoptr (GFile) directory = NULL;
+    g_autoptr (GFile) file = NULL;
+    g_autoptr (GFile) missing = NULL;
+    g_autoptr (GFileEnumerator) enumerator = NULL;
+    g_autoptr (GFileInputStream) stream = NULL;
+    g_autoptr (GFileInfo) info = NULL;
+    g_autoptr (GError) error = NULL;
+
+    directory = g_file_get_child (fixture->root, "data");
+    file = g_file_resolve_relative_path (fixture->root, "data/small.dat");
+    missing = g_file_get_child (directory, "missing.dat");
+
+    stream = g_file_read (directory, NULL, &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY);
+    g_assert_null (stream);
+    g_clear_error (&error);
+
+    enumerator = g_file_enumerate_children (file, G_FILE_ATTRIBUTE_STANDARD_NAME,
+                                            G_FILE_QUERY_INFO_NONE, NULL, &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY);
+    g_assert_null (enumerator);
+    g_clear_error (&error);
+
+    info = g_file_query_info (missing, G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                              G_FILE_QUERY_INFO_NONE, NULL, &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_assert_null (info);
+    g_clear_error (&error);
+
+    g_assert_false (g_file_query_exists (missing, NULL));
+    g_assert_true (g_file_query_exists (file, NULL));
+}
+
+static void
+check_path (GFile      *base,
+            const char *relative_path,
+            GFile      *expected)
+{
+    g_autoptr (GFile) file = NULL;
+
+    file = g_file_resolve_relative_path (base, relative_path);
+
+    g_assert_true (g_file_equal (file, expected));
+}
+
+static void
+test_parent (Fixture    *fixture,
+             const void *user_data)
+{
+    g_autoptr (GFile) map = NULL;
+    g_autoptr (GFile) maps = NULL;
+    g_autoptr (GFile) data = NULL;
+    g_autoptr (GFile) root = NULL;
+    g_autoptr (GFile) readme_parent = NULL;
+    g_autoptr (GFile) readme = NULL;
+    g_autofree char *relative_path = NULL;
+    g_autofree char *basename = NULL;
+
+    map = ras_vfs_file_new (fixture->archive, "data\\maps\\level1.map");
+    maps = g_file_get_parent (map);
+    data = g_file_get_parent (maps);
+    root = g_file_get_parent (data);
+
+    check_path (fixture->root, "data/maps", maps);
+    check_path (fixture->root, "data", data);
+    g_assert_true (g_file_equal (root, fixture->root));
+    g_assert_null (g_file_get_parent (root));
+
+    readme = g_file_get_child (fixture->root, "readme.txt");
+    readme_parent = g_file_get_parent (readme);
+    g_assert_true (g_file_equal (readme_parent, fixture->root));
+
+    basename = g_file_get_basename (root);
+    g_assert_cmpstr (basename, ==, "/");
+
+    g_assert_true (g_file_has_prefix (map, fixture->root));
+    g_assert_true (g_file_has_prefix (map, data));
+    g_assert_false (g_file_has_prefix (data, map));
+    g_assert_false (g_file_has_prefix (fixture->root, fixture->root));
+
+    relative_path = g_file_get_relative_path (data, map);
+    g_assert_cmpstr (relative_path, ==, "maps/level1.map");
+}
+
+static void
+test_resolve (Fixture    *fixture,
+              const void *user_data)
+{
+    g_autoptr (GFile) maps = NULL;
+    g_autoptr (GFile) small = NULL;
+    g_autoptr (GFile) readme = NULL;
+
+    maps = ras_vfs_file_new (fixture->archive, "data/maps");
+    small = ras_vfs_file_new (fixture->archive, "data/small.dat");
+    readme = ras_vfs_file_new (fixture->archive, "readme.txt");
+
+    check_path (maps, "../small.dat", small);
+    check_path (maps, "..\\small.dat", small);
+    check_path (maps, "./.././small.dat", small);
+    check_path (maps, "../../readme.txt", readme);
+    check_path (fixture->root, "data//maps/..//small.dat", small);
+    /* Case is ignored, like in lookups. */
+    check_path (fixture->root, "DATA/Small.dat", small);
+
+    /* Absolute paths start over from the root. */
+    check_path (maps, "/readme.txt", readme);
+    check_path (maps, "\\data\\small.dat", small);
+
+    /* And nothing goes above it. */
+    check_path (maps, "../../..", fixture->root);
+    check_path (maps, "../../../../readme.txt", readme);
+    check_path (fixture->root, "..", fixture->root);
+    check_path (fixture->root, "/../data/../../data/small.dat", small);
+
+    check_contents (small, "data\\small.dat", 3000);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/vfs-file/walk", Fixture, NULL,
+                fixture_set_up, test_walk, fixture_tear_down);
+    g_test_add ("/vfs-file/errors", Fixture, NULL,
+                fixture_set_up, test_errors, fixture_tear_down);
+    g_test_add ("/vfs-file/parent", Fixture, NULL,
+                fixture_set_up, test_parent, fixture_tear_down);
+    g_test_add ("/vfs-file/resolve", Fixture, NULL,
+                fixture_set_up, test_resolve, fixture_tear_down);
+
+    return g_test_run ();
+}